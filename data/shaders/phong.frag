@@ -6,11 +6,24 @@ in float DiffuseTex;
 in vec2 DiffuseTexCoord;
 in vec3 Position;
 in vec3 Normal;
-in vec3 diffuse;
-in vec3 specular;
-in vec3 ambient;
 
-uniform vec3 cameraPos;
+// shared by all groups, set once per frame
+layout (std140, binding = ${CAMERA_BINDING}) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 cameraPos;
+};
+
+// w of diffuse is 1 if the diffuse map is used
+struct Material {
+    vec4 diffuse;
+    vec4 specular;
+    vec4 ambient;
+};
+layout (std430, binding = ${MATERIAL_BINDING}) readonly buffer Materials {
+    Material materials[];
+};
+uniform uint materialIndex;
 
 const int POINT_LIGHT_COUNT = ${POINT_LIGHT_COUNT};
 const float PI = 3.1415926536f;
@@ -77,9 +90,10 @@ void main()
     vec3 norm = normalize(Normal);
 
     vec3 Lo = vec3(0.f);
-    vec3 diffuseResult = diffuse;
+    Material material = materials[materialIndex];
+    vec3 diffuseResult = material.diffuse.rgb;
 
-    if (DiffuseTex >= 0.f) {
+    if (material.diffuse.w > 0.f && DiffuseTex >= 0.f) {
         vec2 Coord = fract(DiffuseTexCoord);
         diffuseResult = texture(textures[0], Coord).rgb;
     }
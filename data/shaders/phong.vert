@@ -1,36 +1,55 @@
 #version 460 core
 
+#if ${COMPACT_VERTICES}
+// 16-bit positions in the group bounds with the tex coord flag in w, octahedral normals, half float tex coords
+layout (location = 0) in vec4 aPosQuantized;
+layout (location = 1) in vec2 aNormalOctahedral;
+layout (location = 2) in vec2 aTexCoordsHalf;
+
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+vec3 decodeNormal(vec2 e) {
+    vec3 n = vec3(e, 1.f - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.f);
+    n.xy += vec2(n.x >= 0.f ? -t : t, n.y >= 0.f ? -t : t);
+    return normalize(n);
+}
+#else
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
-layout (location = 2) in vec3 aDiffuse;
-layout (location = 3) in vec3 aTexCoords;
-layout (location = 4) in vec3 aSpecular;
-layout (location = 5) in vec3 aAmbient;
+layout (location = 2) in vec3 aTexCoords;
+#endif
+layout (location = 6) in mat4 aModel;
+layout (location = 10) in mat3 aNormalMatrix;
 
 out float DiffuseTex;
 out vec2 DiffuseTexCoord;
 out vec3 Position;
 out vec3 Normal;
-out vec3 diffuse;
-out vec3 specular;
-out vec3 ambient;
 
-uniform mat4 view;
-uniform mat4 projection;
+// shared by all groups, set once per frame
+layout (std140, binding = ${CAMERA_BINDING}) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 cameraPos;
+};
 
 const float PI = 3.1415926536f;
 
 void main() {
-    Position = aPos;
+#if ${COMPACT_VERTICES}
+    vec3 aPos = positionOffset + aPosQuantized.xyz * positionScale;
+    vec3 aNormal = decodeNormal(aNormalOctahedral);
+    // back to the z < 0 of vertices without tex coords in the float3 streams
+    vec3 aTexCoords = vec3(aTexCoordsHalf, aPosQuantized.w > 0.5f ? 1.f : -1.f);
+#endif
+    Position = vec3(aModel * vec4(aPos, 1.0f));
     DiffuseTexCoord = aTexCoords.xy;
     DiffuseTex = aTexCoords.z;
 
-    Normal = aNormal;
-
-    diffuse = aDiffuse;
-    specular = aSpecular;
-    ambient = aAmbient;
+    Normal = aNormalMatrix * aNormal;
 
-    gl_Position = projection * view * vec4(aPos, 1.0f);
+    gl_Position = projection * view * vec4(Position, 1.0f);
 //    gl_Position /= gl_Position.w;
 }
@@ -1,7 +1,20 @@
 #version 330 core
+#if ${COMPACT_VERTICES}
+// 16-bit positions in the bounds of the group, w is the tex coord flag
+layout (location = 0) in vec4 aPosQuantized;
+
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+#else
 layout (location = 0) in vec3 aPos;
+#endif
+// per instance, the same streams as the main pass
+layout (location = 6) in mat4 aModel;
 
 void main()
 {
-    gl_Position = vec4(aPos, 1.0);
-}
\ No newline at end of file
+#if ${COMPACT_VERTICES}
+    vec3 aPos = positionOffset + aPosQuantized.xyz * positionScale;
+#endif
+    gl_Position = aModel * vec4(aPos, 1.0);
+}
@@ -10,6 +10,7 @@
 #include <base/camera.h>
 #include <base/pipeline.h>
 #include <core/logger.h>
+#include <core/profiler.h>
 
 using namespace gl_render;
 
@@ -19,6 +20,44 @@ using namespace gl_render;
                    cxxopts::value<uint32_t>()->default_value("0"), "<index>");
     cli.add_option("", "s", "scene", "Path to scene description file",
                    cxxopts::value<path>(), "<file>");
+    cli.add_option("", "t", "threads", "Worker threads for scene loading (0 = hardware concurrency, 1 = serial)",
+                   cxxopts::value<uint32_t>()->default_value("0"), "<count>");
+    cli.add_option("", "", "mesh-cache-dir", "Directory of the processed mesh cache (default: <scene dir>/.cache/meshes)",
+                   cxxopts::value<std::string>()->default_value(""), "<dir>");
+    cli.add_option("", "", "no-mesh-cache", "Always import meshes from their source files",
+                   cxxopts::value<bool>()->default_value("false"), "");
+    cli.add_option("", "", "mesh-memory-budget", "Budget in MB for meshes loaded but not yet uploaded (0 = unbounded)",
+                   cxxopts::value<uint32_t>()->default_value("512"), "<MB>");
+    cli.add_option("", "", "no-instancing", "Bake every mesh into its group instead of instancing shared mesh files",
+                   cxxopts::value<bool>()->default_value("false"), "");
+    cli.add_option("", "", "assimp-obj", "Import OBJ meshes with Assimp instead of the native OBJ loader",
+                   cxxopts::value<bool>()->default_value("false"), "");
+    cli.add_option("", "", "no-progressive", "Load the whole scene before the first frame",
+                   cxxopts::value<bool>()->default_value("false"), "");
+    cli.add_option("", "", "no-mesh-optimization", "Keep the triangle and vertex order of the imported meshes",
+                   cxxopts::value<bool>()->default_value("false"), "");
+    cli.add_option("", "", "compact-vertices", "Store vertices as 16-bit positions, octahedral normals and half float tex coords",
+                   cxxopts::value<bool>()->default_value("false"), "");
+    cli.add_option("", "", "no-lod", "Draw every mesh at full detail instead of selecting levels of detail",
+                   cxxopts::value<bool>()->default_value("false"), "");
+    cli.add_option("", "", "lod-error", "Largest screen-space error in pixels of the selected levels of detail",
+                   cxxopts::value<float>()->default_value("1"), "<px>");
+    cli.add_option("", "", "no-mesh-culling", "Draw all meshes instead of skipping those outside the view",
+                   cxxopts::value<bool>()->default_value("false"), "");
+    cli.add_option("", "", "no-meshlet-culling", "Draw all meshlets instead of skipping those outside the view or facing away",
+                   cxxopts::value<bool>()->default_value("false"), "");
+    cli.add_option("", "", "gpu-culling", "Cull meshlets in a compute shader that writes the draw commands",
+                   cxxopts::value<bool>()->default_value("false"), "");
+    cli.add_option("", "", "baked-transforms", "Bake mesh transforms into the vertices, objects cannot move then",
+                   cxxopts::value<bool>()->default_value("false"), "");
+    cli.add_option("", "", "benchmark-frames", "Render this many frames once the scene is loaded, log the average CPU frame time and exit",
+                   cxxopts::value<uint32_t>()->default_value("0"), "<count>");
+    cli.add_option("", "", "move-objects", "Spin this many objects every frame once the scene is loaded, their transforms are uploaded each frame",
+                   cxxopts::value<uint32_t>()->default_value("0"), "<count>");
+    cli.add_option("", "", "no-watch", "Do not reload the scene when its file changes",
+                   cxxopts::value<bool>()->default_value("false"), "");
+    cli.add_option("", "", "trace", "Write a Chrome trace of the scene loading to this file on exit",
+                   cxxopts::value<std::string>()->default_value(""), "<file>");
     cli.add_option("", "h", "help", "Display this help message",
                    cxxopts::value<bool>()->default_value("false"), "");
     cli.allow_unrecognised_options();
@@ -65,8 +104,36 @@ int main(int argc, char *argv[]) {
     auto device_index = options["device"].as<uint32_t>();
     auto scene_path = options["scene"].as<path>();
 
-    auto &pipeline = Pipeline::GetInstance(scene_path);
+    Pipeline::Config config;
+    config.geometry_config.thread_count = options["threads"].as<uint32_t>();
+    config.geometry_config.enable_mesh_cache = !options["no-mesh-cache"].as<bool>();
+    config.geometry_config.mesh_cache_dir = options["mesh-cache-dir"].as<std::string>();
+    config.geometry_config.mesh_memory_budget = options["mesh-memory-budget"].as<uint32_t>();
+    config.geometry_config.enable_instancing = !options["no-instancing"].as<bool>();
+    config.geometry_config.enable_native_obj = !options["assimp-obj"].as<bool>();
+    config.geometry_config.enable_progressive_loading = !options["no-progressive"].as<bool>();
+    config.geometry_config.enable_mesh_optimization = !options["no-mesh-optimization"].as<bool>();
+    config.geometry_config.enable_compact_vertices = options["compact-vertices"].as<bool>();
+    config.geometry_config.enable_lods = !options["no-lod"].as<bool>();
+    config.geometry_config.lod_error_threshold = options["lod-error"].as<float>();
+    config.geometry_config.enable_mesh_culling = !options["no-mesh-culling"].as<bool>();
+    config.geometry_config.enable_meshlet_culling = !options["no-meshlet-culling"].as<bool>();
+    config.geometry_config.enable_gpu_culling = options["gpu-culling"].as<bool>();
+    config.geometry_config.enable_object_transforms = !options["baked-transforms"].as<bool>();
+    config.watch_config.enable = !options["no-watch"].as<bool>();
+    config.benchmark_config.frames = options["benchmark-frames"].as<uint32_t>();
+    config.benchmark_config.moved_objects = options["move-objects"].as<uint32_t>();
+
+    path trace_path = options["trace"].as<std::string>();
+    if (!trace_path.empty()) {
+        Profiler::GetInstance().enable();
+    }
+    auto &pipeline = Pipeline::GetInstance(scene_path, config);
     pipeline.render();
+    // meshes are still loading during the first frames, so the trace is written at exit
+    if (!trace_path.empty()) {
+        Profiler::GetInstance().save(trace_path);
+    }
 
     return 0;
 }
\ No newline at end of file
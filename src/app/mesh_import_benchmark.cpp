@@ -0,0 +1,118 @@
+//
+// Created by ChenXin on 2022/11/11.
+//
+
+#include <chrono>
+#include <iostream>
+
+#include <cxxopts.hpp>
+
+#include <core/logger.h>
+#include <base/geometry.h>
+
+using namespace gl_render;
+
+[[nodiscard]] auto parse_cli_options(int argc, const char *const *argv) noexcept {
+    cxxopts::Options cli{"opengl-render-mesh-import-benchmark"};
+    cli.add_option("", "s", "scene", "Path to scene description file, every OBJ mesh it references is imported",
+                   cxxopts::value<path>(), "<file>");
+    cli.add_option("", "t", "threads", "Threads the native loader splits one file among",
+                   cxxopts::value<uint32_t>()->default_value("1"), "<count>");
+    cli.add_option("", "r", "repeat", "Import every mesh this many times with each loader",
+                   cxxopts::value<uint32_t>()->default_value("3"), "<count>");
+    cli.add_option("", "h", "help", "Display this help message",
+                   cxxopts::value<bool>()->default_value("false"), "");
+    cli.positional_help("<file>");
+    cli.parse_positional("scene");
+    auto options = [&] {
+        try {
+            return cli.parse(argc, argv);
+        } catch (const std::exception &e) {
+            GL_RENDER_WARNING_WITH_LOCATION(
+                    "Failed to parse command line arguments: {}.",
+                    e.what());
+            std::cout << cli.help() << std::endl;
+            exit(-1);
+        }
+    }();
+    if (options["help"].as<bool>()) {
+        std::cout << cli.help() << std::endl;
+        exit(0);
+    }
+    if (options["scene"].count() == 0u) [[unlikely]] {
+        GL_RENDER_WARNING_WITH_LOCATION("Scene file not specified.");
+        std::cout << cli.help() << std::endl;
+        exit(-1);
+    }
+    return options;
+}
+
+int main(int argc, char *argv[]) {
+    log_level_warning();
+    auto options = parse_cli_options(argc, argv);
+    auto scene_path = options["scene"].as<path>();
+    auto thread_count = options["threads"].as<uint32_t>();
+    auto repeat = max(options["repeat"].as<uint32_t>(), 1u);
+
+    auto scene = SceneParser::parse(scene_path);
+    gl_render::vector<path> mesh_paths;
+    gl_render::unordered_set<string> seen;
+    for (const auto &mesh: scene->meshes) {
+        auto mesh_path = mesh.file_path.is_relative() ? scene_path.parent_path() / mesh.file_path : mesh.file_path;
+        if (impl::is_obj_file(mesh_path) && seen.emplace(mesh_path.lexically_normal().generic_string()).second) {
+            mesh_paths.emplace_back(std::move(mesh_path));
+        }
+    }
+
+    // both loaders read from the page cache: the file is mapped (and touched) before timing
+    auto native_time = 0.0;
+    auto assimp_time = 0.0;
+    auto vertex_count = 0ul;
+    auto file_size = 0ul;
+    auto mismatch_count = 0u;
+    for (const auto &mesh_path: mesh_paths) {
+        MappedFile source{mesh_path};
+        GL_RENDER_ASSERT(source.valid(), "Failed to read mesh \"{}\"", mesh_path.string());
+        file_size += source.size();
+        impl::MeshData native;
+        impl::MeshData assimp;
+        for (auto r = 0u; r < repeat; ++r) {
+            native = impl::MeshData{};
+            auto native_begin = std::chrono::steady_clock::now();
+            auto parsed = impl::load_obj(source.bytes(), constant::IDENTITY_FLOAT4x4, native, thread_count);
+            auto native_end = std::chrono::steady_clock::now();
+            GL_RENDER_ASSERT(parsed, "Native loader rejected \"{}\"", mesh_path.string());
+            native_time += std::chrono::duration<double, std::milli>(native_end - native_begin).count();
+
+            assimp = impl::MeshData{};
+            auto assimp_begin = std::chrono::steady_clock::now();
+            impl::import_mesh(mesh_path, constant::IDENTITY_FLOAT4x4, assimp);
+            auto assimp_end = std::chrono::steady_clock::now();
+            assimp_time += std::chrono::duration<double, std::milli>(assimp_end - assimp_begin).count();
+        }
+        // triangle order may differ, the triangle count and the bounds may not
+        auto bounds_match = glm::length(native.aabb.min - assimp.aabb.min) <= 1e-4f &&
+                            glm::length(native.aabb.max - assimp.aabb.max) <= 1e-4f;
+        if (native.vertex_count() != assimp.vertex_count() || !bounds_match) {
+            GL_RENDER_WARNING(
+                    "\"{}\": native loader {} vertices, Assimp {} vertices{}",
+                    mesh_path.string(), native.vertex_count(), assimp.vertex_count(),
+                    bounds_match ? "" : ", bounds differ");
+            ++mismatch_count;
+        }
+        vertex_count += native.vertex_count();
+    }
+
+    native_time /= repeat;
+    assimp_time /= repeat;
+    std::cout << format(
+            "{} OBJ files, {} MB, {} vertices, {} thread(s) per file for the native loader\n"
+            "  native: {:.2f} ms ({:.1f} MB/s)\n"
+            "  assimp: {:.2f} ms ({:.1f} MB/s)\n"
+            "  speedup: {:.2f}x, {} mismatch(es)\n",
+            mesh_paths.size(), static_cast<double>(file_size) / (1024.0 * 1024.0), vertex_count, max(thread_count, 1u),
+            native_time, static_cast<double>(file_size) / (1024.0 * 1024.0) / (native_time / 1000.0),
+            assimp_time, static_cast<double>(file_size) / (1024.0 * 1024.0) / (assimp_time / 1000.0),
+            assimp_time / native_time, mismatch_count);
+    return mismatch_count == 0u ? 0 : 1;
+}
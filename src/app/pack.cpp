@@ -0,0 +1,61 @@
+//
+// Created by ChenXin on 2022/11/9.
+//
+
+#include <iostream>
+
+#include <cxxopts.hpp>
+
+#include <base/scene_archive.h>
+#include <core/logger.h>
+
+using namespace gl_render;
+
+[[nodiscard]] auto parse_cli_options(int argc, const char *const *argv) noexcept {
+    cxxopts::Options cli{"opengl-render-pack"};
+    cli.add_option("", "s", "scene", "Path to scene description file",
+                   cxxopts::value<path>(), "<file>");
+    cli.add_option("", "o", "output", "Path to the scene archive (default: <scene>.glscene)",
+                   cxxopts::value<std::string>()->default_value(""), "<file>");
+    cli.add_option("", "t", "threads", "Worker threads for mesh import (0 = hardware concurrency, 1 = serial)",
+                   cxxopts::value<uint32_t>()->default_value("0"), "<count>");
+    cli.add_option("", "h", "help", "Display this help message",
+                   cxxopts::value<bool>()->default_value("false"), "");
+    cli.positional_help("<file>");
+    cli.parse_positional("scene");
+    auto options = [&] {
+        try {
+            return cli.parse(argc, argv);
+        } catch (const std::exception &e) {
+            GL_RENDER_WARNING_WITH_LOCATION(
+                    "Failed to parse command line arguments: {}.",
+                    e.what());
+            std::cout << cli.help() << std::endl;
+            exit(-1);
+        }
+    }();
+    if (options["help"].as<bool>()) {
+        std::cout << cli.help() << std::endl;
+        exit(0);
+    }
+    if (options["scene"].count() == 0u) [[unlikely]] {
+        GL_RENDER_WARNING_WITH_LOCATION("Scene file not specified.");
+        std::cout << cli.help() << std::endl;
+        exit(-1);
+    }
+    return options;
+}
+
+int main(int argc, char *argv[]) {
+    log_level_info();
+    auto options = parse_cli_options(argc, argv);
+
+    auto scene_path = options["scene"].as<path>();
+    path archive_path = options["output"].as<std::string>();
+    if (archive_path.empty()) {
+        archive_path = path{scene_path}.replace_extension(SceneArchive::EXTENSION);
+    }
+    SceneArchive::pack(scene_path, archive_path, options["threads"].as<uint32_t>());
+
+    return 0;
+}
@@ -0,0 +1,96 @@
+//
+// Created by ChenXin on 2022/11/18.
+//
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+#include <cxxopts.hpp>
+
+#include <core/allocation_stats.h>
+#include <core/logger.h>
+#include <base/scene_parser.h>
+
+using namespace gl_render;
+
+// count heap allocations for the parse statistics; on Windows the replacement does not reach the DLLs the
+// parser lives in, so allocations are left uncounted there
+#if !defined(_WIN32)
+void *operator new(std::size_t size) {
+    gl_render::detail::record_allocation(size);
+    if (auto p = std::malloc(size == 0u ? 1u : size)) [[likely]] {
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+#endif
+
+[[nodiscard]] auto parse_cli_options(int argc, const char *const *argv) noexcept {
+    cxxopts::Options cli{"opengl-render-scene-parse-benchmark"};
+    cli.add_option("", "s", "scene", "Path to scene description file",
+                   cxxopts::value<path>(), "<file>");
+    cli.add_option("", "r", "repeat", "Parse the scene this many times",
+                   cxxopts::value<uint32_t>()->default_value("10"), "<count>");
+    cli.add_option("", "h", "help", "Display this help message",
+                   cxxopts::value<bool>()->default_value("false"), "");
+    cli.positional_help("<file>");
+    cli.parse_positional("scene");
+    auto options = [&] {
+        try {
+            return cli.parse(argc, argv);
+        } catch (const std::exception &e) {
+            GL_RENDER_WARNING_WITH_LOCATION(
+                    "Failed to parse command line arguments: {}.",
+                    e.what());
+            std::cout << cli.help() << std::endl;
+            exit(-1);
+        }
+    }();
+    if (options["help"].as<bool>()) {
+        std::cout << cli.help() << std::endl;
+        exit(0);
+    }
+    if (options["scene"].count() == 0u) [[unlikely]] {
+        GL_RENDER_WARNING_WITH_LOCATION("Scene file not specified.");
+        std::cout << cli.help() << std::endl;
+        exit(-1);
+    }
+    return options;
+}
+
+int main(int argc, char *argv[]) {
+    log_level_warning();
+    auto options = parse_cli_options(argc, argv);
+    auto scene_path = options["scene"].as<path>();
+    auto repeat = max(options["repeat"].as<uint32_t>(), 1u);
+
+    // the first parse is not timed, the file is in the page cache from then on
+    SceneParser::Statistics total;
+    auto mesh_count = 0ul;
+    for (auto r = 0u; r <= repeat; ++r) {
+        SceneParser::Statistics statistics;
+        auto scene = SceneParser::parse(scene_path, &statistics);
+        mesh_count = scene->meshes.size();
+        if (r != 0u) {
+            total.parse_time += statistics.parse_time;
+            total.allocation_count += statistics.allocation_count;
+            total.allocation_bytes += statistics.allocation_bytes;
+        }
+    }
+    auto allocations = allocation_stats().count == 0u ?
+                       string{"allocations not counted"} :
+                       format("{} allocations ({} bytes)",
+                              total.allocation_count / repeat, total.allocation_bytes / repeat);
+    std::cout << format("\"{}\": {} meshes, {} run(s)\n  parse: {:.3f} ms, {}\n",
+                        scene_path.string(), mesh_count, repeat, total.parse_time / repeat, allocations);
+    return 0;
+}
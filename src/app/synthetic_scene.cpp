@@ -0,0 +1,132 @@
+//
+// Created by ChenXin on 2022/11/10.
+//
+
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+#include <cxxopts.hpp>
+#include <nlohmann/json.hpp>
+
+#include <core/logger.h>
+#include <core/serialize.h>
+
+using namespace gl_render;
+
+// Writes a scene with many copies of one mesh file on a grid, to compare loading and memory with and
+// without instancing, e.g.
+//   opengl-render-synthetic-scene -n 4096 -o data/scenes/synthetic/synthetic.json
+//   opengl-render-cli data/scenes/synthetic/synthetic.json [--no-instancing]
+// With --instances the copies are declared as the instances of one mesh per material, which are drawn
+// instanced even with --no-instancing. Scaling with the instance count, e.g.
+//   for n in 1000 4000 16000 64000 256000; do
+//     opengl-render-synthetic-scene -n $n --instances -o data/scenes/synthetic/instances-$n.json
+//     opengl-render-cli data/scenes/synthetic/instances-$n.json --benchmark-frames 500
+//   done
+// compares the "Instancing" line of the load log (vertex memory, and what it would be if baked) and the
+// "Benchmark" line (CPU frame and submission time) across the counts. Adding --move-objects <n> to the run
+// moves n of the copies every frame; the "Benchmark" line then shows the transform bytes uploaded per frame.
+
+[[nodiscard]] auto parse_cli_options(int argc, const char *const *argv) noexcept {
+    cxxopts::Options cli{"opengl-render-synthetic-scene"};
+    cli.add_option("", "n", "count", "Number of mesh copies",
+                   cxxopts::value<uint32_t>()->default_value("4096"), "<count>");
+    cli.add_option("", "m", "mesh", "Mesh file to repeat",
+                   cxxopts::value<std::string>()->default_value("data/scenes/cbox/models/tall-box.obj"), "<file>");
+    cli.add_option("", "k", "materials", "Number of materials the copies cycle through",
+                   cxxopts::value<uint32_t>()->default_value("4"), "<count>");
+    cli.add_option("", "i", "instances", "Declare the copies as instances of one mesh per material",
+                   cxxopts::value<bool>()->default_value("false"), "");
+    cli.add_option("", "o", "output", "Path to the scene description file",
+                   cxxopts::value<std::string>()->default_value("data/scenes/synthetic/synthetic.json"), "<file>");
+    cli.add_option("", "h", "help", "Display this help message",
+                   cxxopts::value<bool>()->default_value("false"), "");
+    auto options = [&] {
+        try {
+            return cli.parse(argc, argv);
+        } catch (const std::exception &e) {
+            GL_RENDER_WARNING_WITH_LOCATION(
+                    "Failed to parse command line arguments: {}.",
+                    e.what());
+            std::cout << cli.help() << std::endl;
+            exit(-1);
+        }
+    }();
+    if (options["help"].as<bool>()) {
+        std::cout << cli.help() << std::endl;
+        exit(0);
+    }
+    return options;
+}
+
+int main(int argc, char *argv[]) {
+    log_level_info();
+    auto options = parse_cli_options(argc, argv);
+
+    auto count = options["count"].as<uint32_t>();
+    auto material_count = max(options["materials"].as<uint32_t>(), 1u);
+    auto declare_instances = options["instances"].as<bool>();
+    auto output_path = std::filesystem::absolute(options["output"].as<std::string>());
+    auto mesh_path = std::filesystem::absolute(options["mesh"].as<std::string>());
+    std::filesystem::create_directories(output_path.parent_path());
+
+    nlohmann::json scene;
+    scene["materials"] = nlohmann::json::array();
+    for (auto i = 0u; i < material_count; ++i) {
+        auto hue = static_cast<float>(i) / static_cast<float>(material_count);
+        scene["materials"].push_back({
+                {"name", serialize("Material", i)},
+                {"type", "phong"},
+                {"diffuse", {0.2f + 0.6f * hue, 0.5f, 0.8f - 0.6f * hue}}});
+    }
+
+    // the copies fill a square grid on the ground, each turned a little further around y
+    auto side = static_cast<uint>(std::ceil(std::sqrt(static_cast<double>(count))));
+    auto spacing = 1.5f;
+    auto extent = static_cast<float>(side) * spacing;
+    auto file = std::filesystem::relative(mesh_path, output_path.parent_path()).generic_string();
+    scene["meshes"] = nlohmann::json::array();
+    if (declare_instances) {
+        for (auto i = 0u; i < min(material_count, count); ++i) {
+            scene["meshes"].push_back({
+                    {"file", file},
+                    {"material", serialize("Material", i)},
+                    {"instances", nlohmann::json::array()}});
+        }
+    }
+    for (auto i = 0u; i < count; ++i) {
+        auto x = static_cast<float>(i % side) * spacing - extent * 0.5f;
+        auto z = static_cast<float>(i / side) * spacing - extent * 0.5f;
+        nlohmann::json transform{
+                {"rotate", {{"axis", {0.f, 1.f, 0.f}}, {"angle", static_cast<float>(i % 360u)}}},
+                {"translate", {x, 0.f, z}}};
+        if (declare_instances) {
+            scene["meshes"][i % material_count]["instances"].push_back(std::move(transform));
+        } else {
+            scene["meshes"].push_back({
+                    {"file", file},
+                    {"material", serialize("Material", i % material_count)},
+                    {"transform", std::move(transform)}});
+        }
+    }
+
+    scene["lights"] = nlohmann::json::array({
+            {{"position", {0.f, extent * 0.5f, 0.f}}, {"emission", {1.f, 1.f, 1.f}}, {"scale", extent}}});
+    scene["camera"] = {
+            {"resolution", {1280, 720}},
+            {"position", {0.f, extent * 0.6f, extent * 0.8f}},
+            {"front", {0.f, -0.6f, -0.8f}},
+            {"up", {0.f, 1.f, 0.f}},
+            {"fov", 45.f}};
+    scene["renderer"] = {
+            {"enable_vsync", false},
+            {"enable_shadow", true},
+            {"output_file", "output.exr"}};
+
+    std::ofstream{output_path} << scene.dump(2);
+    GL_RENDER_INFO(
+            "Wrote {} copies of \"{}\" with {} materials{} to \"{}\"",
+            count, file, material_count, declare_instances ? " as declared instances" : "", output_path.string());
+    return 0;
+}
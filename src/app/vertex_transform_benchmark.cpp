@@ -0,0 +1,107 @@
+//
+// Created by ChenXin on 2022/11/17.
+//
+
+#include <chrono>
+#include <iostream>
+#include <random>
+
+#include <cxxopts.hpp>
+
+#include <core/constant.h>
+#include <core/logger.h>
+#include <base/vertex_transform.h>
+
+using namespace gl_render;
+
+[[nodiscard]] auto parse_cli_options(int argc, const char *const *argv) noexcept {
+    cxxopts::Options cli{"opengl-render-vertex-transform-benchmark"};
+    cli.add_option("", "n", "vertices", "Vertices transformed per run",
+                   cxxopts::value<uint32_t>()->default_value("4000000"), "<count>");
+    cli.add_option("", "r", "repeat", "Transform the vertices this many times with each kernel",
+                   cxxopts::value<uint32_t>()->default_value("10"), "<count>");
+    cli.add_option("", "h", "help", "Display this help message",
+                   cxxopts::value<bool>()->default_value("false"), "");
+    auto options = [&] {
+        try {
+            return cli.parse(argc, argv);
+        } catch (const std::exception &e) {
+            GL_RENDER_WARNING_WITH_LOCATION(
+                    "Failed to parse command line arguments: {}.",
+                    e.what());
+            std::cout << cli.help() << std::endl;
+            exit(-1);
+        }
+    }();
+    if (options["help"].as<bool>()) {
+        std::cout << cli.help() << std::endl;
+        exit(0);
+    }
+    return options;
+}
+
+int main(int argc, char *argv[]) {
+    log_level_warning();
+    auto options = parse_cli_options(argc, argv);
+    auto vertex_count = static_cast<size_t>(options["vertices"].as<uint32_t>());
+    auto repeat = max(options["repeat"].as<uint32_t>(), 1u);
+
+    std::mt19937 random{0u};
+    std::uniform_real_distribution<float> coordinate{-100.f, 100.f};
+    gl_render::vector<float3> positions(vertex_count);
+    gl_render::vector<float3> normals(vertex_count);
+    for (auto i = 0ul; i < vertex_count; ++i) {
+        positions[i] = float3{coordinate(random), coordinate(random), coordinate(random)};
+        normals[i] = normalize(float3{coordinate(random), coordinate(random), coordinate(random)} + 1e-3f);
+    }
+    auto transform = glm::translate(constant::IDENTITY_FLOAT4x4, float3{1.f, -2.f, 3.f}) *
+                     glm::rotate(constant::IDENTITY_FLOAT4x4, 0.7f, normalize(float3{1.f, 2.f, 3.f})) *
+                     glm::scale(constant::IDENTITY_FLOAT4x4, float3{2.f, 0.5f, 1.5f});
+    auto normal_matrix = float3x3{transpose(inverse(transform))};
+
+    // outputs are presized, and the first run is not timed, so neither kernel pays for page faults
+    gl_render::vector<float3> scalar_positions(vertex_count);
+    gl_render::vector<float3> scalar_normals(vertex_count);
+    gl_render::vector<float3> batched_positions(vertex_count);
+    gl_render::vector<float3> batched_normals(vertex_count);
+    impl::AABB scalar_aabb;
+    impl::AABB batched_aabb;
+    auto scalar_time = 0.0;
+    auto batched_time = 0.0;
+    for (auto r = 0u; r <= repeat; ++r) {
+        auto scalar_begin = std::chrono::steady_clock::now();
+        scalar_aabb = impl::transform_vertices_scalar(positions, scalar_positions, normals, scalar_normals,
+                                                      transform, normal_matrix);
+        auto scalar_end = std::chrono::steady_clock::now();
+        batched_aabb = impl::transform_vertices(positions, batched_positions, normals, batched_normals,
+                                                transform, normal_matrix);
+        auto batched_end = std::chrono::steady_clock::now();
+        if (r != 0u) {
+            scalar_time += std::chrono::duration<double, std::milli>(scalar_end - scalar_begin).count();
+            batched_time += std::chrono::duration<double, std::milli>(batched_end - scalar_end).count();
+        }
+    }
+    scalar_time /= repeat;
+    batched_time /= repeat;
+
+    // the kernels may round differently, e.g. with fused multiply-adds
+    auto max_error = max(glm::length(scalar_aabb.min - batched_aabb.min), glm::length(scalar_aabb.max - batched_aabb.max));
+    for (auto i = 0ul; i < vertex_count; ++i) {
+        max_error = max(max_error, glm::length(scalar_positions[i] - batched_positions[i]));
+        max_error = max(max_error, glm::length(scalar_normals[i] - batched_normals[i]));
+    }
+    auto mismatch = max_error > 1e-3f;
+    auto vertices_per_second = [vertex_count](double milliseconds) {
+        return static_cast<double>(vertex_count) / (milliseconds * 1e-3) * 1e-6;
+    };
+    std::cout << format(
+            "{} vertices, position and normal streams, {} run(s)\n"
+            "  scalar: {:.2f} ms ({:.1f} M vertices/s)\n"
+            "  {}: {:.2f} ms ({:.1f} M vertices/s)\n"
+            "  speedup: {:.2f}x, max error {:.2e}{}\n",
+            vertex_count, repeat,
+            scalar_time, vertices_per_second(scalar_time),
+            impl::vertex_transform_kernel(), batched_time, vertices_per_second(batched_time),
+            scalar_time / batched_time, max_error, mismatch ? ", MISMATCH" : "");
+    return mismatch ? 1 : 0;
+}
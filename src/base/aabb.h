@@ -0,0 +1,58 @@
+//
+// Created by ChenXin on 2022/11/4.
+//
+
+#pragma once
+
+#include <core/stl.h>
+#include <core/logger.h>
+
+namespace gl_render {
+
+    namespace impl {
+
+        struct AABB {
+            float3 min{1.e10f};
+            float3 max{-1.e10f};
+
+            /// nothing was added to the box yet
+            [[nodiscard]] bool empty() const noexcept { return min.x > max.x || min.y > max.y || min.z > max.z; }
+
+            /// Bounds of the box after transform
+            [[nodiscard]] AABB transformed(const float4x4 &transform) const noexcept {
+                AABB aabb;
+                for (auto i = 0u; i < 8u; ++i) {
+                    auto corner = float3{(i & 1u) ? max.x : min.x, (i & 2u) ? max.y : min.y, (i & 4u) ? max.z : min.z};
+                    auto p = float3{transform * float4{corner, 1.f}};
+                    aabb.min = glm::min(aabb.min, p);
+                    aabb.max = glm::max(aabb.max, p);
+                }
+                return aabb;
+            }
+
+            [[nodiscard]] auto &operator[](size_t index) noexcept {
+                switch (index) {
+                    case 0:
+                        return min;
+                    case 1:
+                        return max;
+                    default:
+                    GL_RENDER_ERROR("AABB index out of range");
+                }
+            }
+
+            [[nodiscard]] const auto &operator[](size_t index) const noexcept {
+                switch (index) {
+                    case 0:
+                        return min;
+                    case 1:
+                        return max;
+                    default:
+                    GL_RENDER_ERROR("AABB index out of range");
+                }
+            }
+        };
+
+    }
+
+}
@@ -0,0 +1,301 @@
+//
+// Created by ChenXin on 2022/11/14.
+//
+
+#include <base/bvh.h>
+
+#include <algorithm>
+#include <numeric>
+
+#include <core/logger.h>
+#include <core/profiler.h>
+
+namespace gl_render {
+
+    namespace impl {
+
+        [[nodiscard]] static float surface_area(const AABB &aabb) noexcept {
+            auto extent = aabb.max - aabb.min;
+            if (extent.x < 0.f || extent.y < 0.f || extent.z < 0.f) {
+                return 0.f;
+            }
+            return 2.f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+        }
+
+        static void expand(AABB &aabb, const AABB &other) noexcept {
+            aabb.min = min(aabb.min, other.min);
+            aabb.max = max(aabb.max, other.max);
+        }
+
+    }
+
+    void BVH::build(span<const impl::AABB> bounds) noexcept {
+        GL_RENDER_PROFILE_SCOPE("build bvh", "geometry");
+        _nodes.clear();
+        _primitives.resize(bounds.size());
+        _bounds.assign(bounds.begin(), bounds.end());
+        _build_cost = 0.f;
+        if (bounds.empty()) {
+            return;
+        }
+        std::iota(_primitives.begin(), _primitives.end(), 0u);
+        vector<float3> centroids(bounds.size());
+        Node root{impl::AABB{}, 0u, static_cast<uint>(bounds.size())};
+        for (auto i = 0ul; i < bounds.size(); ++i) {
+            centroids[i] = (bounds[i].min + bounds[i].max) * 0.5f;
+            impl::expand(root.aabb, bounds[i]);
+        }
+        _nodes.reserve(bounds.size() * 2u);
+        _nodes.emplace_back(root);
+        _split(0u, bounds, centroids, 0u);
+        _nodes.shrink_to_fit();
+        _build_cost = sah_cost();
+    }
+
+    void BVH::_split(uint node, span<const impl::AABB> bounds, span<const float3> centroids, uint depth) noexcept {
+        auto first = _nodes[node].first;
+        auto count = _nodes[node].count;
+        if (count <= 1u || depth + 1u >= MAX_DEPTH) {
+            return;
+        }
+        auto primitives = span<uint>{_primitives}.subspan(first, count);
+        impl::AABB centroid_bounds;
+        for (auto primitive: primitives) {
+            centroid_bounds.min = min(centroid_bounds.min, centroids[primitive]);
+            centroid_bounds.max = max(centroid_bounds.max, centroids[primitive]);
+        }
+        auto extent = centroid_bounds.max - centroid_bounds.min;
+        auto axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+
+        // bin the centroids along the longest axis and take the split of least SAH cost between the bins
+        auto middle = 0ul;
+        if (extent[axis] > 0.f) {
+            struct Bin {
+                impl::AABB aabb;
+                uint count{0u};
+            };
+            std::array<Bin, SAH_BIN_COUNT> bins{};
+            auto bin_of = [&](uint primitive) {
+                auto offset = (centroids[primitive][axis] - centroid_bounds.min[axis]) / extent[axis];
+                return min(static_cast<uint>(offset * static_cast<float>(SAH_BIN_COUNT)), SAH_BIN_COUNT - 1u);
+            };
+            for (auto primitive: primitives) {
+                auto &bin = bins[bin_of(primitive)];
+                impl::expand(bin.aabb, bounds[primitive]);
+                ++bin.count;
+            }
+            // right_costs[i]: area times count of the bins from i + 1 on
+            std::array<float, SAH_BIN_COUNT> right_costs{};
+            impl::AABB right;
+            auto right_count = 0u;
+            for (auto i = SAH_BIN_COUNT - 1u; i > 0u; --i) {
+                impl::expand(right, bins[i].aabb);
+                right_count += bins[i].count;
+                right_costs[i - 1u] = impl::surface_area(right) * static_cast<float>(right_count);
+            }
+            impl::AABB left;
+            auto left_count = 0u;
+            auto best_cost = std::numeric_limits<float>::infinity();
+            auto best_split = 0u;
+            for (auto i = 0u; i + 1u < SAH_BIN_COUNT; ++i) {
+                impl::expand(left, bins[i].aabb);
+                left_count += bins[i].count;
+                if (left_count == 0u || left_count == count) {
+                    continue;
+                }
+                if (auto cost = impl::surface_area(left) * static_cast<float>(left_count) + right_costs[i]; cost < best_cost) {
+                    best_cost = cost;
+                    best_split = i;
+                }
+            }
+            auto node_area = impl::surface_area(_nodes[node].aabb);
+            auto split_cost = SAH_TRAVERSAL_COST + best_cost / max(node_area, std::numeric_limits<float>::min());
+            if (count <= MAX_LEAF_SIZE && split_cost >= static_cast<float>(count)) {
+                return;
+            }
+            if (best_cost < std::numeric_limits<float>::infinity()) {
+                middle = std::partition(primitives.begin(), primitives.end(), [&](uint primitive) {
+                    return bin_of(primitive) <= best_split;
+                }) - primitives.begin();
+            }
+        } else if (count <= MAX_LEAF_SIZE) {
+            return;
+        }
+        // coincident centroids cannot be binned apart, they are split in half
+        if (middle == 0u || middle == count) {
+            middle = count / 2u;
+            std::nth_element(primitives.begin(), primitives.begin() + static_cast<std::ptrdiff_t>(middle), primitives.end(),
+                             [&](uint a, uint b) { return centroids[a][axis] < centroids[b][axis]; });
+        }
+
+        auto make_child = [&](uint child_first, uint child_count) {
+            Node child{impl::AABB{}, child_first, child_count};
+            for (auto i = child_first; i < child_first + child_count; ++i) {
+                impl::expand(child.aabb, bounds[_primitives[i]]);
+            }
+            _nodes.emplace_back(child);
+            return static_cast<uint>(_nodes.size() - 1u);
+        };
+        auto left = make_child(first, static_cast<uint>(middle));
+        _split(left, bounds, centroids, depth + 1u);
+        auto right = make_child(first + static_cast<uint>(middle), count - static_cast<uint>(middle));
+        _nodes[node].first = right;
+        _nodes[node].count = 0u;
+        _split(right, bounds, centroids, depth + 1u);
+    }
+
+    void BVH::refit(span<const impl::AABB> bounds) noexcept {
+        GL_RENDER_ASSERT(bounds.size() == _primitives.size(), "BVH refit with {} bounds for {} primitives",
+                         bounds.size(), _primitives.size());
+        _bounds.assign(bounds.begin(), bounds.end());
+        // children come after their parents, so walking backwards visits them first
+        for (auto index = _nodes.size(); index-- > 0u;) {
+            auto &node = _nodes[index];
+            node.aabb = impl::AABB{};
+            if (node.count != 0u) {
+                for (auto i = node.first; i < node.first + node.count; ++i) {
+                    impl::expand(node.aabb, bounds[_primitives[i]]);
+                }
+            } else {
+                impl::expand(node.aabb, _nodes[index + 1u].aabb);
+                impl::expand(node.aabb, _nodes[node.first].aabb);
+            }
+        }
+    }
+
+    bool BVH::update(span<const impl::AABB> bounds) noexcept {
+        if (!_nodes.empty() && bounds.size() == _primitives.size()) {
+            refit(bounds);
+            if (sah_cost() <= _build_cost * REFIT_COST_LIMIT) {
+                return false;
+            }
+        }
+        build(bounds);
+        return true;
+    }
+
+    float BVH::sah_cost() const noexcept {
+        if (_nodes.empty()) {
+            return 0.f;
+        }
+        auto root_area = max(impl::surface_area(_nodes.front().aabb), std::numeric_limits<float>::min());
+        auto cost = 0.f;
+        for (const auto &node: _nodes) {
+            auto probability = impl::surface_area(node.aabb) / root_area;
+            cost += probability * (node.count == 0u ? SAH_TRAVERSAL_COST : static_cast<float>(node.count));
+        }
+        return cost;
+    }
+
+    void BVH::query(const impl::Frustum &frustum, vector<uint> &primitives) const noexcept {
+        if (_nodes.empty()) {
+            return;
+        }
+        std::array<uint, MAX_DEPTH * 2u> stack;
+        auto size = 0u;
+        stack[size++] = 0u;
+        while (size != 0u) {
+            const auto &node = _nodes[stack[--size]];
+            if (!frustum.intersects(node.aabb)) {
+                continue;
+            }
+            if (node.count == 0u) {
+                stack[size++] = node.first;
+                stack[size++] = static_cast<uint>(&node - _nodes.data()) + 1u;
+                continue;
+            }
+            for (auto i = node.first; i < node.first + node.count; ++i) {
+                if (node.count == 1u || frustum.intersects(_bounds[_primitives[i]])) {
+                    primitives.emplace_back(_primitives[i]);
+                }
+            }
+        }
+    }
+
+    void BVH::query(const Ray &ray, vector<uint> &primitives) const noexcept {
+        if (_nodes.empty()) {
+            return;
+        }
+        auto inverse_direction = 1.f / ray.direction;
+        std::array<uint, MAX_DEPTH * 2u> stack;
+        auto size = 0u;
+        stack[size++] = 0u;
+        while (size != 0u) {
+            const auto &node = _nodes[stack[--size]];
+            if (intersect(node.aabb, ray, inverse_direction) == std::numeric_limits<float>::infinity()) {
+                continue;
+            }
+            if (node.count == 0u) {
+                stack[size++] = node.first;
+                stack[size++] = static_cast<uint>(&node - _nodes.data()) + 1u;
+                continue;
+            }
+            for (auto i = node.first; i < node.first + node.count; ++i) {
+                if (node.count == 1u ||
+                    intersect(_bounds[_primitives[i]], ray, inverse_direction) != std::numeric_limits<float>::infinity()) {
+                    primitives.emplace_back(_primitives[i]);
+                }
+            }
+        }
+    }
+
+    optional<BVH::Hit> BVH::intersect(const Ray &ray) const noexcept {
+        auto inverse_direction = 1.f / ray.direction;
+        return intersect(ray, [&](uint primitive, float t_max) -> optional<float> {
+            auto t = intersect(_bounds[primitive], Ray{ray.origin, ray.direction, t_max}, inverse_direction);
+            return t < t_max ? optional{t} : nullopt;
+        });
+    }
+
+    optional<float2> BVH::depth_range(const impl::Frustum &frustum, float3 origin, float3 direction) const noexcept {
+        vector<uint> primitives;
+        query(frustum, primitives);
+        if (primitives.empty()) {
+            return nullopt;
+        }
+        auto range = float2{std::numeric_limits<float>::infinity(), 0.f};
+        auto absolute_direction = float3{std::abs(direction.x), std::abs(direction.y), std::abs(direction.z)};
+        for (auto primitive: primitives) {
+            const auto &aabb = _bounds[primitive];
+            auto center = dot((aabb.min + aabb.max) * 0.5f - origin, direction);
+            auto radius = dot((aabb.max - aabb.min) * 0.5f, absolute_direction);
+            range.x = min(range.x, max(center - radius, 0.f));
+            range.y = max(range.y, center + radius);
+        }
+        return range;
+    }
+
+    float BVH::intersect(const impl::AABB &aabb, const Ray &ray, float3 inverse_direction) noexcept {
+        auto t0 = (aabb.min - ray.origin) * inverse_direction;
+        auto t1 = (aabb.max - ray.origin) * inverse_direction;
+        auto entry = min(t0, t1);
+        auto exit = max(t0, t1);
+        auto t_entry = max(max(entry.x, entry.y), max(entry.z, 0.f));
+        auto t_exit = min(min(exit.x, exit.y), exit.z);
+        return t_entry <= t_exit && t_entry < ray.t_max ? t_entry : std::numeric_limits<float>::infinity();
+    }
+
+    optional<float> BVH::intersect(const Ray &ray, float3 p0, float3 p1, float3 p2) noexcept {
+        auto e1 = p1 - p0;
+        auto e2 = p2 - p0;
+        auto p = cross(ray.direction, e2);
+        auto determinant = dot(e1, p);
+        if (std::abs(determinant) < 1e-12f) {
+            return nullopt;
+        }
+        auto inverse_determinant = 1.f / determinant;
+        auto s = ray.origin - p0;
+        auto u = dot(s, p) * inverse_determinant;
+        if (u < 0.f || u > 1.f) {
+            return nullopt;
+        }
+        auto q = cross(s, e1);
+        auto v = dot(ray.direction, q) * inverse_determinant;
+        if (v < 0.f || u + v > 1.f) {
+            return nullopt;
+        }
+        auto t = dot(e2, q) * inverse_determinant;
+        return t >= 0.f && t < ray.t_max ? optional{t} : nullopt;
+    }
+
+}
@@ -0,0 +1,143 @@
+//
+// Created by ChenXin on 2022/11/14.
+//
+
+#pragma once
+
+#include <array>
+#include <limits>
+
+#include <core/stl.h>
+#include <base/aabb.h>
+#include <base/frustum.h>
+
+namespace gl_render {
+
+    /// Bounding volume hierarchy over the boxes of primitives (meshes, triangles, ...), built with the binned
+    /// surface area heuristic. Primitives are referred to by their index in the bounds it was built from.
+    class BVH {
+
+    public:
+        static constexpr uint MAX_LEAF_SIZE = 4u;
+        static constexpr uint SAH_BIN_COUNT = 16u;
+        /// cost of a traversal step relative to a primitive test
+        static constexpr float SAH_TRAVERSAL_COST = 1.f;
+        /// update() rebuilds instead of refitting once refitting grew the SAH cost by this factor since the build
+        static constexpr float REFIT_COST_LIMIT = 1.5f;
+        static constexpr uint MAX_DEPTH = 64u;
+
+        /// Leaves have primitives _primitives[first] to _primitives[first + count - 1], inner nodes have count 0,
+        /// their left child right behind them and their right child at first
+        struct Node {
+            impl::AABB aabb;
+            uint first;
+            uint count;
+        };
+
+        struct Ray {
+            float3 origin;
+            float3 direction;
+            float t_max = std::numeric_limits<float>::infinity();
+        };
+
+        struct Hit {
+            uint primitive;
+            float t;
+        };
+
+    private:
+        vector<Node> _nodes;
+        vector<uint> _primitives;
+        vector<impl::AABB> _bounds;     // of the primitives, as last built or refitted
+        float _build_cost{0.f};
+
+    public:
+        /// Build from scratch, empty bounds give an empty hierarchy
+        void build(span<const impl::AABB> bounds) noexcept;
+        /// Keep the tree and recompute the boxes of its nodes for new bounds of the same primitives
+        void refit(span<const impl::AABB> bounds) noexcept;
+        /// Refit if the primitive count is the same and the tree is still good enough, build otherwise.
+        /// Returns true if it was rebuilt.
+        bool update(span<const impl::AABB> bounds) noexcept;
+
+        /// Primitives whose boxes intersect frustum
+        void query(const impl::Frustum &frustum, vector<uint> &primitives) const noexcept;
+        /// Primitives whose boxes the ray hits within t_max
+        void query(const Ray &ray, vector<uint> &primitives) const noexcept;
+        /// Nearest hit along the ray: hit(primitive, t_max) returns the distance of the primitive along the ray
+        /// if it is hit before t_max, subtrees further than the closest hit so far are skipped
+        template<typename F>
+        [[nodiscard]] optional<Hit> intersect(const Ray &ray, F &&hit) const noexcept;
+        /// Nearest hit of the primitive boxes
+        [[nodiscard]] optional<Hit> intersect(const Ray &ray) const noexcept;
+        /// Nearest and furthest distances along the unit direction from origin of the boxes intersecting frustum,
+        /// nullopt if there are none
+        [[nodiscard]] optional<float2> depth_range(const impl::Frustum &frustum, float3 origin,
+                                                   float3 direction) const noexcept;
+
+        /// Distance of the ray to the box if it is hit within t_max, infinity otherwise; 0 from inside
+        [[nodiscard]] static float intersect(const impl::AABB &aabb, const Ray &ray, float3 inverse_direction) noexcept;
+        /// Distance of the ray to the triangle (both sides) if it is hit within t_max (Moller and Trumbore)
+        [[nodiscard]] static optional<float> intersect(const Ray &ray, float3 p0, float3 p1, float3 p2) noexcept;
+        /// SAH cost of the tree, relative to testing every primitive of the root box
+        [[nodiscard]] float sah_cost() const noexcept;
+
+        [[nodiscard]] auto empty() const noexcept { return _nodes.empty(); }
+        [[nodiscard]] auto bounds() const noexcept { return _nodes.empty() ? impl::AABB{} : _nodes.front().aabb; }
+        [[nodiscard]] auto node_count() const noexcept { return _nodes.size(); }
+        [[nodiscard]] auto primitive_count() const noexcept { return _primitives.size(); }
+        [[nodiscard]] const auto &nodes() const noexcept { return _nodes; }
+
+    private:
+        /// Split the primitives of _nodes[node], recursively until the SAH prefers leaves
+        void _split(uint node, span<const impl::AABB> bounds, span<const float3> centroids, uint depth) noexcept;
+    };
+
+    template<typename F>
+    optional<BVH::Hit> BVH::intersect(const Ray &ray, F &&hit) const noexcept {
+        if (_nodes.empty()) {
+            return nullopt;
+        }
+        auto inverse_direction = 1.f / ray.direction;
+        auto closest = ray;
+        optional<Hit> nearest;
+        // nodes are pushed with their entry distance, far children first so that near ones are visited first
+        std::array<pair<uint, float>, MAX_DEPTH * 2u> stack;
+        auto size = 0u;
+        if (auto t = intersect(_nodes.front().aabb, closest, inverse_direction); t < closest.t_max) {
+            stack[size++] = {0u, t};
+        }
+        while (size != 0u) {
+            auto [index, entry] = stack[--size];
+            if (entry >= closest.t_max) {
+                continue;
+            }
+            const auto &node = _nodes[index];
+            if (node.count != 0u) {
+                for (auto i = node.first; i < node.first + node.count; ++i) {
+                    if (auto t = hit(_primitives[i], closest.t_max); t && *t < closest.t_max) {
+                        closest.t_max = *t;
+                        nearest = Hit{_primitives[i], *t};
+                    }
+                }
+                continue;
+            }
+            auto left = index + 1u;
+            auto right = node.first;
+            auto t_left = intersect(_nodes[left].aabb, closest, inverse_direction);
+            auto t_right = intersect(_nodes[right].aabb, closest, inverse_direction);
+            if (t_left > t_right) {
+                std::swap(left, right);
+                std::swap(t_left, t_right);
+            }
+            if (t_right < closest.t_max) {
+                stack[size++] = {right, t_right};
+            }
+            if (t_left < closest.t_max) {
+                stack[size++] = {left, t_left};
+            }
+        }
+        return nearest;
+    }
+
+}
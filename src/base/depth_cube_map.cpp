@@ -4,36 +4,25 @@
 
 #include "depth_cube_map.h"
 
+#include <core/profiler.h>
+
 namespace gl_render {
 
-    GLuint DepthCubeMap::VERTEX_ARRAY = 0u;
-    GLuint DepthCubeMap::POSITION_BUFFER = 0u;
-    int DepthCubeMap::TRIANGLE_COUNT = 0u;
     gl_render::unique_ptr<Shader> DepthCubeMap::SHADER = nullptr;
     int DepthCubeMap::INSTANCE_NUM = 0;
+    bool DepthCubeMap::COMPACT_POSITIONS = false;
+    DepthCubeMap::DrawScene DepthCubeMap::DRAW_SCENE{};
 
-    DepthCubeMap::DepthCubeMap(uint2 shadowResolution, gl_render::vector<float3> *vertex_positions) noexcept
+    DepthCubeMap::DepthCubeMap(uint2 shadowResolution) noexcept
             : _shadowResolution(shadowResolution) {
+        GL_RENDER_PROFILE_SCOPE("create shadow map", "shadow");
         if (INSTANCE_NUM == 0) {
             // initialize shader
             SHADER = gl_render::make_unique<Shader>(
                     path{"data/shaders/point_shadows_depth.vert"},
                     path{"data/shaders/point_shadows_depth.geom"},
                     path{"data/shaders/point_shadows_depth.frag"},
-                    Shader::TemplateList{});
-
-            // init geometry
-            TRIANGLE_COUNT = vertex_positions->size() / 3;
-            glGenVertexArrays(1, &VERTEX_ARRAY);
-            glBindVertexArray(VERTEX_ARRAY);
-
-            glGenBuffers(1, &POSITION_BUFFER);
-            glBindBuffer(GL_ARRAY_BUFFER, POSITION_BUFFER);
-            glBufferData(GL_ARRAY_BUFFER, vertex_positions->size() * sizeof(float3), vertex_positions->data(), GL_DYNAMIC_COPY);
-            glEnableVertexAttribArray(0);
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float3), nullptr);
-
-            glBindVertexArray(0);
+                    Shader::TemplateList{{"COMPACT_VERTICES", COMPACT_POSITIONS ? "1" : "0"}});
         }
         ++INSTANCE_NUM;
 
@@ -66,10 +55,6 @@ namespace gl_render {
 
     DepthCubeMap::~DepthCubeMap() noexcept {
         --INSTANCE_NUM;
-        if (INSTANCE_NUM == 0) {
-            glDeleteVertexArrays(1, &VERTEX_ARRAY);
-            glDeleteBuffers(1, &POSITION_BUFFER);
-        }
         glDeleteFramebuffers(1, &_depthCubeMapFBO);
         glDeleteTextures(1, &_depthCubeMap);
     }
@@ -88,9 +73,9 @@ namespace gl_render {
         SHADER->setVec3("lightPos", lightPos);
 
         // render scene from light's point of view
-        glBindVertexArray(VERTEX_ARRAY);
-        glDrawArrays(GL_TRIANGLES, 0, TRIANGLE_COUNT * 3);
-        glBindVertexArray(0);
+        if (DRAW_SCENE) {
+            DRAW_SCENE(*SHADER);
+        }
 
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
     }
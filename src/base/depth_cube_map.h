@@ -19,21 +19,30 @@ namespace gl_render {
         GLuint _depthCubeMap{0u};
         GLuint64 _depthCubeMapHandle{0u};
 
-        static GLuint VERTEX_ARRAY;
-        static GLuint POSITION_BUFFER;
-        static int TRIANGLE_COUNT;
+    public:
+        /// Draws the depth of the scene with the shader passed, which is in use with the shadow uniforms set
+        using DrawScene = function<void(const Shader &)>;
+
+    private:
         static gl_render::unique_ptr<Shader> SHADER;
         static int INSTANCE_NUM;
+        static bool COMPACT_POSITIONS;
+        static DrawScene DRAW_SCENE;
 
     public:
         void render(float far_plane, const float3 &lightPos,
                     const vector <float4x4> &shadowTransforms) const noexcept;
 
-        explicit DepthCubeMap(uint2 shadowResolution,
-                              gl_render::vector<float3> *vertex_positions) noexcept;
+        explicit DepthCubeMap(uint2 shadowResolution) noexcept;
 
         ~DepthCubeMap() noexcept;
 
+        /// Set how all shadow maps draw the scene, the geometry is drawn from where it already resides
+        static void set_scene(DrawScene draw_scene) noexcept { DRAW_SCENE = std::move(draw_scene); }
+
+        /// Read the positions as 16-bit values in the bounds of their group, takes effect while no shadow map exists
+        static void set_compact_positions(bool compact) noexcept { COMPACT_POSITIONS = compact; }
+
         [[nodiscard]] inline auto depthCubeMapHandle() const noexcept { return _depthCubeMapHandle; }
 
     };
@@ -0,0 +1,99 @@
+//
+// Created by ChenXin on 2022/11/15.
+//
+
+#include <base/frustum.h>
+
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+namespace gl_render {
+
+    namespace impl {
+
+        void AABBArray::assign(span<const AABB> boxes) noexcept {
+            size = boxes.size();
+            auto padded_size = (size + BATCH_SIZE - 1u) / BATCH_SIZE * BATCH_SIZE;
+            // padding boxes are empty, they are behind every plane
+            AABB empty;
+            for (auto stream: {&min_x, &min_y, &min_z, &max_x, &max_y, &max_z}) {
+                stream->resize(padded_size);
+            }
+            for (auto i = 0ul; i < padded_size; ++i) {
+                set(i, i < size ? boxes[i] : empty);
+            }
+        }
+
+        void AABBArray::set(size_t index, const AABB &box) noexcept {
+            min_x[index] = box.min.x;
+            min_y[index] = box.min.y;
+            min_z[index] = box.min.z;
+            max_x[index] = box.max.x;
+            max_y[index] = box.max.y;
+            max_z[index] = box.max.z;
+        }
+
+        size_t cull_boxes(const Frustum &frustum, const AABBArray &boxes, span<uint8_t> visible) noexcept {
+            // the box corner furthest along a plane normal is the same for all boxes, so each plane reads
+            // one stream per axis
+            std::array<std::array<const float *, 3u>, 6u> corners{};
+            for (auto p = 0u; p < 6u; ++p) {
+                const auto &plane = frustum.planes[p];
+                corners[p] = {plane.x >= 0.f ? boxes.max_x.data() : boxes.min_x.data(),
+                              plane.y >= 0.f ? boxes.max_y.data() : boxes.min_y.data(),
+                              plane.z >= 0.f ? boxes.max_z.data() : boxes.min_z.data()};
+            }
+            auto visible_count = 0ul;
+            for (auto first = 0ul; first < boxes.size; first += AABBArray::BATCH_SIZE) {
+                // bit i set if box first + i is behind any plane
+                auto outside = 0u;
+#if defined(__AVX__)
+                auto behind = _mm256_setzero_ps();
+                for (auto p = 0u; p < 6u; ++p) {
+                    const auto &plane = frustum.planes[p];
+                    auto d = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), _mm256_loadu_ps(corners[p][0] + first)),
+                                           _mm256_set1_ps(plane.w));
+                    d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(plane.y), _mm256_loadu_ps(corners[p][1] + first)));
+                    d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(plane.z), _mm256_loadu_ps(corners[p][2] + first)));
+                    behind = _mm256_or_ps(behind, _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_LT_OQ));
+                }
+                outside = static_cast<uint>(_mm256_movemask_ps(behind));
+#elif defined(__SSE2__) || defined(_M_X64)
+                for (auto half = 0u; half < 2u; ++half) {
+                    auto offset = first + half * 4u;
+                    auto behind = _mm_setzero_ps();
+                    for (auto p = 0u; p < 6u; ++p) {
+                        const auto &plane = frustum.planes[p];
+                        auto d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), _mm_loadu_ps(corners[p][0] + offset)),
+                                            _mm_set1_ps(plane.w));
+                        d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(plane.y), _mm_loadu_ps(corners[p][1] + offset)));
+                        d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(plane.z), _mm_loadu_ps(corners[p][2] + offset)));
+                        behind = _mm_or_ps(behind, _mm_cmplt_ps(d, _mm_setzero_ps()));
+                    }
+                    outside |= static_cast<uint>(_mm_movemask_ps(behind)) << (half * 4u);
+                }
+#else
+                for (auto i = 0u; i < AABBArray::BATCH_SIZE; ++i) {
+                    for (auto p = 0u; p < 6u; ++p) {
+                        const auto &plane = frustum.planes[p];
+                        auto d = plane.x * corners[p][0][first + i] + plane.y * corners[p][1][first + i] +
+                                 plane.z * corners[p][2][first + i] + plane.w;
+                        if (d < 0.f) {
+                            outside |= 1u << i;
+                        }
+                    }
+                }
+#endif
+                auto last = min(first + AABBArray::BATCH_SIZE, boxes.size);
+                for (auto i = first; i < last; ++i) {
+                    visible[i] = static_cast<uint8_t>(((outside >> (i - first)) & 1u) ^ 1u);
+                    visible_count += visible[i];
+                }
+            }
+            return visible_count;
+        }
+
+    }
+
+}
@@ -0,0 +1,81 @@
+//
+// Created by ChenXin on 2022/11/13.
+//
+
+#pragma once
+
+#include <array>
+
+#include <core/stl.h>
+#include <base/aabb.h>
+
+namespace gl_render {
+
+    namespace impl {
+
+        /// View frustum as six inward-facing planes (xyz normal, w offset), a point p is inside a plane
+        /// if dot(xyz, p) + w >= 0
+        struct Frustum {
+            std::array<float4, 6u> planes;
+
+            /// Planes of the clip volume of view_projection, in the space it transforms from (Gribb and Hartmann)
+            [[nodiscard]] static Frustum from(const float4x4 &view_projection) noexcept {
+                auto row = [&view_projection](int index) {
+                    return float4{view_projection[0][index], view_projection[1][index],
+                                  view_projection[2][index], view_projection[3][index]};
+                };
+                Frustum frustum{};
+                for (auto axis = 0; axis < 3; ++axis) {
+                    frustum.planes[axis * 2] = row(3) + row(axis);
+                    frustum.planes[axis * 2 + 1] = row(3) - row(axis);
+                }
+                for (auto &plane: frustum.planes) {
+                    plane /= length(float3{plane});
+                }
+                return frustum;
+            }
+
+            [[nodiscard]] bool intersects(float3 center, float radius) const noexcept {
+                for (const auto &plane: planes) {
+                    if (dot(float3{plane}, center) + plane.w < -radius) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            /// Conservative: boxes outside of the frustum but not behind any single plane count as intersecting
+            [[nodiscard]] bool intersects(const AABB &aabb) const noexcept {
+                for (const auto &plane: planes) {
+                    // the corner furthest along the plane normal
+                    auto corner = float3{plane.x >= 0.f ? aabb.max.x : aabb.min.x,
+                                         plane.y >= 0.f ? aabb.max.y : aabb.min.y,
+                                         plane.z >= 0.f ? aabb.max.z : aabb.min.z};
+                    if (dot(float3{plane}, corner) + plane.w < 0.f) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+        };
+
+        /// Boxes in structure-of-arrays layout for cull_boxes(), padded with empty boxes to whole batches
+        struct AABBArray {
+            static constexpr size_t BATCH_SIZE = 8u;
+
+            gl_render::vector<float> min_x, min_y, min_z;
+            gl_render::vector<float> max_x, max_y, max_z;
+            size_t size{0u};
+
+            void assign(span<const AABB> boxes) noexcept;
+            void set(size_t index, const AABB &box) noexcept;
+        };
+
+        /// Set visible[i] to 1 if box i intersects frustum (conservatively, see Frustum::intersects) and to 0
+        /// otherwise, a batch of 8 boxes at a time with AVX if enabled, SSE or scalar code otherwise.
+        /// Returns the number of visible boxes.
+        size_t cull_boxes(const Frustum &frustum, const AABBArray &boxes, span<uint8_t> visible) noexcept;
+
+    }
+
+}
@@ -4,39 +4,86 @@
 
 #include <base/geometry.h>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <numeric>
+
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
-#include <assimp/postprocess.h>
 
+#include <core/profiler.h>
+#include <core/thread_pool.h>
 #include <base/texture_manager.h>
+#include <base/vertex_transform.h>
+#include <util/memory_usage.h>
 
 namespace gl_render {
 
-    Geometry::Geometry(const SceneAllNode::SceneAllInfo &sceneAllInfo, const path &scene_dir) {
-        Shader::TemplateList tl = {
-                {std::string{"POINT_LIGHT_COUNT"}, serialize(sceneAllInfo.lights.size())}
-        };
-        gl_render::unordered_map<MaterialInfo *, gl_render::vector<impl::MeshInfoGrouped>> mesh_map;
-        gl_render::vector<Assimp::Importer> importer(sceneAllInfo.meshes.size());
-        for (auto index = 0u; index < sceneAllInfo.meshes.size(); ++index) {
-            const auto &mesh_node = sceneAllInfo.meshes[index];
-            const auto &mesh = mesh_node.mesh_info;
-
-            auto mesh_path = mesh.file_path.string();
-            if (mesh.file_path.is_relative()) {
-                mesh_path = (scene_dir / mesh.file_path).string();
-            }
-            auto material_name = mesh.material_name;
-
-            auto ai_scene = importer[index].ReadFile(
-                    mesh_path,
-                    aiProcess_Triangulate |
-                    aiProcess_FixInfacingNormals | aiProcess_GenNormals |
-                    aiProcess_RemoveRedundantMaterials |
-                    aiProcess_OptimizeGraph | aiProcess_OptimizeMeshes);
-            GL_RENDER_ASSERT(ai_scene != nullptr, "Mesh \"{}\" is nullptr", mesh_path);
-            GL_RENDER_ASSERT(!(ai_scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE), "Mesh \"{}\" is incomplete", mesh_path);
-            GL_RENDER_ASSERT(ai_scene->mRootNode != nullptr, "Failed to load mesh: {}", mesh_path);
+    namespace impl {
+
+        /// Rough CPU memory of a mesh while it is imported and converted, relative to its source file size
+        constexpr size_t MESH_MEMORY_ESTIMATE_FACTOR = 4u;
+
+        /// Transform and flatten all submeshes of one scene mesh into data
+        static void process_mesh(const gl_render::vector<aiMesh *> &mesh_list, const float4x4 &model_matrix,
+                                 MeshData &data) noexcept {
+            GL_RENDER_PROFILE_SCOPE("process mesh", "geometry");
+            auto vertex_count = 0ul;
+            for (auto ai_mesh: mesh_list) {
+                vertex_count += ai_mesh->mNumFaces * 3ul;
+            }
+            data.allocate(vertex_count);
+            auto positions = data.storage.data();
+            auto normals = positions + vertex_count;
+            auto tex_coords = normals + vertex_count;
+
+            auto normal_matrix = float3x3{transpose(inverse(model_matrix))};
+            gl_render::vector<float3> mesh_positions;
+            gl_render::vector<float3> mesh_normals;
+            auto index = 0ul;
+            for (auto ai_mesh: mesh_list) {
+                // process vertices, aiVector3D is read as float3 (ai_real is float)
+                static_assert(sizeof(aiVector3D) == sizeof(float3));
+                auto vertex_count = static_cast<size_t>(ai_mesh->mNumVertices);
+                mesh_positions.resize(vertex_count);
+                mesh_normals.resize(vertex_count);
+                auto aabb = transform_vertices(
+                        span{reinterpret_cast<const float3 *>(ai_mesh->mVertices), vertex_count}, mesh_positions,
+                        span{reinterpret_cast<const float3 *>(ai_mesh->mNormals), vertex_count}, mesh_normals,
+                        model_matrix, normal_matrix);
+                data.aabb.min = min(data.aabb.min, aabb.min);
+                data.aabb.max = max(data.aabb.max, aabb.max);
+
+                // process faces
+                auto ai_tex_coords = ai_mesh->mTextureCoords[0];
+                for (auto i = 0ul; i < ai_mesh->mNumFaces; i++) {
+                    auto &&face = ai_mesh->mFaces[i].mIndices;
+                    for (auto j = 0u; j < 3u; ++j, ++index) {
+                        positions[index] = mesh_positions[face[j]];
+                        normals[index] = mesh_normals[face[j]];
+                        // z < 0 marks vertices without texture coordinates
+                        tex_coords[index] = ai_tex_coords == nullptr ?
+                                            float3{0.f, 0.f, -1.f} :
+                                            float3{ai_tex_coords[face[j]].x, ai_tex_coords[face[j]].y, 1.f};
+                    }
+                }
+            }
+        }
+
+        void import_mesh(const path &mesh_path, const float4x4 &transform, MeshData &data) noexcept {
+            // the importer and its aiScene only live until the mesh is converted
+            Assimp::Importer importer;
+            auto ai_scene = [&] {
+                GL_RENDER_PROFILE_SCOPE("Assimp import", "geometry", mesh_path.string());
+                return importer.ReadFile(mesh_path.string(), ASSIMP_POST_PROCESS_FLAGS);
+            }();
+            GL_RENDER_ASSERT(ai_scene != nullptr, "Mesh \"{}\" is nullptr", mesh_path.string());
+            GL_RENDER_ASSERT(!(ai_scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE), "Mesh \"{}\" is incomplete", mesh_path.string());
+            GL_RENDER_ASSERT(ai_scene->mRootNode != nullptr, "Failed to load mesh: {}", mesh_path.string());
 
             // gather submeshes
             vector<aiMesh *> mesh_list;
@@ -53,35 +100,724 @@ namespace gl_render {
                 }
             }
 
-            GL_RENDER_INFO("Loaded mesh \"{}\", list size: {}", mesh_path, mesh_list.size());
+            GL_RENDER_INFO("Loaded mesh \"{}\", list size: {}", mesh_path.string(), mesh_list.size());
 
-            // process submeshes
-            for (auto ai_mesh: mesh_list) {
-                // process material
-                auto iter = sceneAllInfo.materials.find(material_name);
-                if (iter == sceneAllInfo.materials.end()) {
-                    GL_RENDER_ERROR_WITH_LOCATION("Reference to undefined material: {}", material_name);
+            process_mesh(mesh_list, transform, data);
+        }
+
+        void load_mesh_file(const path &mesh_path, span<const std::byte> source, const float4x4 &transform,
+                            MeshData &data, bool native_obj, bool optimize, bool lods, uint thread_count) noexcept {
+            if (!native_obj || !load_obj(source, transform, data, thread_count)) {
+                if (native_obj) {
+                    GL_RENDER_WARNING("Failed to parse OBJ \"{}\", falling back to Assimp", mesh_path.string());
+                }
+                import_mesh(mesh_path, transform, data);
+            }
+            weld_mesh(data);
+            if (optimize) {
+                optimize_mesh(data);
+            }
+            if (lods) {
+                generate_lods(data);
+            }
+        }
+
+        MeshInstancing find_mesh_instancing(const SceneAllInfo &scene, bool enable) noexcept {
+            auto mesh_count = scene.meshes.size();
+            MeshInstancing instancing;
+            instancing.source.resize(mesh_count);
+            instancing.references.resize(mesh_count);
+            instancing.instance_counts.resize(mesh_count, 0u);
+            instancing.declared.resize(mesh_count, 0u);
+            gl_render::unordered_map<string, size_t> first_use;
+            for (auto index = 0ul; index < mesh_count; ++index) {
+                auto source = index;
+                if (enable) {
+                    auto file = scene.meshes[index].file_path.lexically_normal().generic_string();
+                    source = first_use.try_emplace(std::move(file), index).first->second;
+                }
+                instancing.source[index] = source;
+                instancing.references[source].emplace_back(index);
+                instancing.instance_counts[source] += scene.meshes[index].instance_count();
+                instancing.declared[source] |= static_cast<uint8_t>(!scene.meshes[index].instances.empty());
+            }
+            return instancing;
+        }
+
+        /// First object of every mesh of scene in its group: the meshes of a group and their instances are
+        /// numbered in scene order
+        [[nodiscard]] static gl_render::vector<uint> first_objects(const SceneAllInfo &scene) noexcept {
+            gl_render::vector<uint> first(scene.meshes.size());
+            gl_render::unordered_map<string, uint> next;
+            for (auto index = 0ul; index < scene.meshes.size(); ++index) {
+                auto &object = next[scene.meshes[index].material_name];
+                first[index] = object;
+                object += static_cast<uint>(scene.meshes[index].instance_count());
+            }
+            return first;
+        }
+
+        /// Build the meshlets and the vertex cache statistics of the welded mesh in prepared.data
+        static void prepare_mesh(PreparedMesh &prepared) noexcept {
+            GL_RENDER_PROFILE_SCOPE("prepare mesh", "geometry");
+            const auto &data = prepared.data;
+            if (data.index_count() == 0u) {
+                return;
+            }
+            prepared.meshlets.reserve(data.lod_count());
+            for (auto level = 0ul; level < data.lod_count(); ++level) {
+                auto lod = data.lod(level);
+                auto &meshlets = prepared.meshlets.emplace_back(
+                        build_meshlets(data.indices.subspan(lod.first_index, lod.index_count), data.positions));
+                for (auto &meshlet: meshlets) {
+                    meshlet.first_index += lod.first_index;
+                }
+            }
+            prepared.cache_statistics = analyze_vertex_cache(data.indices.first(data.index_count()), data.vertex_count());
+        }
+
+        struct GeometryLoad {
+            const SceneAllInfo *scene;
+            /// groups to load, all of them if empty
+            gl_render::unordered_set<string> materials;
+            Shader::TemplateList tl;
+            MeshInstancing instancing;
+            /// every mesh is kept in object space and added as an instance, see GeometryConfig::enable_object_transforms
+            bool object_transforms{false};
+            gl_render::vector<uint> first_objects;
+            /// meshes to load in upload order, shared meshes only through their source
+            gl_render::vector<size_t> sources;
+            size_t selected_count{0u};
+            /// meshes each group still waits for, the group is finalized when it drops to zero
+            gl_render::unordered_map<string, size_t> remaining;
+            gl_render::vector<GeometryGroup *> new_groups;
+
+            gl_render::vector<PreparedMesh> meshes;
+            gl_render::vector<string> mesh_paths;
+            gl_render::vector<size_t> memory_estimates;
+            size_t memory_budget{0u};
+            std::atomic<uint> cache_hits{0u};
+            /// a single OBJ file is split among the threads left idle by the number of meshes
+            uint obj_thread_count{1u};
+
+            std::mutex mutex;
+            std::condition_variable loaded_cv;
+            gl_render::vector<uint8_t> loaded;
+            size_t in_flight_memory{0u};
+            size_t peak_in_flight_memory{0u};
+            size_t next_dispatch{0u};
+            size_t next_upload{0u};
+            double upload_time{0.0};
+            /// ms the workers spent loading and preparing meshes, summed over the workers
+            std::atomic<double> worker_time{0.0};
+            std::chrono::steady_clock::time_point begin;
+
+            // declared last, so the workers are joined before the state they use is destroyed
+            unique_ptr<ThreadPool> thread_pool;
+
+            [[nodiscard]] bool selected(size_t index) const noexcept {
+                return materials.empty() || materials.contains(scene->meshes[index].material_name);
+            }
+            [[nodiscard]] bool object_space(size_t index) const noexcept {
+                return object_transforms || instancing.instanced(index);
+            }
+        };
+
+    }
+
+    Geometry::Geometry(const SceneAllInfo &sceneAllInfo, const path &scene_dir,
+                       const GeometryConfig &config, const SceneArchive *archive)
+            : _scene_dir{scene_dir}, _config{config}, _archive{archive} {
+        GL_RENDER_PROFILE_SCOPE("Geometry::Geometry", "geometry");
+        if (config.enable_mesh_cache && archive == nullptr) {
+            auto cache_dir = config.mesh_cache_dir.empty() ? scene_dir / ".cache" / "meshes" : config.mesh_cache_dir;
+            _mesh_cache = make_unique<MeshCache>(cache_dir);
+        }
+        _arena = make_unique<GeometryArena>();
+        glGenBuffers(1, &_camera_buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, _camera_buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(impl::CameraData), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        if (config.enable_gpu_culling) {
+            Shader::TemplateList tl{
+                    {"WORK_GROUP_SIZE", serialize(GeometryGroup::CULL_WORK_GROUP_SIZE)},
+                    {"MESHLET_BINDING", serialize(GeometryGroup::CULL_MESHLET_BINDING)},
+                    {"DRAW_BINDING", serialize(GeometryGroup::CULL_DRAW_BINDING)},
+                    {"INSTANCE_BINDING", serialize(GeometryGroup::CULL_INSTANCE_BINDING)},
+                    {"COMMAND_BINDING", serialize(GeometryGroup::CULL_COMMAND_BINDING)},
+                    {"COUNT_BINDING", serialize(GeometryGroup::CULL_COUNT_BINDING)},
+                    {"VISIBLE_INSTANCE_BINDING", serialize(GeometryGroup::CULL_VISIBLE_INSTANCE_BINDING)},
+                    {"INSTANCE_DRAW_BINDING", serialize(GeometryGroup::CULL_INSTANCE_DRAW_BINDING)},
+                    {"INSTANCE_STRIDE", serialize(sizeof(impl::InstanceData) / sizeof(float))}};
+            _instance_cull_shader = make_unique<Shader>("data/shaders/instance_cull.comp", tl);
+            _cull_shader = make_unique<Shader>("data/shaders/meshlet_cull.comp", tl);
+        }
+        _begin_load(sceneAllInfo, nullptr);
+        if (!config.enable_progressive_loading) {
+            _load_step(std::numeric_limits<double>::infinity(), true);
+            _sync_arena();
+        }
+    }
+
+    Geometry::~Geometry() noexcept {
+        glDeleteBuffers(1, &_material_buffer);
+        glDeleteBuffers(1, &_camera_buffer);
+    }
+
+    void Geometry::update(const SceneAllInfo &sceneAllInfo, const SceneDiff &diff) noexcept {
+        GL_RENDER_PROFILE_SCOPE("Geometry::update", "geometry");
+        GL_RENDER_ASSERT(!loading(), "Geometry can only be updated after it is loaded");
+        // the meshes of untouched groups may still have moved in the scene order
+        _index_objects(sceneAllInfo);
+        if (diff.light_count_changed) {
+            Shader::TemplateList tl = {
+                    {std::string{"POINT_LIGHT_COUNT"}, serialize(sceneAllInfo.lights.size())}
+            };
+            for (const auto &[name, index]: _group_indices) {
+                if (!diff.changed_groups.contains(name)) {
+                    _groups[index]->compile_shader(tl);
+                }
+            }
+        }
+        // groups whose material only changed its colors keep their meshes and shader
+        for (const auto &name: diff.changed_materials) {
+            if (auto iter = _group_indices.find(name); iter != _group_indices.end()) {
+                _groups[iter->second]->set_material_colors(*sceneAllInfo.materials.at(name));
+            }
+        }
+        if (diff.changed_groups.empty()) {
+            if (!diff.changed_materials.empty()) {
+                _update_materials();
+            }
+            return;
+        }
+
+        // changed groups are released and rebuilt in their slots, so the draw order stays the same
+        for (const auto &name: diff.changed_groups) {
+            if (auto iter = _group_indices.find(name); iter != _group_indices.end()) {
+                _groups[iter->second] = nullptr;
+            }
+        }
+        _begin_load(sceneAllInfo, &diff.changed_groups);
+        _load_step(std::numeric_limits<double>::infinity(), true);
+        _sync_arena();
+
+        // slots not refilled belong to groups left without meshes
+        std::erase(_groups, nullptr);
+        _group_indices.clear();
+        for (auto index = 0ul; index < _groups.size(); ++index) {
+            _group_indices.emplace(_groups[index]->material_name(), index);
+        }
+        _index_objects(sceneAllInfo);
+        _update_materials();
+        _update_aabb();
+        ++_revision;
+    }
+
+    void Geometry::_index_objects(const SceneAllInfo &scene) noexcept {
+        auto first_objects = impl::first_objects(scene);
+        _objects.resize(scene.meshes.size());
+        for (auto index = 0ul; index < scene.meshes.size(); ++index) {
+            auto iter = _group_indices.find(scene.meshes[index].material_name);
+            auto group = iter == _group_indices.end() ? std::numeric_limits<uint>::max() : static_cast<uint>(iter->second);
+            _objects[index] = uint3{group, first_objects[index], static_cast<uint>(scene.meshes[index].instance_count())};
+        }
+    }
+
+    bool Geometry::set_transform(size_t mesh, size_t instance, const float4x4 &transform) noexcept {
+        GL_RENDER_ASSERT(!loading(), "Objects can only be moved once the geometry is loaded");
+        GL_RENDER_ASSERT(mesh < _objects.size(), "Mesh {} is not in the scene of the geometry", mesh);
+        auto [group, first_object, instance_count] = _objects[mesh];
+        GL_RENDER_ASSERT(instance < instance_count, "Mesh {} has {} instance(s), not {}", mesh, instance_count, instance + 1u);
+        if (group >= _groups.size() || _groups[group] == nullptr) {
+            return false;
+        }
+        return _groups[group]->set_transform(first_object + static_cast<uint>(instance), transform);
+    }
+
+    impl::TransformUpload Geometry::upload_transforms() noexcept {
+        auto begin = std::chrono::steady_clock::now();
+        impl::TransformUpload upload;
+        for (auto &group: _groups) {
+            if (group != nullptr && group->ready()) {
+                upload += group->upload_transforms();
+            }
+        }
+        if (upload.instance_count != 0u) {
+            _update_aabb();
+            ++_revision;
+        }
+        upload.time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        return upload;
+    }
+
+    void Geometry::_update_aabb() noexcept {
+        _aabb = impl::AABB{};
+        for (const auto &group: _groups) {
+            if (group != nullptr && group->ready()) {
+                _aabb.min = min(_aabb.min, group->aabb().min);
+                _aabb.max = max(_aabb.max, group->aabb().max);
+            }
+        }
+    }
+
+    const BVH &Geometry::bvh() noexcept {
+        if (_bvh_revision == _revision) {
+            return _bvh;
+        }
+        _bvh_revision = _revision;
+        vector<impl::AABB> bounds;
+        _bvh_groups.clear();
+        for (auto index = 0ul; index < _groups.size(); ++index) {
+            if (_groups[index] != nullptr && _groups[index]->ready()) {
+                const auto &mesh_bounds = _groups[index]->mesh_bounds();
+                bounds.insert(bounds.end(), mesh_bounds.cbegin(), mesh_bounds.cend());
+                _bvh_groups.insert(_bvh_groups.end(), mesh_bounds.size(), index);
+            }
+        }
+        auto begin = std::chrono::steady_clock::now();
+        auto rebuilt = _bvh.update(bounds);
+        auto time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        // refits follow every revision, i.e. moving objects and groups arriving, so they are only debug output
+        if (rebuilt) {
+            GL_RENDER_INFO(
+                    "BVH over {} meshes built in {} ms: {} nodes, SAH cost {:.2f}",
+                    bounds.size(), time, _bvh.node_count(), _bvh.sah_cost());
+        } else {
+            GL_RENDER_DEBUG(
+                    "BVH over {} meshes refitted in {} ms: SAH cost {:.2f}",
+                    bounds.size(), time, _bvh.sah_cost());
+        }
+        return _bvh;
+    }
+
+    optional<float2> Geometry::depth_range(const float4x4 &view_projection, float3 position, float3 front) noexcept {
+        return bvh().depth_range(impl::Frustum::from(view_projection), position, front);
+    }
+
+    optional<Geometry::MeshHit> Geometry::pick(const BVH::Ray &ray) noexcept {
+        if (auto hit = bvh().intersect(ray)) {
+            return MeshHit{_bvh_groups[hit->primitive], hit->t};
+        }
+        return nullopt;
+    }
+
+    void Geometry::_update_materials() noexcept {
+        vector<impl::MaterialData> materials(max(_groups.size(), size_t{1}), impl::MaterialData{});
+        for (auto index = 0ul; index < _groups.size(); ++index) {
+            if (_groups[index] != nullptr) {
+                materials[index] = _groups[index]->material_data();
+                _groups[index]->set_material_index(static_cast<uint>(index));
+            }
+        }
+        if (_material_buffer == 0u) {
+            glGenBuffers(1, &_material_buffer);
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _material_buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, materials.size() * sizeof(impl::MaterialData), materials.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    size_t Geometry::ready_group_count() const noexcept {
+        return std::count_if(_groups.cbegin(), _groups.cend(), [](const auto &group) {
+            return group != nullptr && group->ready();
+        });
+    }
+
+    void Geometry::select_lods(const float3 &camera_position, float fov, float viewport_height) noexcept {
+        if (!_config.enable_lods) {
+            return;
+        }
+        impl::LodView view{
+                camera_position,
+                viewport_height * 0.5f / std::tan(radians(fov) * 0.5f),
+                _config.lod_error_threshold};
+        for (auto &group: _groups) {
+            if (group != nullptr && group->ready()) {
+                group->select_lods(view);
+            }
+        }
+    }
+
+    const Geometry::CullStatistics &Geometry::cull(const float4x4 &view_projection, float3 camera_position) noexcept {
+        auto begin = std::chrono::steady_clock::now();
+        impl::CullView view{impl::Frustum::from(view_projection), camera_position,
+                            _config.enable_mesh_culling, _config.enable_meshlet_culling};
+        _cull_statistics = CullStatistics{};
+        if (_config.enable_gpu_culling) {
+            auto set_view = [&](const Shader &shader) {
+                shader.use();
+                for (auto i = 0u; i < view.frustum.planes.size(); ++i) {
+                    shader.setVec4(serialize("frustumPlanes[", i, "]"), view.frustum.planes[i]);
+                }
+                shader.setVec3("cameraPos", camera_position);
+                shader.setBool("cullFrustum", view.meshes || view.meshlets);
+                shader.setBool("cullBackFacing", view.meshlets);
+            };
+            set_view(*_instance_cull_shader);
+            for (auto &group: _groups) {
+                if (group != nullptr && group->ready()) {
+                    group->dispatch_instance_culling(*_instance_cull_shader);
+                }
+            }
+            // the meshlet pass reads the visible instances and their counts
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+            set_view(*_cull_shader);
+            for (auto &group: _groups) {
+                if (group != nullptr && group->ready()) {
+                    group->dispatch_meshlet_culling(*_cull_shader);
+                    _cull_statistics.mesh_count += group->mesh_count();
+                    _cull_statistics.meshlet_count += group->meshlet_count();
+                }
+            }
+            // the commands and their counts are read by the multi-draws of render(), the visible instances by
+            // its vertex shaders
+            glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+            _cull_statistics.time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+            return _cull_statistics;
+        }
+        for (auto &group: _groups) {
+            if (group != nullptr && group->ready()) {
+                group->cull(view);
+                _cull_statistics.mesh_count += group->mesh_count();
+                _cull_statistics.visible_mesh_count += group->visible_mesh_count();
+                _cull_statistics.meshlet_count += group->meshlet_count();
+                _cull_statistics.visible_meshlet_count += group->visible_meshlet_count();
+                _cull_statistics.submitted_triangle_count += group->submitted_triangle_count();
+            }
+        }
+        _cull_statistics.time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        return _cull_statistics;
+    }
+
+    const Geometry::CullStatistics &Geometry::cull_statistics() noexcept {
+        if (!_config.enable_gpu_culling) {
+            return _cull_statistics;
+        }
+        // only the instances of instanced meshes are tested on their own on the GPU, and they are not read back
+        _cull_statistics.visible_mesh_count = _cull_statistics.mesh_count;
+        _cull_statistics.visible_meshlet_count = 0u;
+        _cull_statistics.submitted_triangle_count = 0u;
+        for (auto &group: _groups) {
+            if (group != nullptr && group->ready()) {
+                auto counts = group->read_culling_counts();
+                _cull_statistics.visible_meshlet_count += counts.x;
+                _cull_statistics.submitted_triangle_count += counts.y;
+            }
+        }
+        return _cull_statistics;
+    }
+
+    bool Geometry::load() noexcept {
+        if (_load == nullptr) {
+            return true;
+        }
+        auto complete = _load_step(_config.upload_time_budget, false);
+        _sync_arena();
+        return complete;
+    }
+
+    void Geometry::_sync_arena() noexcept {
+        for (auto &group: _groups) {
+            if (group != nullptr) {
+                group->sync_arena();
+            }
+        }
+    }
+
+    size_t Geometry::buffer_count() const noexcept {
+        // the material table and the camera block
+        auto count = GeometryArena::buffer_count() + 2u;
+        for (const auto &group: _groups) {
+            count += group != nullptr ? group->buffer_count() : 0u;
+        }
+        return count;
+    }
+
+    void Geometry::_begin_load(const SceneAllInfo &sceneAllInfo, const unordered_set<string> *materials) noexcept {
+        _load = make_unique<impl::GeometryLoad>();
+        auto &load = *_load;
+        load.begin = std::chrono::steady_clock::now();
+        load.scene = &sceneAllInfo;
+        if (materials != nullptr) {
+            load.materials = *materials;
+        }
+        load.tl = {
+                {std::string{"POINT_LIGHT_COUNT"}, serialize(sceneAllInfo.lights.size())}
+        };
+        auto mesh_count = sceneAllInfo.meshes.size();
+        // archives store shared meshes in object space, so they are always drawn instanced, and the others baked
+        load.instancing = impl::find_mesh_instancing(sceneAllInfo, _config.enable_instancing || _archive != nullptr);
+        load.object_transforms = _config.enable_object_transforms && _archive == nullptr;
+        load.first_objects = impl::first_objects(sceneAllInfo);
+        // a shared mesh is loaded through its source, even if the source itself is in a group left untouched
+        gl_render::vector<uint8_t> needed(mesh_count, 0u);
+        for (auto index = 0ul; index < mesh_count; ++index) {
+            if (load.selected(index)) {
+                needed[load.instancing.source[index]] = 1u;
+                ++load.remaining[sceneAllInfo.meshes[index].material_name];
+                ++load.selected_count;
+            }
+        }
+        for (auto index = 0ul; index < mesh_count; ++index) {
+            if (needed[index] != 0u) {
+                load.sources.emplace_back(index);
+            }
+        }
+        load.meshes.resize(mesh_count);
+        load.mesh_paths.resize(mesh_count);
+        load.memory_estimates.resize(mesh_count);
+        load.loaded.resize(mesh_count, 0u);
+        // archived meshes are mapped, not imported, so they do not count against the budget
+        for (auto index: load.sources) {
+            if (_archive != nullptr) {
+                break;
+            }
+            const auto &file_path = sceneAllInfo.meshes[index].file_path;
+            load.mesh_paths[index] = file_path.is_relative() ? (_scene_dir / file_path).string() : file_path.string();
+            std::error_code ec;
+            load.memory_estimates[index] = std::filesystem::file_size(load.mesh_paths[index], ec) * impl::MESH_MEMORY_ESTIMATE_FACTOR;
+        }
+        load.memory_budget = _config.mesh_memory_budget == 0u ?
+                             std::numeric_limits<size_t>::max() :
+                             static_cast<size_t>(_config.mesh_memory_budget) * 1024u * 1024u;
+        load.thread_pool = make_unique<ThreadPool>(_config.thread_count);
+        load.obj_thread_count = max(load.thread_pool->size() / static_cast<uint>(max(load.sources.size(), size_t{1})), 1u);
+    }
+
+    void Geometry::_load_mesh(size_t index) noexcept {
+        auto &load = *_load;
+        const auto &mesh = load.scene->meshes[index];
+        const auto &mesh_path = load.mesh_paths[index];
+        auto &data = load.meshes[index].data;
+        // shared and movable meshes are kept in object space, their transforms go to the instances
+        auto transform = load.object_space(index) ? constant::IDENTITY_FLOAT4x4 : mesh.world_transform(0u);
+        GL_RENDER_PROFILE_SCOPE("load mesh", "geometry", mesh.file_path.string());
+
+        if (_archive != nullptr) {
+            auto found = _archive->mesh(index, data);
+            GL_RENDER_ASSERT(found, "Mesh {} (\"{}\") is missing from the scene archive", index, mesh.file_path.string());
+            return;
+        }
+
+        auto native_obj = _config.enable_native_obj && impl::is_obj_file(mesh_path);
+        MappedFile source{mesh_path};
+        GL_RENDER_ASSERT(source.valid(), "Failed to read mesh \"{}\"", mesh_path);
+        auto cache_key = 0ull;
+        if (_mesh_cache != nullptr) {
+            auto flags = native_obj ? impl::OBJ_LOADER_FLAGS : impl::ASSIMP_POST_PROCESS_FLAGS;
+            if (_config.enable_mesh_optimization) {
+                flags |= impl::MESH_OPTIMIZATION_FLAG;
+            }
+            if (_config.enable_lods) {
+                flags |= impl::MESH_LOD_FLAG;
+            }
+            cache_key = MeshCache::key(source.bytes(), transform, flags);
+            if (_mesh_cache->load(cache_key, data)) {
+                load.cache_hits.fetch_add(1u);
+                return;
+            }
+        }
+
+        impl::load_mesh_file(mesh_path, source.bytes(), transform, data, native_obj,
+                             _config.enable_mesh_optimization, _config.enable_lods, load.obj_thread_count);
+        if (_mesh_cache != nullptr) {
+            _mesh_cache->store(cache_key, data);
+        }
+    }
+
+    GeometryGroup *Geometry::_group_of(size_t index) noexcept {
+        auto &load = *_load;
+        const auto &material_name = load.scene->meshes[index].material_name;
+        auto iter = load.scene->materials.find(material_name);
+        if (iter == load.scene->materials.end()) {
+            GL_RENDER_ERROR_WITH_LOCATION("Reference to undefined material: {}", material_name);
+        }
+        auto [slot, inserted] = _group_indices.try_emplace(material_name, _groups.size());
+        if (inserted) {
+            _groups.emplace_back();
+        }
+        auto &group = _groups[slot->second];
+        if (group == nullptr) {
+            group = make_unique<GeometryGroup>(iter->second.get(), _arena.get(), _scene_dir, load.tl, _archive,
+                                               _config.enable_compact_vertices, _config.enable_gpu_culling);
+            load.new_groups.emplace_back(group.get());
+            _update_materials();
+        }
+        return group.get();
+    }
+
+    bool Geometry::_load_step(double time_budget, bool wait) noexcept {
+        // Meshes are loaded and prepared by the workers, everything a group computes from a mesh included, while
+        // the GL thread drains them into the groups in scene order, so group contents do not depend on thread
+        // timing. Every mesh is freed right after its upload, and new loads are only started while the estimated
+        // memory of meshes loaded but not yet uploaded stays within the budget.
+        auto &load = *_load;
+        auto step_begin = std::chrono::steady_clock::now();
+        auto source_count = load.sources.size();
+        while (load.next_upload < source_count) {
+            auto k = load.next_upload;
+            while (load.next_dispatch < source_count &&
+                   (load.next_dispatch == k ||
+                    load.in_flight_memory + load.memory_estimates[load.sources[load.next_dispatch]] <= load.memory_budget)) {
+                load.in_flight_memory += load.memory_estimates[load.sources[load.next_dispatch]];
+                load.thread_pool->dispatch([this, &load, dispatch_index = load.sources[load.next_dispatch]] {
+                    auto worker_begin = std::chrono::steady_clock::now();
+                    _load_mesh(dispatch_index);
+                    impl::prepare_mesh(load.meshes[dispatch_index]);
+                    load.worker_time.fetch_add(std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - worker_begin).count());
+                    {
+                        std::lock_guard lock{load.mutex};
+                        load.loaded[dispatch_index] = 1u;
+                    }
+                    load.loaded_cv.notify_all();
+                });
+                ++load.next_dispatch;
+            }
+            load.peak_in_flight_memory = max(load.peak_in_flight_memory, load.in_flight_memory);
+            auto index = load.sources[k];
+            if (wait) {
+                GL_RENDER_PROFILE_SCOPE("wait for mesh", "geometry");
+                std::unique_lock lock{load.mutex};
+                load.loaded_cv.wait(lock, [&] { return load.loaded[index] != 0u; });
+            } else if (std::lock_guard lock{load.mutex}; load.loaded[index] == 0u) {
+                return false;
+            }
+
+            GL_RENDER_PROFILE_SCOPE("upload mesh", "upload", load.scene->meshes[index].file_path.string());
+            auto upload_begin = std::chrono::steady_clock::now();
+            auto append = [&](size_t reference, auto &&f) {
+                auto group = _group_of(reference);
+                f(group);
+                if (--load.remaining[load.scene->meshes[reference].material_name] == 0u) {
+                    group->finalize();
+                    _update_aabb();
+                    ++_revision;
                 }
-                auto material = iter->second->material_info.get();
-                uint offset = 0u;
-                if (mesh_map.find(material) != mesh_map.end()) {
-                    offset = mesh_map[material].back().offset + mesh_map[material].back().ai_mesh->mNumVertices;
+            };
+            if (load.object_space(index)) {
+                for (auto reference: load.instancing.references[index]) {
+                    if (!load.selected(reference)) {
+                        continue;
+                    }
+                    append(reference, [&](GeometryGroup *group) {
+                        const auto &mesh = load.scene->meshes[reference];
+                        for (auto instance = 0ul; instance < mesh.instance_count(); ++instance) {
+                            group->append_instance(index, load.meshes[index], mesh.world_transform(instance),
+                                                   load.first_objects[reference] + static_cast<uint>(instance));
+                        }
+                    });
                 }
-                mesh_map[material].emplace_back(impl::MeshInfoGrouped{ai_mesh, &mesh, offset});
+            } else {
+                append(index, [&](GeometryGroup *group) { group->append(load.meshes[index], load.first_objects[index]); });
+            }
+            load.meshes[index] = impl::PreparedMesh{};
+            auto upload_end = std::chrono::steady_clock::now();
+            load.upload_time += std::chrono::duration<double, std::milli>(upload_end - upload_begin).count();
+            load.in_flight_memory -= load.memory_estimates[index];
+            ++load.next_upload;
+
+            if (load.next_upload < source_count &&
+                std::chrono::duration<double, std::milli>(upload_end - step_begin).count() >= time_budget) {
+                return false;
             }
         }
+        _end_load();
+        return true;
+    }
+
+    void Geometry::_end_load() noexcept {
+        auto &load = *_load;
+        load.thread_pool->synchronize();
 
-        for (auto &[material, mesh_info_grouped_vec]: mesh_map) {
-            _groups.emplace_back(make_unique<GeometryGroup>(material, mesh_info_grouped_vec, scene_dir, tl));
-            _aabb.min = min(_aabb.min, _groups.back()->aabb().min);
-            _aabb.max = max(_aabb.max, _groups.back()->aabb().max);
+        auto stored_vertices = size_t{0};
+        auto stored_triangles = size_t{0};
+        auto stored_indices = size_t{0};
+        auto drawn_triangles = size_t{0};
+        auto instance_count = size_t{0};
+        impl::VertexCacheStatistics cache_statistics;
+        for (auto group: load.new_groups) {
+            cache_statistics += group->cache_statistics();
+            stored_vertices += group->vertex_count();
+            stored_triangles += group->triangle_count();
+            stored_indices += group->index_count();
+            drawn_triangles += group->drawn_triangle_count();
+            instance_count += group->instance_count();
         }
+        auto load_end = std::chrono::steady_clock::now();
 
         GL_RENDER_INFO(
                 "All meshes AABB: min = {}, max = {})",
                 to_string(_aabb.min),
                 to_string(_aabb.max));
-        GL_RENDER_INFO("Group count: {}", _groups.size());
+        GL_RENDER_INFO("Group count: {} ({} built)", _groups.size(), load.new_groups.size());
+        if (_mesh_cache != nullptr) {
+            GL_RENDER_INFO(
+                    "Mesh cache \"{}\": {} hit(s), {} miss(es)",
+                    _mesh_cache->dir().string(), load.cache_hits.load(), load.sources.size() - load.cache_hits.load());
+        }
+        // the worker time over the wall time shows how the load scales with the thread count
+        auto load_time = std::chrono::duration<double, std::milli>(load_end - load.begin).count();
+        GL_RENDER_INFO(
+                "Geometry loaded {} meshes in {} ms with {} thread(s): workers busy {} ms ({:.2f}x parallel) loading "
+                "and preparing meshes, GL thread {} ms copying them into groups",
+                load.selected_count,
+                load_time,
+                load.thread_pool->size(),
+                load.worker_time.load(),
+                load.worker_time.load() / max(load_time, 1e-3),
+                load.upload_time);
+        auto vertex_size = static_cast<double>(_config.enable_compact_vertices ?
+                                               impl::COMPACT_VERTEX_SIZE : GeometryGroup::VERTEX_SIZE);
+        auto triangle_size = vertex_size * 3.0;
+        auto indexed_size = static_cast<double>(stored_vertices) * vertex_size +
+                            static_cast<double>(stored_indices * sizeof(uint));
+        GL_RENDER_INFO(
+                "Instancing: {} of {} meshes imported, {} instances; vertex memory {} MB ({} MB if baked)",
+                load.sources.size(), load.selected_count, instance_count,
+                indexed_size / (1024.0 * 1024.0),
+                static_cast<double>(drawn_triangles) * triangle_size / (1024.0 * 1024.0));
+        GL_RENDER_INFO(
+                "Indexing: {} vertices for {} triangles ({:.2f} per triangle); vertex and index memory {} MB, "
+                "{} MB de-indexed",
+                stored_vertices, stored_triangles,
+                static_cast<double>(stored_vertices) / static_cast<double>(max(stored_triangles, size_t{1})),
+                indexed_size / (1024.0 * 1024.0),
+                static_cast<double>(stored_triangles) * triangle_size / (1024.0 * 1024.0));
+        GL_RENDER_INFO(
+                "Vertex cache ({} entry FIFO): ACMR {:.3f}, ATVR {:.3f} ({})",
+                impl::VERTEX_CACHE_SIZE, cache_statistics.acmr(), cache_statistics.atvr(),
+                _config.enable_mesh_optimization ? "meshes optimized" : "meshes as imported");
+        GL_RENDER_INFO(
+                "Vertex format: {} bytes per vertex ({} bytes as float3 streams), vertex memory {} MB ({} MB as float3)",
+                vertex_size, GeometryGroup::VERTEX_SIZE,
+                static_cast<double>(stored_vertices) * vertex_size / (1024.0 * 1024.0),
+                static_cast<double>(stored_vertices * GeometryGroup::VERTEX_SIZE) / (1024.0 * 1024.0));
+        GL_RENDER_INFO(
+                "Geometry memory: peak in-flight mesh estimate {} MB (budget {} MB), process peak RSS {} MB",
+                to_megabytes(load.peak_in_flight_memory),
+                _config.mesh_memory_budget,
+                to_megabytes(peak_memory_usage()));
+        // rebuilt groups leave the ranges of the groups they replace behind
+        _arena->defragment();
+        auto arena = _arena->statistics();
+        GL_RENDER_INFO(
+                "Geometry arena: {} of {} MB in {} allocations, {} free ranges, grown {} time(s), defragmented {} time(s); "
+                "uploads {} MB at {:.1f} MB/s with {} staging wait(s); {} GL buffers for {} groups",
+                to_megabytes(arena.used),
+                to_megabytes(arena.capacity),
+                arena.allocation_count,
+                arena.free_range_count,
+                arena.grow_count,
+                arena.defragment_count,
+                to_megabytes(arena.uploaded),
+                arena.upload_throughput(),
+                arena.staging_waits,
+                buffer_count(),
+                _groups.size());
+        _index_objects(*load.scene);
+        _load = nullptr;
     }
 
     void Geometry::render(
@@ -89,195 +825,749 @@ namespace gl_render {
             const float4x4& projection,
             const float4x4& view,
             const float3& cameraPos) const {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GeometryGroup::MATERIAL_BINDING, _material_buffer);
+        _set_camera(projection, view, cameraPos);
         for (auto &group: _groups) {
+            if (group == nullptr || !group->ready()) {
+                continue;
+            }
             auto shader = group->shader();
             shader->use();
             group->set_lights(lightManager);
-            group->set_camera(projection, view, cameraPos);
             group->render();
         }
     }
 
-    void Geometry::shadow(
-            LightManager *lightManager,
-            const float4x4& projection,
-            const float4x4& view,
-            const float3& cameraPos) const {
+    void Geometry::shadow(const Shader &shader) const {
         for (auto &group: _groups) {
-            auto shader = group->shader();
-            shader->use();
-            group->set_lights(lightManager);
-            group->set_camera(projection, view, cameraPos);
-            group->shadow();
+            if (group != nullptr && group->ready()) {
+                group->shadow(shader);
+            }
         }
     }
 
-    auto Geometry::vertex_positions_flattened() noexcept {
-        if (_vertex_positions_flattened.empty()) {
-            auto sum = 0u;
-            auto offset = 0u;
-            for (const auto &group: _groups) {
-                sum += group->triangle_count() * 3u;
-            }
-            _vertex_positions_flattened.resize(sum);
-            for (const auto &group: _groups) {
-                auto count = group->triangle_count() * 3u;
-                glBindBuffer(GL_ARRAY_BUFFER, group->position_buffer());
-                glGetBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(float3), _vertex_positions_flattened.data() + offset);
-                offset += count;
+    void Geometry::_set_camera(const float4x4 &projection, const float4x4 &view, const float3 &camera_position) const noexcept {
+        impl::CameraData camera{projection, view, float4{camera_position, 1.f}};
+        glBindBuffer(GL_UNIFORM_BUFFER, _camera_buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(impl::CameraData), &camera);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, GeometryGroup::CAMERA_BINDING, _camera_buffer);
+    }
+
+    GeometryGroup::GeometryGroup(const MaterialInfo *material, GeometryArena *arena, const path &scene_dir,
+                                 const Shader::TemplateList &tl, const SceneArchive *archive,
+                                 bool compact_vertices, bool gpu_culling) noexcept
+            : _material{*material}, _compact_vertices{compact_vertices}, _gpu_culling{gpu_culling}, _arena{arena} {
+        GL_RENDER_PROFILE_SCOPE("create group", "geometry", material->name);
+        _texture_num = material->texture_num();
+        compile_shader(tl);
+
+        // process material
+        _has_diffuse_texture = !material->diffuse_map.empty();
+        if (_has_diffuse_texture) {
+            Texture *diffuse_texture;
+            auto archived = archive == nullptr ? nullopt : archive->texture(material->diffuse_map.string());
+            if (archived) {
+                diffuse_texture = TextureManager::GetInstance()->CreateTexture(
+                        material->diffuse_map, archived->resolution, archived->pixel_storage, archived->pixels);
+            } else {
+                auto diffuse_map_path = material->diffuse_map;
+                if (material->diffuse_map.is_relative()) {
+                    diffuse_map_path = (scene_dir / material->diffuse_map).string();
+                }
+                diffuse_texture = TextureManager::GetInstance()->CreateTexture(diffuse_map_path);
             }
+            _texture_handles.emplace_back(diffuse_texture->handle());
+        } else {
+            _texture_handles.emplace_back(0u);
         }
-        return &_vertex_positions_flattened;
+
+        glGenVertexArrays(1, &_vertex_array);
     }
 
-    GeometryGroup::GeometryGroup(MaterialInfo *material, const gl_render::vector<impl::MeshInfoGrouped>& meshInfoGroupedVec,
-                                 const path &scene_dir, Shader::TemplateList tl) noexcept {
-        _buffer_num = 6;
-        _texture_num = material->texture_num();
-        string type_string = MaterialInfo::Type2String(material->type);
+    void GeometryGroup::compile_shader(Shader::TemplateList tl) noexcept {
+        string type_string = MaterialInfo::Type2String(_material.type);
         tl["TEXTURE_COUNT"] = serialize(_texture_num);
+        tl["MATERIAL_BINDING"] = serialize(MATERIAL_BINDING);
+        tl["CAMERA_BINDING"] = serialize(CAMERA_BINDING);
+        tl["COMPACT_VERTICES"] = _compact_vertices ? "1" : "0";
         _shader = make_unique<Shader>(
                 "data/shaders/" + type_string + ".vert",
                 "",
                 "data/shaders/" + type_string + ".frag",
                 tl
         );
+    }
 
-        vector<float3> positions;
-        vector<float3> normals;
-        vector<float3> diffuse_vec;
-        vector<float3> specular_vec;
-        vector<float3> ambient_vec;
-        vector<float3> tex_coords;
-        vector<uint3> indices;
+    GeometryGroup::~GeometryGroup() noexcept {
+        glDeleteVertexArrays(1, &_vertex_array);
+        _arena->release(_vertex_allocation);
+        _arena->release(_index_allocation);
+        glDeleteBuffers(1, &_instance_buffer);
+        glDeleteBuffers(1, &_indirect_buffer);
+        glDeleteBuffers(1, &_gpu_meshlet_buffer);
+        glDeleteBuffers(1, &_gpu_draw_buffer);
+        glDeleteBuffers(1, &_count_buffer);
+        glDeleteBuffers(1, &_visible_instance_buffer);
+        glDeleteBuffers(1, &_instance_draw_buffer);
+    }
 
-        // process material
-        float3 diffuse{0.5f, 0.f, 0.5f};
-        auto has_diffuse_texture = true;
-        if (material->diffuse_map.empty()) {
-            diffuse = material->diffuse;
-            has_diffuse_texture = false;
+    void GeometryGroup::_reallocate(uint vertex_capacity) noexcept {
+        // the float3 streams back to back, vertex_capacity long each
+        auto stream_size = static_cast<size_t>(vertex_capacity) * sizeof(float3);
+        auto allocation = _arena->allocate(stream_size * ATTRIBUTE_COUNT);
+        for (auto attribute = 0u; attribute < ATTRIBUTE_COUNT; ++attribute) {
+            auto offset = attribute * stream_size;
+            if (_vertex_count != 0u) {
+                // the old contents never leave the GPU
+                _arena->copy(_vertex_allocation, _streams[attribute].offset, allocation, offset,
+                             _vertex_count * sizeof(float3));
+            }
+            _streams[attribute] = impl::VertexStream{offset, 3, GL_FLOAT, GL_FALSE, sizeof(float3)};
         }
+        _arena->release(_vertex_allocation);
+        _vertex_allocation = allocation;
+        _vertex_capacity = vertex_capacity;
+        _bind_arena();
+    }
+
+    void GeometryGroup::_reallocate_indices(uint index_capacity) noexcept {
+        auto allocation = _arena->allocate(index_capacity * sizeof(uint));
+        if (_index_count != 0u) {
+            _arena->copy(_index_allocation, 0u, allocation, 0u, _index_count * sizeof(uint));
+        }
+        _arena->release(_index_allocation);
+        _index_allocation = allocation;
+        _index_capacity = index_capacity;
+        _bind_arena();
+    }
 
-        if (has_diffuse_texture) {
-            auto diffuse_map_path = material->diffuse_map;
-            if (material->diffuse_map.is_relative()) {
-                diffuse_map_path = (scene_dir / material->diffuse_map).string();
+    void GeometryGroup::_bind_arena() noexcept {
+        // the element buffer binding is part of the VAO
+        glBindVertexArray(_vertex_array);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _arena->buffer());
+        if (_vertex_allocation != GeometryArena::INVALID_ALLOCATION) {
+            auto base = _arena->offset(_vertex_allocation);
+            glBindBuffer(GL_ARRAY_BUFFER, _arena->buffer());
+            for (auto attribute = 0u; attribute < ATTRIBUTE_COUNT; ++attribute) {
+                const auto &stream = _streams[attribute];
+                glEnableVertexAttribArray(attribute);
+                glVertexAttribPointer(attribute, stream.size, stream.type, stream.normalized, stream.stride,
+                                      reinterpret_cast<const void *>(base + stream.offset));
             }
-            auto diffuse_texture = TextureManager::GetInstance()->CreateTexture(diffuse_map_path);
-            _texture_handles.emplace_back(diffuse_texture->handle());
-        } else {
-            _texture_handles.emplace_back(0u);
         }
+        glBindVertexArray(0);
+        _arena_generation = _arena->generation();
+    }
+
+    void GeometryGroup::sync_arena() noexcept {
+        if (_arena_generation == _arena->generation()) {
+            return;
+        }
+        _bind_arena();
+        if (!_ready) {
+            return;
+        }
+        // the culling pass rebases the commands it writes itself
+        if (!_gpu_culling) {
+            _upload_commands(_visible_draws, 0u);
+        }
+        _upload_commands(_draws, _shadow_draw_offset);
+    }
 
-        for (const auto& meshInfoGrouped : meshInfoGroupedVec) {
-            auto ai_mesh = meshInfoGrouped.ai_mesh;
-            auto mesh = meshInfoGrouped.mesh_info;
-            auto offset = meshInfoGrouped.offset;
+    void GeometryGroup::_upload_commands(span<const impl::DrawCommand> commands, uint first) noexcept {
+        vector<impl::DrawCommand> rebased(commands.begin(), commands.end());
+        auto index_base = _index_base();
+        for (auto &command: rebased) {
+            command.first_index += index_base;
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _indirect_buffer);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, first * sizeof(impl::DrawCommand),
+                        rebased.size() * sizeof(impl::DrawCommand), rebased.data());
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
 
-            auto model_matrix = mesh->transform;
-            auto normal_matrix = transpose(inverse(model_matrix));
+    size_t GeometryGroup::buffer_count() const noexcept {
+        // instances and draw commands, and the meshlet and draw records, the counts, the visible instances and
+        // the instance draws of the culling pass
+        return _gpu_culling ? 7u : 2u;
+    }
 
-            // process vertices
-            for (auto i = 0ul; i < ai_mesh->mNumVertices; i++) {
-                auto ai_position = ai_mesh->mVertices[i];
-                auto ai_normal = ai_mesh->mNormals[i];
-                auto temp = model_matrix * float4{ai_position.x, ai_position.y, ai_position.z, 1.f};
-                auto position = float3(temp.x, temp.y, temp.z);
-                auto normal = normal_matrix * float4{ai_normal.x, ai_normal.y, ai_normal.z, 1.f};
-                positions.emplace_back(position);
-                normals.emplace_back(normal);
-                _aabb.min = min(_aabb.min, position);
-                _aabb.max = max(_aabb.max, position);
+    uint GeometryGroup::_upload(const impl::PreparedMesh &mesh) noexcept {
+        const auto &mesh_data = mesh.data;
+        GL_RENDER_ASSERT(mesh_data.indexed(), "Meshes are welded before upload");
+        auto vertex_count = _vertex_count;
+        auto index_count = _index_count;
+        auto mesh_vertex_count = static_cast<uint>(mesh_data.vertex_count());
+        // every level of detail is uploaded
+        auto mesh_index_count = static_cast<uint>(mesh_data.indices.size());
+        if (!_compact_vertices && vertex_count + mesh_vertex_count > _vertex_capacity) {
+            _reallocate(max(_vertex_capacity * 2u, vertex_count + mesh_vertex_count));
+        }
+        if (index_count + mesh_index_count > _index_capacity) {
+            _reallocate_indices(max(_index_capacity * 2u, index_count + mesh_index_count));
+        }
 
-                // TODO: move properties of phong .etc to children class
-                auto ai_tex_coords = ai_mesh->mTextureCoords[0];
-                if (!has_diffuse_texture || ai_tex_coords == nullptr) {
-                    tex_coords.emplace_back(0.f, 0.f, -1.f);
-                } else {
-                    tex_coords.emplace_back(ai_tex_coords[i].x, ai_tex_coords[i].y, 1.f);
-                    GL_RENDER_INFO("tex coord: ({}, {}, {}), tex uv: ({}, {})",
-                                   ai_position.x, ai_position.y, ai_position.z,
-                                   ai_tex_coords[i].x, ai_tex_coords[i].y);
-                }
-                diffuse_vec.emplace_back(diffuse);
-                specular_vec.emplace_back(material->specular);
-                ambient_vec.emplace_back(material->ambient);
+        // mesh streams are staged straight from their storage (or the cache mapping) into place
+        auto offset = vertex_count * sizeof(float3);
+        auto upload = [&](Attribute attribute, const float3 *data) {
+            if (_compact_vertices) {
+                _staged_streams[attribute].insert(_staged_streams[attribute].end(), data, data + mesh_vertex_count);
+            } else {
+                _arena->upload(_vertex_allocation, _streams[attribute].offset + offset, span<const float3>{data, mesh_vertex_count});
             }
+        };
+        // material parameters are constant over the group and live in the material table, not in the vertices
+        upload(POSITION, mesh_data.positions.data());
+        upload(NORMAL, mesh_data.normals.data());
+        upload(TEX_COORD, mesh_data.tex_coords.data());
+
+        // indices are rebased onto the group vertices, so consecutive meshes without levels of detail can share a draw
+        vector<uint> indices(mesh_data.indices.begin(), mesh_data.indices.end());
+        for (auto &index: indices) {
+            index += vertex_count;
+        }
+        _arena->upload(_index_allocation, index_count * sizeof(uint), span<const uint>{indices});
 
-            // process faces
-            for (auto i = 0ul; i < ai_mesh->mNumFaces; i++) {
-                auto &&face = ai_mesh->mFaces[i].mIndices;
-                indices.emplace_back(uint3{face[0], face[1], face[2]} + offset);
+        _cache_statistics += mesh.cache_statistics;
+        _vertex_count += mesh_vertex_count;
+        _index_count += mesh_index_count;
+        _triangle_count += static_cast<uint>(mesh_data.index_count() / 3u);
+        return index_count;
+    }
+
+    uint GeometryGroup::_add_draw(const impl::PreparedMesh &mesh, uint first_index, uint instance_count) noexcept {
+        const auto &mesh_data = mesh.data;
+        _draws.emplace_back(impl::DrawCommand{static_cast<uint>(mesh_data.index_count()), instance_count, first_index, 0, 0u});
+        _draw_transforms.emplace_back();
+        _draw_bounds.emplace_back(mesh_data.aabb);
+        _draw_meshlets.emplace_back(_append_meshlets(mesh, first_index));
+        auto &lods = _draw_lods.emplace_back();
+        if (mesh_data.lod_count() > 1u) {
+            for (auto level = 0ul; level < mesh_data.lod_count(); ++level) {
+                auto lod = mesh_data.lod(level);
+                lod.first_index += first_index;
+                lods.emplace_back(lod);
             }
         }
+        return static_cast<uint>(_draws.size() - 1u);
+    }
 
+    vector<uint2> GeometryGroup::_append_meshlets(const impl::PreparedMesh &mesh, uint first_index) noexcept {
+        vector<uint2> ranges;
+        for (const auto &meshlets: mesh.meshlets) {
+            ranges.emplace_back(uint2{static_cast<uint>(_meshlets.size()), static_cast<uint>(meshlets.size())});
+            for (auto meshlet: meshlets) {
+                meshlet.first_index += first_index;
+                _meshlets.emplace_back(meshlet);
+            }
+        }
+        return ranges;
+    }
+
+    void GeometryGroup::_add_object(uint object) noexcept {
+        if (object >= _object_meshes.size()) {
+            _object_meshes.resize(object + 1u, INVALID_MESH);
+        }
+    }
+
+    void GeometryGroup::_add_mesh(uint object, impl::GroupMesh mesh, const impl::AABB &bounds) noexcept {
+        _object_meshes[object] = static_cast<uint>(_meshes.size());
+        _meshes.emplace_back(mesh);
+        _mesh_bounds.emplace_back(bounds);
+        _aabb.min = min(_aabb.min, bounds.min);
+        _aabb.max = max(_aabb.max, bounds.max);
+    }
+
+    void GeometryGroup::append(const impl::PreparedMesh &mesh, uint object) noexcept {
+        const auto &mesh_data = mesh.data;
+        auto mesh_index_count = static_cast<uint>(mesh_data.index_count());
+        _add_object(object);
+        if (mesh_index_count == 0u) {
+            return;
+        }
+        auto first = _upload(mesh);
+        // consecutive baked meshes share one draw, unless they have levels of detail to select from
+        if (mesh_data.lod_count() == 1u && !_draws.empty() && _draw_transforms.back().empty() &&
+            _draw_lods.back().empty() && _draws.back().first_index + _draws.back().count == first) {
+            _draws.back().count += mesh_index_count;
+            // the meshlets of the mesh directly follow those of the draw
+            auto meshlets = _append_meshlets(mesh, first).front();
+            _draw_meshlets.back().front().y += meshlets.y;
+            _draw_bounds.back().min = min(_draw_bounds.back().min, mesh_data.aabb.min);
+            _draw_bounds.back().max = max(_draw_bounds.back().max, mesh_data.aabb.max);
+            _add_mesh(object, impl::GroupMesh{static_cast<uint>(_draws.size() - 1u), meshlets, 0u}, mesh_data.aabb);
+        } else {
+            auto draw = _add_draw(mesh, first, 1u);
+            _add_mesh(object, impl::GroupMesh{draw, _draw_meshlets[draw].front(), 0u}, mesh_data.aabb);
+        }
+    }
+
+    void GeometryGroup::append_instance(size_t source, const impl::PreparedMesh &mesh,
+                                        const float4x4 &transform, uint object) noexcept {
+        const auto &mesh_data = mesh.data;
+        auto mesh_index_count = static_cast<uint>(mesh_data.index_count());
+        _add_object(object);
+        if (mesh_index_count == 0u) {
+            return;
+        }
+        auto iter = _instanced_draws.find(source);
+        if (iter == _instanced_draws.end()) {
+            auto first = _upload(mesh);
+            iter = _instanced_draws.emplace(source, _draws.size()).first;
+            _add_draw(mesh, first, 0u);
+        }
+        _draw_transforms[iter->second].emplace_back(transform);
+        // the instance is assigned by finalize()
+        _add_mesh(object, impl::GroupMesh{static_cast<uint>(iter->second), _draw_meshlets[iter->second].front(), 0u},
+                  mesh_data.aabb.transformed(transform));
+    }
+
+    void GeometryGroup::finalize() noexcept {
+        GL_RENDER_PROFILE_SCOPE("finalize group", "upload", _material.name);
+        if (_vertex_count != 0u && _vertex_count < _vertex_capacity) {
+            _reallocate(_vertex_count);
+        }
+        if (_index_count != 0u && _index_count < _index_capacity) {
+            _reallocate_indices(_index_count);
+        }
+        if (_compact_vertices && _vertex_count != 0u) {
+            _compact();
+        }
+
+        // instance 0 is the identity shared by all baked draws
+        _instances.assign(1u, impl::InstanceData{constant::IDENTITY_FLOAT4x4, float3x3{1.f}});
+        for (auto i = 0ul; i < _draws.size(); ++i) {
+            const auto &transforms = _draw_transforms[i];
+            if (transforms.empty()) {
+                continue;
+            }
+            _draws[i].instance_count = static_cast<uint>(transforms.size());
+            _draws[i].base_instance = static_cast<uint>(_instances.size());
+            for (const auto &transform: transforms) {
+                _instances.emplace_back(impl::InstanceData{transform, float3x3{transpose(inverse(transform))}});
+            }
+        }
+        _instance_count = static_cast<uint>(_instances.size() - 1u);
+        _instance_dirty.assign(_instances.size(), 0u);
+        _draw_levels.assign(_draws.size(), 0u);
+        _visible_draws = _draws;
+        _visible_meshlet_count = _meshlets.size();
+        _visible_mesh_count = _meshes.size();
+        _mesh_boxes.assign(_mesh_bounds);
+        _mesh_visibility.assign(_meshes.size(), 1u);
+        // meshes grouped by draw, in append order, so that the instances of a draw match its transforms
+        _draw_mesh_offsets.assign(_draws.size() + 1u, 0u);
+        for (const auto &mesh: _meshes) {
+            ++_draw_mesh_offsets[mesh.draw + 1u];
+        }
+        std::partial_sum(_draw_mesh_offsets.cbegin(), _draw_mesh_offsets.cend(), _draw_mesh_offsets.begin());
+        _draw_meshes.resize(_meshes.size());
+        auto next = _draw_mesh_offsets;
+        for (auto mesh = 0u; mesh < _meshes.size(); ++mesh) {
+            auto draw = _meshes[mesh].draw;
+            if (!_draw_transforms[draw].empty()) {
+                _meshes[mesh].instance = _draws[draw].base_instance + (next[draw] - _draw_mesh_offsets[draw]);
+            }
+            _draw_meshes[next[draw]++] = mesh;
+        }
+        _submitted_triangle_count = drawn_triangle_count();
+        _ready = true;
+
+        glGenBuffers(1, &_instance_buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, _instance_buffer);
+        glBufferData(GL_ARRAY_BUFFER, _instances.size() * sizeof(impl::InstanceData), _instances.data(),
+                     _instance_count != 0u ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+        glBindVertexArray(_vertex_array);
+        glBindVertexBuffer(INSTANCE_VERTEX_BINDING, _instance_buffer, 0, sizeof(impl::InstanceData));
+        glVertexBindingDivisor(INSTANCE_VERTEX_BINDING, 1u);
+        for (auto column = 0u; column < 4u; ++column) {
+            auto location = INSTANCE_MODEL_LOCATION + column;
+            glEnableVertexAttribArray(location);
+            glVertexAttribFormat(location, 4, GL_FLOAT, GL_FALSE,
+                                 static_cast<GLuint>(offsetof(impl::InstanceData, model) + column * sizeof(float4)));
+            glVertexAttribBinding(location, INSTANCE_VERTEX_BINDING);
+        }
+        for (auto column = 0u; column < 3u; ++column) {
+            auto location = INSTANCE_NORMAL_LOCATION + column;
+            glEnableVertexAttribArray(location);
+            glVertexAttribFormat(location, 3, GL_FLOAT, GL_FALSE,
+                                 static_cast<GLuint>(offsetof(impl::InstanceData, normal) + column * sizeof(float3)));
+            glVertexAttribBinding(location, INSTANCE_VERTEX_BINDING);
+        }
+        glBindVertexArray(0);
+
+        glGenBuffers(1, &_indirect_buffer);
+        if (_gpu_culling) {
+            _create_culling_buffers();
+        } else {
+            // culling leaves at most one command per meshlet, every draw has at least one
+            _shadow_draw_offset = static_cast<uint>(_meshlets.size());
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _indirect_buffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, (_shadow_draw_offset + _draws.size()) * sizeof(impl::DrawCommand),
+                         nullptr, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            _upload_commands(_visible_draws, 0u);
+        }
+        _upload_commands(_draws, _shadow_draw_offset);
+
+        auto lod_draw_count = std::count_if(_draw_lods.cbegin(), _draw_lods.cend(), [](const auto &lods) { return !lods.empty(); });
         GL_RENDER_INFO(
-                "AABB: min = {}, max = {})",
+                "Group \"{}\": {} triangles, {} vertices, {} draws ({} with LODs), {} meshlets, {} instances, "
+                "ACMR {:.3f}, ATVR {:.3f}, AABB: min = {}, max = {})",
+                _material.name,
+                _triangle_count,
+                _vertex_count,
+                _draws.size(),
+                lod_draw_count,
+                _meshlets.size(),
+                _instance_count,
+                _cache_statistics.acmr(),
+                _cache_statistics.atvr(),
                 to_string(_aabb.min),
                 to_string(_aabb.max));
+    }
 
-        _triangle_count = indices.size();
-        auto vertex_count = _triangle_count * 3;
+    bool GeometryGroup::set_transform(uint object, const float4x4 &transform) noexcept {
+        GL_RENDER_ASSERT(_ready, "Objects of group \"{}\" can only be moved once it is finalized", _material.name);
+        if (object >= _object_meshes.size()) {
+            return false;
+        }
+        // empty meshes are not stored, there is nothing to move
+        if (_object_meshes[object] == INVALID_MESH) {
+            return true;
+        }
+        auto mesh = _object_meshes[object];
+        auto draw = _meshes[mesh].draw;
+        auto instance = _meshes[mesh].instance;
+        if (instance == 0u) {
+            return false;
+        }
+        _draw_transforms[draw][instance - _draws[draw].base_instance] = transform;
+        _instances[instance] = impl::InstanceData{transform, float3x3{transpose(inverse(transform))}};
+        if (_instance_dirty[instance] == 0u) {
+            _instance_dirty[instance] = 1u;
+            _dirty_instances.emplace_back(instance);
+        }
+        _mesh_bounds[mesh] = _draw_bounds[draw].transformed(transform);
+        _mesh_boxes.set(mesh, _mesh_bounds[mesh]);
+        return true;
+    }
 
-        // transfer to OpenGL
-        glGenVertexArrays(1, &_vertex_array);
+    impl::TransformUpload GeometryGroup::upload_transforms() noexcept {
+        impl::TransformUpload upload;
+        if (_dirty_instances.empty()) {
+            return upload;
+        }
+        std::sort(_dirty_instances.begin(), _dirty_instances.end());
+        glBindBuffer(GL_ARRAY_BUFFER, _instance_buffer);
+        for (auto i = 0ul; i < _dirty_instances.size();) {
+            auto first = _dirty_instances[i];
+            auto last = first;
+            while (++i < _dirty_instances.size() && _dirty_instances[i] - last <= TRANSFORM_UPLOAD_GAP) {
+                last = _dirty_instances[i];
+            }
+            auto size = (last - first + 1u) * sizeof(impl::InstanceData);
+            glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(impl::InstanceData), size, &_instances[first]);
+            upload.bytes += size;
+            ++upload.range_count;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        for (auto instance: _dirty_instances) {
+            _instance_dirty[instance] = 0u;
+        }
+        upload.instance_count = _dirty_instances.size();
+        _dirty_instances.clear();
 
-        vector<uint32_t> buffers(_buffer_num);
-        glGenBuffers(_buffer_num, buffers.data());
+        _aabb = impl::AABB{};
+        for (const auto &bounds: _mesh_bounds) {
+            _aabb.min = min(_aabb.min, bounds.min);
+            _aabb.max = max(_aabb.max, bounds.max);
+        }
+        return upload;
+    }
 
-        _position_buffer = buffers[0];
-        _normal_buffer = buffers[1];
-        _diffuse_buffer = buffers[2];
-        _tex_coord_buffer = buffers[3];
-        _specular_buffer = buffers[4];
-        _ambient_buffer = buffers[5];
+    void GeometryGroup::_create_culling_buffers() noexcept {
+        vector<impl::GpuMeshlet> meshlets;
+        meshlets.reserve(_meshlets.size());
+        _gpu_draws.clear();
+        _command_capacity = 0u;
+        vector<uint> instance_draws(_instances.size(), 0u);
+        for (auto i = 0u; i < _draws.size(); ++i) {
+            const auto &draw = _draws[i];
+            // baked draws have instance_count 1 at base instance 0, the identity, which is never culled
+            const auto &bounds = _draw_bounds[i];
+            _gpu_draws.emplace_back(impl::GpuDraw{
+                    _draw_levels[i], draw.base_instance, draw.instance_count, 0u,
+                    float4{(bounds.min + bounds.max) * 0.5f, length(bounds.max - bounds.min) * 0.5f}});
+            if (draw.base_instance != 0u) {
+                std::fill_n(instance_draws.begin() + draw.base_instance, draw.instance_count, i);
+            }
+            auto level_capacity = 0u;
+            for (auto level = 0u; level < _draw_meshlets[i].size(); ++level) {
+                auto range = _draw_meshlets[i][level];
+                for (auto m = range.x; m < range.x + range.y; ++m) {
+                    const auto &meshlet = _meshlets[m];
+                    meshlets.emplace_back(impl::GpuMeshlet{
+                            float4{meshlet.center, meshlet.radius}, float4{meshlet.cone_axis, meshlet.cone_cutoff},
+                            meshlet.first_index, meshlet.index_count, i, level});
+                }
+                level_capacity = max(level_capacity, range.y);
+            }
+            // one command per meshlet of the largest level, drawing all visible instances
+            _command_capacity += level_capacity;
+        }
+        _gpu_meshlet_count = static_cast<uint>(meshlets.size());
 
-        // VAO
-        glBindVertexArray(_vertex_array);
+        glGenBuffers(1, &_gpu_meshlet_buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _gpu_meshlet_buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, meshlets.size() * sizeof(impl::GpuMeshlet), meshlets.data(), GL_STATIC_DRAW);
+        glGenBuffers(1, &_gpu_draw_buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _gpu_draw_buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, _gpu_draws.size() * sizeof(impl::GpuDraw), _gpu_draws.data(), GL_DYNAMIC_DRAW);
+        // command count and triangle count, then the visible instance count of every draw
+        glGenBuffers(1, &_count_buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _count_buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(uint2) + _draws.size() * sizeof(uint), nullptr, GL_DYNAMIC_COPY);
+        // the identity at instance 0 is drawn from here as well, the culling pass only writes the others
+        glGenBuffers(1, &_visible_instance_buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _visible_instance_buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, _instances.size() * sizeof(impl::InstanceData), _instances.data(), GL_DYNAMIC_COPY);
+        glGenBuffers(1, &_instance_draw_buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _instance_draw_buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, instance_draws.size() * sizeof(uint), instance_draws.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        _shadow_draw_offset = _command_capacity;
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _indirect_buffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, (_command_capacity + _draws.size()) * sizeof(impl::DrawCommand),
+                     nullptr, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
 
-        glBindBuffer(GL_ARRAY_BUFFER, _position_buffer);
-        glBufferData(GL_ARRAY_BUFFER, vertex_count * sizeof(float3), impl::_flatten(positions, indices).data(),
-                     GL_DYNAMIC_COPY);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float3), nullptr);
-
-        glBindBuffer(GL_ARRAY_BUFFER, _normal_buffer);
-        glBufferData(GL_ARRAY_BUFFER, vertex_count * sizeof(float3), impl::_flatten(normals, indices).data(),
-                     GL_DYNAMIC_COPY);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(float3), nullptr);
-
-        glBindBuffer(GL_ARRAY_BUFFER, _diffuse_buffer);
-        glBufferData(GL_ARRAY_BUFFER, vertex_count * sizeof(float3), impl::_flatten(diffuse_vec, indices).data(),
-                     GL_STATIC_DRAW);
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(float3), nullptr);
-
-        glBindBuffer(GL_ARRAY_BUFFER, _tex_coord_buffer);
-        glBufferData(GL_ARRAY_BUFFER, vertex_count * sizeof(float3), impl::_flatten(tex_coords, indices).data(),
-                     GL_STATIC_DRAW);
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(float3), nullptr);
-
-        glBindBuffer(GL_ARRAY_BUFFER, _specular_buffer);
-        glBufferData(GL_ARRAY_BUFFER, vertex_count * sizeof(float3), impl::_flatten(specular_vec, indices).data(),
-                     GL_STATIC_DRAW);
-        glEnableVertexAttribArray(5);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(float3), nullptr);
-
-        glBindBuffer(GL_ARRAY_BUFFER, _ambient_buffer);
-        glBufferData(GL_ARRAY_BUFFER, vertex_count * sizeof(float3), impl::_flatten(ambient_vec, indices).data(),
-                     GL_STATIC_DRAW);
-        glEnableVertexAttribArray(6);
-        glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, sizeof(float3), nullptr);
+    void GeometryGroup::_compact() noexcept {
+        auto compact = impl::compact_vertices(_staged_streams[POSITION], _staged_streams[NORMAL], _staged_streams[TEX_COORD]);
+        _position_bounds = compact.bounds;
+        for (auto &stream: _staged_streams) {
+            vector<float3>{}.swap(stream);
+        }
 
-        glBindVertexArray(0);
+        // the compact streams back to back, each 16 bytes aligned
+        auto stream_size = [](const auto &data) { return (data.size() * sizeof(data[0]) + 15u) / 16u * 16u; };
+        auto allocation = _arena->allocate(
+                stream_size(compact.positions) + stream_size(compact.normals) + stream_size(compact.tex_coords));
+        auto offset = 0ul;
+        auto upload = [&](Attribute attribute, const auto &data, GLint size, GLenum type, GLboolean normalized) {
+            using Element = typename std::remove_cvref_t<decltype(data)>::value_type;
+            _arena->upload(allocation, offset, span<const Element>{data});
+            _streams[attribute] = impl::VertexStream{offset, size, type, normalized, sizeof(Element)};
+            offset += stream_size(data);
+        };
+        upload(POSITION, compact.positions, 4, GL_UNSIGNED_SHORT, GL_TRUE);
+        upload(NORMAL, compact.normals, 2, GL_SHORT, GL_TRUE);
+        upload(TEX_COORD, compact.tex_coords, 2, GL_HALF_FLOAT, GL_FALSE);
+        _arena->release(_vertex_allocation);
+        _vertex_allocation = allocation;
+        _bind_arena();
     }
 
-    GeometryGroup::~GeometryGroup() noexcept {
-        glDeleteVertexArrays(1, &_vertex_array);
-        glDeleteBuffers(_buffer_num, &_position_buffer);
+    impl::MaterialData GeometryGroup::material_data() const noexcept {
+        // the diffuse color is unused with a diffuse map
+        auto diffuse = _has_diffuse_texture ? float3{0.5f, 0.f, 0.5f} : _material.diffuse;
+        return impl::MaterialData{
+                float4{diffuse, _has_diffuse_texture ? 1.f : 0.f},
+                float4{_material.specular, 0.f},
+                float4{_material.ambient, 0.f}};
+    }
+
+    void GeometryGroup::set_material_colors(const MaterialInfo &material) noexcept {
+        GL_RENDER_ASSERT(material.name == _material.name && material.type == _material.type &&
+                         material.diffuse_map == _material.diffuse_map,
+                         "Material \"{}\" needs its group rebuilt", material.name);
+        _material.diffuse = material.diffuse;
+        _material.specular = material.specular;
+        _material.ambient = material.ambient;
+    }
+
+    size_t GeometryGroup::drawn_triangle_count() const noexcept {
+        auto count = 0ul;
+        for (const auto &draw: _draws) {
+            count += static_cast<size_t>(draw.count / 3u) * draw.instance_count;
+        }
+        return count;
+    }
+
+    void GeometryGroup::select_lods(const impl::LodView &view) noexcept {
+        for (auto i = 0ul; i < _draws.size(); ++i) {
+            const auto &lods = _draw_lods[i];
+            if (lods.empty()) {
+                continue;
+            }
+            auto level = lods.size() - 1u;
+            if (_draw_transforms[i].empty()) {
+                level = view.level(lods, view.distance(_draw_bounds[i]), 1.f);
+            } else {
+                // every instance shares the draw, the closest one decides
+                for (const auto &transform: _draw_transforms[i]) {
+                    auto scale = max(max(length(float3{transform[0]}), length(float3{transform[1]})),
+                                     length(float3{transform[2]}));
+                    auto distance = view.distance(_draw_bounds[i].transformed(transform));
+                    level = min(level, view.level(lods, distance, scale));
+                }
+            }
+            _draw_levels[i] = static_cast<uint>(level);
+        }
+        if (!_gpu_culling) {
+            return;
+        }
+        auto changed = false;
+        for (auto i = 0ul; i < _gpu_draws.size(); ++i) {
+            changed |= _gpu_draws[i].level != _draw_levels[i];
+            _gpu_draws[i].level = _draw_levels[i];
+        }
+        if (changed) {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, _gpu_draw_buffer);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, _gpu_draws.size() * sizeof(impl::GpuDraw), _gpu_draws.data());
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        }
+    }
+
+    void GeometryGroup::cull(const impl::CullView &view) noexcept {
+        struct InstanceCulling {
+            float4x4 model;
+            float scale;
+            bool cone;      // rotation and uniform scale only, i.e. the normal cone is transformed with model
+        };
+        vector<InstanceCulling> instances;
+        _culled_draws.clear();
+        _visible_meshlet_count = 0u;
+        _visible_mesh_count = view.meshes ? impl::cull_boxes(view.frustum, _mesh_boxes, _mesh_visibility) : _meshes.size();
+        if (!view.meshes) {
+            std::fill(_mesh_visibility.begin(), _mesh_visibility.end(), 1u);
+        }
+        for (auto i = 0ul; i < _draws.size(); ++i) {
+            const auto &draw = _draws[i];
+            auto add = [&](const impl::Meshlet &meshlet) {
+                ++_visible_meshlet_count;
+                // neighbouring meshlets of one draw are merged back into one command
+                if (!_culled_draws.empty() && _culled_draws.back().base_instance == draw.base_instance &&
+                    _culled_draws.back().first_index + _culled_draws.back().count == meshlet.first_index) {
+                    _culled_draws.back().count += meshlet.index_count;
+                } else {
+                    _culled_draws.emplace_back(impl::DrawCommand{
+                            meshlet.index_count, draw.instance_count, meshlet.first_index, 0, draw.base_instance});
+                }
+            };
+            auto add_visible = [&](uint2 range) {
+                for (auto m = range.x; m < range.x + range.y; ++m) {
+                    const auto &meshlet = _meshlets[m];
+                    if (!view.meshlets ||
+                        (view.frustum.intersects(meshlet.center, meshlet.radius) && !meshlet.back_facing(view.position))) {
+                        add(meshlet);
+                    }
+                }
+            };
+            auto meshes = span<const uint>{_draw_meshes}.subspan(
+                    _draw_mesh_offsets[i], _draw_mesh_offsets[i + 1u] - _draw_mesh_offsets[i]);
+            auto level = _draw_meshlets[i][_draw_levels[i]];
+            if (_draw_transforms[i].empty()) {
+                if (!_draw_lods[i].empty()) {
+                    // a single mesh, drawn at its selected level
+                    if (_mesh_visibility[meshes.front()] != 0u) {
+                        add_visible(level);
+                    }
+                    continue;
+                }
+                for (auto mesh: meshes) {
+                    if (_mesh_visibility[mesh] != 0u) {
+                        add_visible(_meshes[mesh].meshlets);
+                    }
+                }
+                continue;
+            }
+            instances.clear();
+            for (auto k = 0ul; k < meshes.size(); ++k) {
+                if (_mesh_visibility[meshes[k]] == 0u) {
+                    continue;
+                }
+                const auto &transform = _draw_transforms[i][k];
+                auto scales = float3{length(float3{transform[0]}), length(float3{transform[1]}), length(float3{transform[2]})};
+                auto scale = max(max(scales.x, scales.y), scales.z);
+                auto uniform = scale - min(min(scales.x, scales.y), scales.z) <= scale * 1e-3f;
+                instances.emplace_back(InstanceCulling{transform, scale, uniform && glm::determinant(float3x3{transform}) > 0.f});
+            }
+            if (instances.empty()) {
+                continue;
+            }
+            if (!view.meshlets) {
+                add_visible(level);
+                continue;
+            }
+            for (auto m = level.x; m < level.x + level.y; ++m) {
+                const auto &meshlet = _meshlets[m];
+                auto visible = std::any_of(instances.cbegin(), instances.cend(), [&](const auto &instance) {
+                    auto center = float3{instance.model * float4{meshlet.center, 1.f}};
+                    auto radius = meshlet.radius * instance.scale;
+                    if (!view.frustum.intersects(center, radius)) {
+                        return false;
+                    }
+                    if (!instance.cone) {
+                        return true;
+                    }
+                    auto axis = float3{instance.model * float4{meshlet.cone_axis, 0.f}} / instance.scale;
+                    return !impl::Meshlet{center, radius, axis, meshlet.cone_cutoff}.back_facing(view.position);
+                });
+                if (visible) {
+                    add(meshlet);
+                }
+            }
+        }
+        if (_culled_draws.size() == _visible_draws.size() &&
+            std::memcmp(_culled_draws.data(), _visible_draws.data(), _culled_draws.size() * sizeof(impl::DrawCommand)) == 0) {
+            return;
+        }
+        std::swap(_culled_draws, _visible_draws);
+        _submitted_triangle_count = 0u;
+        for (const auto &draw: _visible_draws) {
+            _submitted_triangle_count += static_cast<size_t>(draw.count / 3u) * draw.instance_count;
+        }
+        _upload_commands(_visible_draws, 0u);
+    }
+
+    void GeometryGroup::dispatch_instance_culling(const Shader &shader) const noexcept {
+        const uint zero = 0u;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, _count_buffer);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        if (_instance_count == 0u) {
+            return;
+        }
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_DRAW_BINDING, _gpu_draw_buffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_INSTANCE_BINDING, _instance_buffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_COUNT_BINDING, _count_buffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_VISIBLE_INSTANCE_BINDING, _visible_instance_buffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_INSTANCE_DRAW_BINDING, _instance_draw_buffer);
+        shader.setUint("instanceCount", _instance_count);
+        shader.dispatch(_instance_count, CULL_WORK_GROUP_SIZE);
+    }
+
+    void GeometryGroup::dispatch_meshlet_culling(const Shader &shader) const noexcept {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_MESHLET_BINDING, _gpu_meshlet_buffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_DRAW_BINDING, _gpu_draw_buffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_COMMAND_BINDING, _indirect_buffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_COUNT_BINDING, _count_buffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_VISIBLE_INSTANCE_BINDING, _visible_instance_buffer);
+        shader.setUint("meshletCount", _gpu_meshlet_count);
+        shader.setUint("indexBase", _index_base());
+        shader.dispatch(_gpu_meshlet_count, CULL_WORK_GROUP_SIZE);
+    }
+
+    uint2 GeometryGroup::read_culling_counts() const noexcept {
+        uint2 counts{0u};
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        glBindBuffer(GL_COPY_READ_BUFFER, _count_buffer);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(uint2), &counts);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        return counts;
     }
 
     void GeometryGroup::render() const {
@@ -285,14 +1575,42 @@ namespace gl_render {
 
         // textures
         _shader->setHandlevARB("textures", _texture_handles.data(), _texture_handles.size());
+        _shader->setUint("materialIndex", _material_index);
+        if (_compact_vertices) {
+            _shader->setVec3("positionOffset", _position_bounds.min);
+            _shader->setVec3("positionScale", _position_bounds.max - _position_bounds.min);
+        }
 
-        glDrawArrays(GL_TRIANGLES, 0, _triangle_count * 3);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _indirect_buffer);
+        if (_gpu_culling) {
+            // the commands of the culling pass draw its visible instances
+            glBindVertexBuffer(INSTANCE_VERTEX_BINDING, _visible_instance_buffer, 0, sizeof(impl::InstanceData));
+            // the culling pass wrote the command count, the CPU never sees it
+            glBindBuffer(GL_PARAMETER_BUFFER, _count_buffer);
+            glMultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, 0,
+                                             static_cast<GLsizei>(_command_capacity), 0);
+            glBindBuffer(GL_PARAMETER_BUFFER, 0);
+        } else {
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(_visible_draws.size()), 0);
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
         glBindVertexArray(0);
     }
 
-    void GeometryGroup::shadow() const {
+    void GeometryGroup::shadow(const Shader &shader) const {
         glBindVertexArray(_vertex_array);
-        glDrawArrays(GL_TRIANGLES, 0, _triangle_count * 3);
+        if (_gpu_culling) {
+            glBindVertexBuffer(INSTANCE_VERTEX_BINDING, _instance_buffer, 0, sizeof(impl::InstanceData));
+        }
+        if (_compact_vertices) {
+            shader.setVec3("positionOffset", _position_bounds.min);
+            shader.setVec3("positionScale", _position_bounds.max - _position_bounds.min);
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _indirect_buffer);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                    reinterpret_cast<const void *>(_shadow_draw_offset * sizeof(impl::DrawCommand)),
+                                    static_cast<GLsizei>(_draws.size()), 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
         glBindVertexArray(0);
     }
 
@@ -309,10 +1627,4 @@ namespace gl_render {
         }
     }
 
-    void GeometryGroup::set_camera(const float4x4 &projection, const float4x4 &view, const float3 &cameraPos) const {
-        _shader->setMat4("projection", projection);
-        _shader->setMat4("view", view);
-        _shader->setVec3("cameraPos", cameraPos);
-    }
-
 }
@@ -4,61 +4,192 @@
 
 #pragma once
 
+#include <array>
+
 #include <base/scene_parser.h>
 #include <base/shader.h>
 #include <base/light_manager.h>
+#include <base/aabb.h>
+#include <base/bvh.h>
+#include <base/frustum.h>
+#include <base/geometry_arena.h>
+#include <base/mesh_cache.h>
+#include <base/obj_loader.h>
+#include <base/mesh_processing.h>
+#include <base/scene_archive.h>
+#include <base/scene_diff.h>
 
 #include <assimp/scene.h>
+#include <assimp/postprocess.h>
 
 namespace gl_render {
 
     namespace impl {
 
-        struct AABB {
-            float3 min{1.e10f};
-            float3 max{-1.e10f};
-
-            [[nodiscard]] auto &operator[](size_t index) noexcept {
-                switch (index) {
-                    case 0:
-                        return min;
-                    case 1:
-                        return max;
-                    default:
-                    GL_RENDER_ERROR("AABB index out of range");
-                }
+        /// Assimp post-process steps applied to every imported mesh, part of the mesh cache key
+        constexpr uint ASSIMP_POST_PROCESS_FLAGS =
+                aiProcess_Triangulate |
+                aiProcess_FixInfacingNormals | aiProcess_GenNormals |
+                aiProcess_RemoveRedundantMaterials |
+                aiProcess_OptimizeGraph | aiProcess_OptimizeMeshes;
+
+        /// Import the mesh file with Assimp, then transform and flatten it into data
+        void import_mesh(const path &mesh_path, const float4x4 &transform, MeshData &data) noexcept;
+
+        /// Load the mesh file mapped in source and weld it: OBJ files with load_obj if native_obj is set,
+        /// everything else, and OBJ files load_obj rejects, with import_mesh. Welded meshes are then run
+        /// through optimize_mesh if optimize is set, and get levels of detail from generate_lods if lods is set.
+        void load_mesh_file(const path &mesh_path, span<const std::byte> source, const float4x4 &transform,
+                            MeshData &data, bool native_obj, bool optimize, bool lods,
+                            uint thread_count = 1u) noexcept;
+
+        /// Meshes of a scene referencing the same file. A shared file is imported once, in object space,
+        /// from its first mesh (the source) and drawn with the transforms of all meshes referencing it.
+        struct MeshInstancing {
+            /// first mesh with the same file, the mesh itself if instancing is disabled
+            gl_render::vector<size_t> source;
+            /// meshes sharing the file of a source, indexed by the source
+            gl_render::vector<gl_render::vector<size_t>> references;
+            /// placements of the file of a source, the instances declared by its references included
+            gl_render::vector<size_t> instance_counts;
+            /// 1 for the sources of which a reference declares instances, be it only one
+            gl_render::vector<uint8_t> declared;
+
+            [[nodiscard]] auto instanced(size_t index) const noexcept {
+                auto source = this->source[index];
+                return instance_counts[source] > 1u || declared[source] != 0u;
             }
+        };
+
+        /// Share the files referenced by several meshes if enable is set. Meshes with declared instances are
+        /// instanced either way.
+        [[nodiscard]] MeshInstancing find_mesh_instancing(const SceneAllInfo &scene, bool enable) noexcept;
+
+        /// Same layout as DrawElementsIndirectCommand
+        struct DrawCommand {
+            uint count;
+            uint instance_count;
+            uint first_index;
+            int base_vertex;
+            uint base_instance;
+        };
+
+        /// Where a vertex attribute lives in the vertex allocation of a group and how it is read
+        struct VertexStream {
+            size_t offset;
+            GLint size;
+            GLenum type;
+            GLboolean normalized;
+            GLsizei stride;
+        };
+
+        /// Per-instance vertex attributes
+        struct InstanceData {
+            float4x4 model;
+            float3x3 normal;
+        };
+
+        /// Entry of the material table (std430), w of diffuse is 1 if the diffuse map is used
+        struct MaterialData {
+            float4 diffuse;
+            float4 specular;
+            float4 ambient;
+        };
+
+        /// Camera uniform block (std140) shared by the material shaders
+        struct CameraData {
+            float4x4 projection;
+            float4x4 view;
+            float4 position;
+        };
 
-            [[nodiscard]] const auto &operator[](size_t index) const noexcept {
-                switch (index) {
-                    case 0:
-                        return min;
-                    case 1:
-                        return max;
-                    default:
-                    GL_RENDER_ERROR("AABB index out of range");
+        /// Meshlet record of the GPU culling pass (std430, see meshlet_cull.comp), one per meshlet of every
+        /// level of detail of every draw; the sphere and the cone are in object space for instanced draws
+        struct GpuMeshlet {
+            float4 sphere;
+            float4 cone;
+            uint first_index;
+            uint index_count;
+            uint draw;
+            uint level;
+        };
+
+        /// Draw record of the GPU culling pass, baked draws are the identity instance 0
+        struct GpuDraw {
+            uint level;
+            uint base_instance;
+            uint instance_count;
+            uint padding;
+            float4 sphere;      // bounds of the stored mesh, instances are tested with it
+        };
+
+        /// What the screen-space error of a level of detail is measured with
+        struct LodView {
+            float3 position;
+            /// pixels covered by a unit length facing the camera at distance one
+            float pixels_per_unit;
+            /// largest error in pixels a level may project to
+            float error_threshold;
+
+            /// distance to the closest point of aabb, 0 inside
+            [[nodiscard]] float distance(const AABB &aabb) const noexcept {
+                return length(max(max(aabb.min - position, position - aabb.max), float3{0.f}));
+            }
+            /// coarsest level of lods whose error, scaled by scale, projects within the threshold at distance
+            [[nodiscard]] size_t level(span<const MeshLod> lods, float distance, float scale) const noexcept {
+                auto level = 0ul;
+                while (level + 1u < lods.size() &&
+                       lods[level + 1u].error * scale * pixels_per_unit <= error_threshold * distance) {
+                    ++level;
                 }
+                return level;
             }
         };
 
-        template<typename T>
-        static T _flatten(const T &v, const std::vector<uint3> &indices) noexcept {
-            T container;
-            container.reserve(indices.size() * 3u);
-            for (auto i: indices) {
-                container.emplace_back(v[i.x]);
-                container.emplace_back(v[i.y]);
-                container.emplace_back(v[i.z]);
+        /// What a frame is culled against, the mesh and meshlet tests can be turned off separately
+        struct CullView {
+            Frustum frustum;
+            float3 position;
+            bool meshes;
+            bool meshlets;
+        };
+
+        /// A mesh or an instance of a group: its draw, its instance (0, the identity, if it is baked) and, if it is
+        /// baked, its meshlets at full detail
+        struct GroupMesh {
+            uint draw;
+            uint2 meshlets;
+            uint instance;
+        };
+
+        /// What GeometryGroup::upload_transforms() sent to the instance buffers
+        struct TransformUpload {
+            size_t instance_count{0u};
+            size_t range_count{0u};
+            size_t bytes{0u};
+            double time{0.0};     // ms
+
+            TransformUpload &operator+=(const TransformUpload &rhs) noexcept {
+                instance_count += rhs.instance_count;
+                range_count += rhs.range_count;
+                bytes += rhs.bytes;
+                time += rhs.time;
+                return *this;
             }
-            return container;
-        }
+        };
 
-        struct MeshInfoGrouped {
-            aiMesh *ai_mesh;
-            const MeshInfo *mesh_info;
-            uint offset;
+        /// A loaded mesh with everything a group builds from it on the CPU, prepared by the load workers so that
+        /// the GL thread only copies it into place: meshlets of every level of detail, with first indices relative
+        /// to the mesh, and the vertex cache behaviour of its full-detail indices
+        struct PreparedMesh {
+            MeshData data;
+            gl_render::vector<gl_render::vector<Meshlet>> meshlets;
+            VertexCacheStatistics cache_statistics;
         };
 
+        /// Streaming state of the meshes being loaded into groups, see Geometry::load()
+        struct GeometryLoad;
+
         struct MeshSqueezed {
             gl_render::vector<float3> vertices;
             gl_render::vector<float3> normals;
@@ -66,28 +197,170 @@ namespace gl_render {
 
     }
 
+    struct GeometryConfig {
+        /// worker threads used to import and prepare meshes, 0 for hardware concurrency, 1 for serial import
+        uint thread_count = 0u;
+        /// cache processed mesh streams, keyed by source content, transform and import flags
+        bool enable_mesh_cache = true;
+        /// empty for "<scene dir>/.cache/meshes"
+        path mesh_cache_dir;
+        /// upper bound in MB for mesh data loaded but not yet uploaded, 0 for unbounded
+        uint mesh_memory_budget = 512u;
+        /// store mesh files referenced more than once only once and draw them instanced
+        bool enable_instancing = true;
+        /// keep every mesh in object space and draw it with its transform from the instance buffer of its group,
+        /// so that it can be moved with Geometry::set_transform(); baked meshes share draws but never move.
+        /// Archives store meshes that are not shared baked, so they stay baked.
+        bool enable_object_transforms = true;
+        /// parse OBJ files with the native loader instead of Assimp
+        bool enable_native_obj = true;
+        /// return from construction right away and upload meshes with load() as they arrive
+        bool enable_progressive_loading = true;
+        /// ms per load() call spent uploading meshes
+        double upload_time_budget = 4.0;
+        /// reorder triangles and vertices of imported meshes for the vertex cache, overdraw and vertex fetch
+        bool enable_mesh_optimization = true;
+        /// generate levels of detail for imported meshes and draw each mesh at the level its distance allows
+        bool enable_lods = true;
+        /// pixels the geometric error of a level of detail may project to
+        float lod_error_threshold = 1.f;
+        /// store vertices in the compact format of impl::CompactVertices instead of float3 streams
+        bool enable_compact_vertices = false;
+        /// skip the meshes whose bounds are outside of the view frustum every frame
+        bool enable_mesh_culling = true;
+        /// skip the meshlets outside of the view frustum or facing away from the camera every frame
+        bool enable_meshlet_culling = true;
+        /// cull the instances, then the meshlets with compute shaders that write one instanced draw command per
+        /// visible meshlet, drawn with one multi-draw per group whose count the GPU reads back itself
+        bool enable_gpu_culling = false;
+    };
+
     class GeometryGroup {
 
+    public:
+        /// vertex attribute locations, one buffer each
+        enum Attribute : uint {
+            POSITION = 0u,
+            NORMAL,
+            TEX_COORD,
+            ATTRIBUTE_COUNT
+        };
+        /// per-instance attribute locations, the matrices take one location per column
+        static constexpr uint INSTANCE_MODEL_LOCATION = 6u;
+        static constexpr uint INSTANCE_NORMAL_LOCATION = 10u;
+        /// vertex buffer binding the instance attributes are read from, so that the culled instances can be
+        /// swapped in without respecifying them
+        static constexpr uint INSTANCE_VERTEX_BINDING = INSTANCE_MODEL_LOCATION;
+        /// shader storage binding of the material table, indexed by the materialIndex uniform
+        static constexpr uint MATERIAL_BINDING = 0u;
+        /// uniform block binding of impl::CameraData
+        static constexpr uint CAMERA_BINDING = 0u;
+        /// shader storage bindings of the GPU culling pass
+        static constexpr uint CULL_MESHLET_BINDING = 1u;
+        static constexpr uint CULL_DRAW_BINDING = 2u;
+        static constexpr uint CULL_INSTANCE_BINDING = 3u;
+        static constexpr uint CULL_COMMAND_BINDING = 4u;
+        static constexpr uint CULL_COUNT_BINDING = 5u;
+        static constexpr uint CULL_VISIBLE_INSTANCE_BINDING = 6u;
+        static constexpr uint CULL_INSTANCE_DRAW_BINDING = 7u;
+        static constexpr uint CULL_WORK_GROUP_SIZE = 64u;
+        static constexpr size_t VERTEX_SIZE = ATTRIBUTE_COUNT * sizeof(float3);
+        /// moved instances at most this far apart are uploaded in one range, which is cheaper than another call
+        static constexpr uint TRANSFORM_UPLOAD_GAP = 8u;
+        /// objects without a mesh of the group, i.e. empty meshes
+        static constexpr uint INVALID_MESH = std::numeric_limits<uint>::max();
+
     private:
         impl::AABB _aabb;
         unique_ptr<Shader> _shader;
-        uint _buffer_num;
+        MaterialInfo _material;     // a copy, groups outlive the scene description they were built from
         uint _texture_num;
-        uint _triangle_count{0u};
+        uint _material_index{0u};
+        uint _triangle_count{0u};   // at full detail
+        uint _index_count{0u};      // of every level of detail
+        uint _vertex_count{0u};
+        uint _vertex_capacity{0u};
+        uint _index_capacity{0u};
 
-        GLuint _vertex_array{0u};
-        GLuint _position_buffer{0u};
-        GLuint _normal_buffer{0u};
+        // baked meshes are drawn with the identity at instance 0, base instances are assigned by finalize()
+        vector<impl::DrawCommand> _draws;
+        vector<vector<float4x4>> _draw_transforms;
+        unordered_map<size_t, size_t> _instanced_draws;    // source mesh -> draw
+        uint _instance_count{0u};
+        // levels of detail of the draws of single meshes that have them, the selected one in _draw_levels
+        vector<vector<impl::MeshLod>> _draw_lods;
+        vector<impl::AABB> _draw_bounds;    // of the stored mesh, i.e. in object space if instanced
+        vector<uint> _draw_levels;
+        // meshlets of every level of detail of every draw: level l of draw d has _draw_meshlets[d][l].y of them,
+        // starting at _meshlets[_draw_meshlets[d][l].x]
+        vector<impl::Meshlet> _meshlets;
+        vector<vector<uint2>> _draw_meshlets;
+        // meshes and instances in append order with their world-space bounds, also as SoA for cull_boxes();
+        // draw d has the meshes _draw_meshes[_draw_mesh_offsets[d]] to _draw_meshes[_draw_mesh_offsets[d + 1] - 1]
+        vector<impl::GroupMesh> _meshes;
+        vector<impl::AABB> _mesh_bounds;
+        impl::AABBArray _mesh_boxes;
+        vector<uint8_t> _mesh_visibility;
+        vector<uint> _draw_mesh_offsets;
+        vector<uint> _draw_meshes;
+        // object -> mesh, objects are numbered by Geometry over the scene meshes of the group and their instances
+        vector<uint> _object_meshes;
+        // the instance buffer as uploaded, and the instances moved since, each listed once
+        vector<impl::InstanceData> _instances;
+        vector<uint> _dirty_instances;
+        vector<uint8_t> _instance_dirty;
+        // draw commands of the meshlets that passed culling, as held by the indirect buffer
+        vector<impl::DrawCommand> _visible_draws;
+        vector<impl::DrawCommand> _culled_draws;    // built by cull() and swapped in when they differ
+        size_t _visible_mesh_count{0u};
+        size_t _visible_meshlet_count{0u};
+        size_t _submitted_triangle_count{0u};
+        // records of the GPU culling pass, which appends up to _command_capacity commands to the indirect buffer
+        // and counts them (and their triangles) in _count_buffer, followed by the visible instances of every
+        // draw; those are packed to the front of the instance range of their draw in _visible_instance_buffer
+        vector<impl::GpuDraw> _gpu_draws;
+        uint _gpu_meshlet_count{0u};
+        uint _command_capacity{0u};
+        // every draw at full detail, unculled, behind the culled commands in the indirect buffer; shadows are cast
+        // from outside the view as well
+        uint _shadow_draw_offset{0u};
+
+        bool _has_diffuse_texture{false};
+        bool _compact_vertices{false};
+        bool _gpu_culling{false};
+        impl::AABB _position_bounds;    // quantization bounds of compact positions
+        bool _ready{false};
+        impl::VertexCacheStatistics _cache_statistics;
+
+        // the streams are back to back in the vertex allocation, the indices in their own; draw commands count
+        // their first index from the start of the index allocation and are rebased when uploaded
+        GeometryArena *_arena;
+        GeometryArena::Allocation _vertex_allocation{GeometryArena::INVALID_ALLOCATION};
+        GeometryArena::Allocation _index_allocation{GeometryArena::INVALID_ALLOCATION};
+        std::array<impl::VertexStream, ATTRIBUTE_COUNT> _streams{};
+        // compact groups keep the float3 streams here until finalize(), when their bounds are known; nothing is
+        // drawn before, so they never go to the GPU unencoded
+        std::array<vector<float3>, ATTRIBUTE_COUNT> _staged_streams;
+        size_t _arena_generation{0u};   // of the arena when the allocations were last bound
 
-        GLuint _diffuse_buffer{0u};
-        GLuint _specular_buffer{0u};
-        GLuint _ambient_buffer{0u};
-        GLuint _tex_coord_buffer{0u};
+        GLuint _vertex_array{0u};
+        GLuint _instance_buffer{0u};
+        GLuint _indirect_buffer{0u};
+        GLuint _gpu_meshlet_buffer{0u};
+        GLuint _gpu_draw_buffer{0u};
+        GLuint _count_buffer{0u};
+        GLuint _visible_instance_buffer{0u};
+        GLuint _instance_draw_buffer{0u};   // draw of every instance
         vector<GLuint64> _texture_handles;
 
     public:
-        GeometryGroup(MaterialInfo* material, const gl_render::vector<impl::MeshInfoGrouped>& meshInfoGroupedVec,
-                      const path &scene_dir, Shader::TemplateList tl = {}) noexcept;
+        /// Vertices and indices are allocated from arena, which has to outlive the group. Textures are taken from
+        /// archive when it has them, from the scene directory otherwise.
+        /// With gpu_culling the draw commands come from dispatch_instance_culling() and dispatch_meshlet_culling()
+        /// instead of cull().
+        GeometryGroup(const MaterialInfo *material, GeometryArena *arena, const path &scene_dir, const Shader::TemplateList &tl = {},
+                      const SceneArchive *archive = nullptr, bool compact_vertices = false,
+                      bool gpu_culling = false) noexcept;
         ~GeometryGroup() noexcept;
 
         GeometryGroup(GeometryGroup &&) = delete;
@@ -95,31 +368,160 @@ namespace gl_render {
         GeometryGroup &operator=(GeometryGroup &&) = delete;
         GeometryGroup &operator=(const GeometryGroup &) = delete;
 
+        /// Upload the streams and indices of one welded world-space mesh behind the existing ones as object,
+        /// growing the buffers on the GPU if needed
+        void append(const impl::PreparedMesh &mesh, uint object) noexcept;
+        /// Add an instance of the object-space mesh of source as object, its streams are only uploaded the first time
+        void append_instance(size_t source, const impl::PreparedMesh &mesh, const float4x4 &transform, uint object) noexcept;
+        /// Release the spare capacity left by append(), upload the instance transforms and draw commands,
+        /// and re-encode the vertices if the group is compact. The group is drawn from then on.
+        void finalize() noexcept;
+
+        /// (Re)build the shader of the material with the template values in tl
+        void compile_shader(Shader::TemplateList tl) noexcept;
+
+        /// The material parameters, stored once in the material table of the geometry
+        [[nodiscard]] impl::MaterialData material_data() const noexcept;
+        void set_material_index(uint index) noexcept { _material_index = index; }
+        /// Take the colors of material, which must keep the name, type and diffuse map the group was built with;
+        /// they reach the shaders once the material table is rebuilt
+        void set_material_colors(const MaterialInfo &material) noexcept;
+        /// Draw every mesh with levels of detail at the coarsest level that meets the screen-space error of view;
+        /// instanced meshes are chosen for their closest instance. Takes effect with the next cull().
+        void select_lods(const impl::LodView &view) noexcept;
+        /// Rebuild the draw commands from the meshlets of the selected levels of detail. Meshes are tested
+        /// against the frustum 8 at a time, then the meshlets of the visible ones against the frustum and
+        /// the camera position; instanced meshlets are drawn for all instances if any visible one passes.
+        /// Uploads the commands only if they changed.
+        void cull(const impl::CullView &view) noexcept;
+        /// Reset the counts and run shader, the instance culling compute shader with its view uniforms set, over
+        /// the instances: the visible ones are copied to the front of the instance range of their draw.
+        void dispatch_instance_culling(const Shader &shader) const noexcept;
+        /// Run shader, the meshlet culling compute shader with its view uniforms set, over the meshlet records once
+        /// the instance pass is visible to it. Each visible meshlet gets one command drawing the visible instances
+        /// of its draw, read by render() once a command barrier is issued.
+        void dispatch_meshlet_culling(const Shader &shader) const noexcept;
+        /// Commands and triangles written by the last culling pass, waits for it to finish
+        [[nodiscard]] uint2 read_culling_counts() const noexcept;
+
+        /// Bind the vertex array to the allocations again and rebase the draw commands if the arena moved them
+        void sync_arena() noexcept;
+
+        /// Move object to the world transform transform, once the group is finalized; its bounds and the culling
+        /// follow right away, the vertex shaders with the next upload_transforms(). Returns false if the object is
+        /// baked and cannot move or not in the group.
+        bool set_transform(uint object, const float4x4 &transform) noexcept;
+        /// Upload the instances moved since the last call and bring the group bounds up to date
+        impl::TransformUpload upload_transforms() noexcept;
+
         virtual void render() const;
-        virtual void shadow() const;
+        /// Draw the depth of every mesh at full detail with shader, the point shadow shader in use, straight from
+        /// the streams of the group
+        virtual void shadow(const Shader &shader) const;
         void set_lights(LightManager *lightManager) const;
-        void set_camera(
-                const float4x4& projection,
-                const float4x4& view,
-                const float3& cameraPos) const;
 
         [[nodiscard]] Shader* shader() const noexcept { return _shader.get(); }
+        [[nodiscard]] const auto &material_name() const noexcept { return _material.name; }
         [[nodiscard]] auto aabb() const noexcept { return _aabb; }
-        [[nodiscard]] auto position_buffer() const noexcept { return _position_buffer; }
+        [[nodiscard]] const auto &mesh_bounds() const noexcept { return _mesh_bounds; }
+        /// GL buffer objects of the group itself, the vertices and indices are in the arena
+        [[nodiscard]] size_t buffer_count() const noexcept;
         [[nodiscard]] auto triangle_count() const noexcept { return _triangle_count; }
+        [[nodiscard]] auto vertex_count() const noexcept { return _vertex_count; }
+        /// triangles drawn, i.e. stored triangles times their instance count
+        [[nodiscard]] size_t drawn_triangle_count() const noexcept;
+        /// triangles drawn at the selected levels of detail, after culling
+        [[nodiscard]] auto submitted_triangle_count() const noexcept { return _submitted_triangle_count; }
+        [[nodiscard]] auto mesh_count() const noexcept { return _meshes.size(); }
+        [[nodiscard]] auto visible_mesh_count() const noexcept { return _visible_mesh_count; }
+        [[nodiscard]] auto meshlet_count() const noexcept { return _meshlets.size(); }
+        [[nodiscard]] auto visible_meshlet_count() const noexcept { return _visible_meshlet_count; }
+        [[nodiscard]] auto index_count() const noexcept { return _index_count; }
+        [[nodiscard]] auto instance_count() const noexcept { return _instance_count; }
+        /// vertex cache behaviour of the stored meshes, each simulated on its own
+        [[nodiscard]] const auto &cache_statistics() const noexcept { return _cache_statistics; }
+        [[nodiscard]] auto ready() const noexcept { return _ready; }
+
+    private:
+        void _reallocate(uint vertex_capacity) noexcept;
+        void _reallocate_indices(uint index_capacity) noexcept;
+        /// Point the vertex attributes and the element buffer at the current place of the allocations
+        void _bind_arena() noexcept;
+        /// Upload commands, rebased onto the index allocation, to the indirect buffer from command first on
+        void _upload_commands(span<const impl::DrawCommand> commands, uint first) noexcept;
+        /// first index of the index allocation in the arena
+        [[nodiscard]] auto _index_base() const noexcept {
+            return _index_allocation == GeometryArena::INVALID_ALLOCATION ?
+                   0u : static_cast<uint>(_arena->offset(_index_allocation) / sizeof(uint));
+        }
+        /// returns the first index of the uploaded mesh
+        uint _upload(const impl::PreparedMesh &mesh) noexcept;
+        /// Start a new draw of the mesh uploaded at first_index, keeping its levels of detail; returns the draw
+        uint _add_draw(const impl::PreparedMesh &mesh, uint first_index, uint instance_count) noexcept;
+        /// Make room for object in the object table, it has no mesh until _add_mesh()
+        void _add_object(uint object) noexcept;
+        /// Add mesh with its world-space bounds as object
+        void _add_mesh(uint object, impl::GroupMesh mesh, const impl::AABB &bounds) noexcept;
+        /// Add the meshlets of every level of detail of the mesh uploaded at first_index, returns their ranges
+        [[nodiscard]] vector<uint2> _append_meshlets(const impl::PreparedMesh &mesh, uint first_index) noexcept;
+        /// Encode the staged float3 streams in the compact format and upload them, once every mesh is appended
+        void _compact() noexcept;
+        /// Upload the meshlet and draw records of the GPU culling pass, size the command buffer for them
+        void _create_culling_buffers() noexcept;
     };
 
     class Geometry {
 
+    public:
+        struct MeshHit {
+            size_t group;
+            float distance;
+        };
+
+        /// What the last cull() kept of the ready groups
+        struct CullStatistics {
+            size_t mesh_count{0u};
+            size_t visible_mesh_count{0u};
+            size_t meshlet_count{0u};
+            size_t visible_meshlet_count{0u};
+            /// triangles drawn per frame at the selected levels of detail
+            size_t submitted_triangle_count{0u};
+            double time{0.0};     // ms
+        };
+
     private:
         impl::AABB _aabb;
+        unique_ptr<GeometryArena> _arena;   // declared before the groups, which release their allocations into it
         vector<unique_ptr<GeometryGroup>> _groups;
-        vector<float3> _vertex_positions_flattened;
+        unordered_map<string, size_t> _group_indices;   // material name -> group
+        GLuint _material_buffer{0u};
+        GLuint _camera_buffer{0u};
+        // with GPU culling only
+        unique_ptr<Shader> _instance_cull_shader;
+        unique_ptr<Shader> _cull_shader;
+
+        path _scene_dir;
+        GeometryConfig _config;
+        const SceneArchive *_archive;
+        unique_ptr<MeshCache> _mesh_cache;
+        unique_ptr<impl::GeometryLoad> _load;
+        size_t _revision{0u};
+
+        // over the bounds of every mesh and instance of the ready groups, brought up to date lazily by bvh()
+        BVH _bvh;
+        vector<size_t> _bvh_groups;     // primitive -> group
+        size_t _bvh_revision{std::numeric_limits<size_t>::max()};
+        CullStatistics _cull_statistics;
+        // scene mesh -> its group, its first object there and its instance count, the objects of its instances follow
+        vector<uint3> _objects;
 
     public:
-        explicit Geometry(const SceneAllNode::SceneAllInfo &sceneAllInfo, const path &scene_dir);
+        /// Meshes are mapped from archive if given, imported from their files (or the mesh cache) otherwise.
+        /// With progressive loading the groups are filled by load(), sceneAllInfo has to outlive the loading.
+        explicit Geometry(const SceneAllInfo &sceneAllInfo, const path &scene_dir,
+                          const GeometryConfig &config = {}, const SceneArchive *archive = nullptr);
 
-        ~Geometry() = default;
+        ~Geometry() noexcept;
         Geometry(Geometry &&) = delete;
         Geometry(const Geometry &) = delete;
         Geometry &operator=(Geometry &&) = delete;
@@ -133,12 +535,73 @@ namespace gl_render {
                 const float4x4& projection,
                 const float4x4& view,
                 const float3& cameraPos) const;
-        void shadow(
-                LightManager *lightManager,
-                const float4x4& projection,
-                const float4x4& view,
-                const float3& cameraPos) const;
-        [[nodiscard]] auto vertex_positions_flattened() noexcept;
+        /// Draw the depth of the ready groups with the point shadow shader, which has to be in use
+        void shadow(const Shader &shader) const;
+
+        /// Bring the geometry to sceneAllInfo, only the changed groups of diff are rebuilt and the recolored ones
+        /// only update the material table. The other groups keep their buffers, their shaders are recompiled if
+        /// the light count changed.
+        void update(const SceneAllInfo &sceneAllInfo, const SceneDiff &diff) noexcept;
+        [[nodiscard]] auto group_count() const noexcept { return _groups.size(); }
+        [[nodiscard]] size_t ready_group_count() const noexcept;
+        /// GL buffer objects holding the geometry: the arena and those of the groups
+        [[nodiscard]] size_t buffer_count() const noexcept;
+        [[nodiscard]] auto arena_statistics() const noexcept { return _arena->statistics(); }
+
+        /// Move instance of the scene mesh mesh to the world transform transform, once the geometry is loaded.
+        /// Takes effect with the next upload_transforms(); returns false if the mesh is baked and cannot move.
+        bool set_transform(size_t mesh, size_t instance, const float4x4 &transform) noexcept;
+        /// Upload the transforms set since the last call, only the moved instances of each group; the bounds
+        /// and the revision are updated if anything moved
+        impl::TransformUpload upload_transforms() noexcept;
+
+        /// Upload the meshes loaded so far by the workers, for about the upload time budget.
+        /// Groups are drawn once their last mesh is uploaded. Returns true once every group is complete.
+        bool load() noexcept;
+        [[nodiscard]] auto loading() const noexcept { return _load != nullptr; }
+        /// changes whenever groups are added, completed or rebuilt or objects moved, i.e. when the bounds have
+        /// to be fetched again
+        [[nodiscard]] auto revision() const noexcept { return _revision; }
+
+        /// Select the levels of detail of the ready groups for a camera at camera_position with a vertical
+        /// field of view of fov degrees, rendering viewport_height pixels high
+        void select_lods(const float3 &camera_position, float fov, float viewport_height) noexcept;
+        /// Cull the meshes and meshlets of the ready groups for the camera of view_projection at camera_position,
+        /// as far as enabled in the config, and apply the selected levels of detail
+        /// With GPU culling this only dispatches the culling pass of every group, taking the same CPU time for
+        /// any number of meshes, and the visible counts of the statistics are left to cull_statistics().
+        const CullStatistics &cull(const float4x4 &view_projection, float3 camera_position) noexcept;
+        /// What the last cull() kept; with GPU culling the counts are read back first, which waits for
+        /// the culling pass, so this is best asked for only when they are shown
+        [[nodiscard]] const CullStatistics &cull_statistics() noexcept;
+        /// The hierarchy over the world-space bounds of every mesh and instance, refitted or rebuilt if the
+        /// geometry changed since the last call. Its primitives map to groups through group_of_mesh().
+        [[nodiscard]] const BVH &bvh() noexcept;
+        [[nodiscard]] auto group_of_mesh(uint primitive) const noexcept { return _bvh_groups[primitive]; }
+        /// Nearest and furthest distance along the unit vector front of the meshes in the view frustum of
+        /// view_projection, seen from position; nullopt if the frustum is empty
+        [[nodiscard]] optional<float2> depth_range(const float4x4 &view_projection, float3 position, float3 front) noexcept;
+        /// Nearest mesh whose bounds the ray hits
+        [[nodiscard]] optional<MeshHit> pick(const BVH::Ray &ray) noexcept;
+
+    private:
+        /// Start loading the meshes of the groups named in materials, or of all groups if it is null, into new groups
+        void _begin_load(const SceneAllInfo &sceneAllInfo, const unordered_set<string> *materials) noexcept;
+        /// Upload loaded meshes in scene order, waiting for the workers if wait is set, until time_budget ms
+        /// are spent; returns true when the load is complete
+        bool _load_step(double time_budget, bool wait) noexcept;
+        void _load_mesh(size_t index) noexcept;
+        [[nodiscard]] GeometryGroup *_group_of(size_t index) noexcept;
+        void _end_load() noexcept;
+        /// Map the meshes of scene to their groups and objects
+        void _index_objects(const SceneAllInfo &scene) noexcept;
+        void _update_aabb() noexcept;
+        /// Rebuild the material table from the groups, a group's entry is at its index
+        void _update_materials() noexcept;
+        /// Let the groups follow the allocations the arena moved while it grew or was defragmented
+        void _sync_arena() noexcept;
+        /// Upload the camera block, shared by the shaders of all groups
+        void _set_camera(const float4x4 &projection, const float4x4 &view, const float3 &camera_position) const noexcept;
 
     };
 
@@ -0,0 +1,225 @@
+//
+// Created by ChenXin on 2022/11/16.
+//
+
+#include <base/geometry_arena.h>
+
+#include <chrono>
+#include <cstring>
+
+#include <core/logger.h>
+#include <core/profiler.h>
+
+namespace gl_render {
+
+    namespace impl {
+
+        [[nodiscard]] static constexpr size_t round_up(size_t size, size_t alignment) noexcept {
+            return (size + alignment - 1u) / alignment * alignment;
+        }
+
+    }
+
+    GeometryArena::GeometryArena(size_t capacity) noexcept {
+        constexpr auto staging_flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        constexpr auto staging_size = STAGING_SEGMENT_SIZE * STAGING_SEGMENT_COUNT;
+        glGenBuffers(1, &_staging_buffer);
+        glBindBuffer(GL_COPY_READ_BUFFER, _staging_buffer);
+        glBufferStorage(GL_COPY_READ_BUFFER, staging_size, nullptr, staging_flags);
+        _staging = static_cast<std::byte *>(glMapBufferRange(GL_COPY_READ_BUFFER, 0, staging_size, staging_flags));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        if (_staging == nullptr) {
+            GL_RENDER_ERROR_WITH_LOCATION("Failed to map the geometry staging buffer");
+        }
+        _reallocate(impl::round_up(max(capacity, ALIGNMENT), ALIGNMENT), false);
+    }
+
+    GeometryArena::~GeometryArena() noexcept {
+        for (auto fence: _fences) {
+            if (fence != nullptr) {
+                glDeleteSync(fence);
+            }
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, _staging_buffer);
+        glUnmapBuffer(GL_COPY_READ_BUFFER);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glDeleteBuffers(1, &_staging_buffer);
+        glDeleteBuffers(1, &_buffer);
+    }
+
+    GeometryArena::Allocation GeometryArena::allocate(size_t size) noexcept {
+        size = impl::round_up(max(size, size_t{1}), ALIGNMENT);
+        auto range = std::find_if(_free_ranges.begin(), _free_ranges.end(), [size](const auto &free_range) {
+            return free_range.second >= size;
+        });
+        if (range == _free_ranges.end()) {
+            // the new space is merged into a free range at the end, which then fits
+            _reallocate(max(_capacity * 2u, _capacity + size), false);
+            ++_statistics.grow_count;
+            range = std::prev(_free_ranges.end());
+        }
+        auto [offset, free_size] = *range;
+        _free_ranges.erase(range);
+        if (free_size > size) {
+            _free_ranges.emplace(offset + size, free_size - size);
+        }
+        if (_released.empty()) {
+            _allocations.emplace_back(Range{offset, size});
+            return static_cast<Allocation>(_allocations.size() - 1u);
+        }
+        auto allocation = _released.back();
+        _released.pop_back();
+        _allocations[allocation] = Range{offset, size};
+        return allocation;
+    }
+
+    void GeometryArena::release(Allocation allocation) noexcept {
+        if (allocation == INVALID_ALLOCATION) {
+            return;
+        }
+        auto &range = _allocations[allocation];
+        _insert_free_range(range.offset, range.size);
+        range = Range{0u, 0u};
+        _released.emplace_back(allocation);
+    }
+
+    void GeometryArena::_insert_free_range(size_t offset, size_t size) noexcept {
+        auto next = _free_ranges.lower_bound(offset);
+        if (next != _free_ranges.end() && offset + size == next->first) {
+            size += next->second;
+            next = _free_ranges.erase(next);
+        }
+        if (next != _free_ranges.begin()) {
+            if (auto previous = std::prev(next); previous->first + previous->second == offset) {
+                previous->second += size;
+                return;
+            }
+        }
+        _free_ranges.emplace_hint(next, offset, size);
+    }
+
+    void GeometryArena::upload(Allocation allocation, size_t offset, span<const std::byte> data) noexcept {
+        GL_RENDER_ASSERT(offset + data.size() <= _allocations[allocation].size, "Upload out of the allocation");
+        auto begin = std::chrono::steady_clock::now();
+        _statistics.uploaded += data.size();
+        auto target = _allocations[allocation].offset + offset;
+        glBindBuffer(GL_COPY_READ_BUFFER, _staging_buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, _buffer);
+        while (!data.empty()) {
+            if (_cursor == STAGING_SEGMENT_SIZE) {
+                _next_segment();
+            }
+            auto chunk = min(data.size(), STAGING_SEGMENT_SIZE - _cursor);
+            auto source = _segment * STAGING_SEGMENT_SIZE + _cursor;
+            // the mapping is coherent, the copy sees the data without a flush
+            std::memcpy(_staging + source, data.data(), chunk);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, source, target, chunk);
+            _cursor = min(impl::round_up(_cursor + chunk, 16u), STAGING_SEGMENT_SIZE);
+            target += chunk;
+            data = data.subspan(chunk);
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        _statistics.upload_time += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+    void GeometryArena::_next_segment() noexcept {
+        _fences[_segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        _segment = (_segment + 1u) % STAGING_SEGMENT_COUNT;
+        _cursor = 0u;
+        auto fence = std::exchange(_fences[_segment], nullptr);
+        if (fence == nullptr) {
+            return;
+        }
+        if (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0u) == GL_TIMEOUT_EXPIRED) {
+            // the copies out of this segment are still pending, the ring is outrunning the GPU
+            GL_RENDER_PROFILE_SCOPE("wait for staging", "upload");
+            ++_statistics.staging_waits;
+            while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000u) == GL_TIMEOUT_EXPIRED) {}
+        }
+        glDeleteSync(fence);
+    }
+
+    void GeometryArena::copy(Allocation source, size_t source_offset,
+                             Allocation target, size_t target_offset, size_t size) noexcept {
+        glBindBuffer(GL_COPY_READ_BUFFER, _buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, _buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                            _allocations[source].offset + source_offset,
+                            _allocations[target].offset + target_offset, size);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    bool GeometryArena::defragment(bool force) noexcept {
+        auto end = size_t{0};
+        auto used = size_t{0};
+        for (const auto &range: _allocations) {
+            end = max(end, range.offset + range.size);
+            used += range.size;
+        }
+        if (end == used || (!force && static_cast<double>(end - used) < static_cast<double>(end) * DEFRAGMENT_THRESHOLD)) {
+            return false;
+        }
+        GL_RENDER_PROFILE_SCOPE("defragment geometry arena", "upload");
+        _reallocate(_capacity, true);
+        ++_statistics.defragment_count;
+        return true;
+    }
+
+    void GeometryArena::_reallocate(size_t capacity, bool pack) noexcept {
+        GLuint buffer;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        // only ever written by copies, so it needs no storage flags
+        glBufferStorage(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(capacity), nullptr, 0);
+        if (_buffer == 0u) {
+            _free_ranges.emplace(0u, capacity);
+        } else if (pack) {
+            // allocations keep their order, packed from the front
+            vector<Allocation> order;
+            for (auto allocation = 0u; allocation < _allocations.size(); ++allocation) {
+                if (_allocations[allocation].size != 0u) {
+                    order.emplace_back(allocation);
+                }
+            }
+            std::sort(order.begin(), order.end(), [this](auto lhs, auto rhs) {
+                return _allocations[lhs].offset < _allocations[rhs].offset;
+            });
+            glBindBuffer(GL_COPY_READ_BUFFER, _buffer);
+            auto end = 0ul;
+            for (auto allocation: order) {
+                auto &range = _allocations[allocation];
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, range.offset, end, range.size);
+                range.offset = end;
+                end += range.size;
+            }
+            _free_ranges.clear();
+            if (end < capacity) {
+                _free_ranges.emplace(end, capacity - end);
+            }
+        } else {
+            glBindBuffer(GL_COPY_READ_BUFFER, _buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, static_cast<GLsizeiptr>(_capacity));
+            _insert_free_range(_capacity, capacity - _capacity);
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glDeleteBuffers(1, &_buffer);
+        _buffer = buffer;
+        _capacity = capacity;
+        ++_generation;
+    }
+
+    GeometryArena::Statistics GeometryArena::statistics() const noexcept {
+        auto statistics = _statistics;
+        statistics.capacity = _capacity;
+        statistics.free_range_count = _free_ranges.size();
+        for (const auto &range: _allocations) {
+            statistics.used += range.size;
+            statistics.allocation_count += range.size != 0u ? 1u : 0u;
+        }
+        return statistics;
+    }
+
+}
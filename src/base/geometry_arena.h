@@ -0,0 +1,113 @@
+//
+// Created by ChenXin on 2022/11/16.
+//
+
+#pragma once
+
+#include <array>
+
+#include <glad/glad.h>
+
+#include <core/stl.h>
+
+namespace gl_render {
+
+    /// One immutable GPU buffer holding the vertex streams and indices of every group. Groups sub-allocate ranges
+    /// from it with a first-fit free list; the data reaches it through a persistently mapped staging ring whose
+    /// segments are fenced before they are written again. Allocations are handles: the arena moves them when it
+    /// grows or is defragmented, which changes generation(), and their users look their offsets up again.
+    class GeometryArena {
+
+    public:
+        using Allocation = uint;
+        static constexpr Allocation INVALID_ALLOCATION = ~0u;
+        /// of every allocation, enough for any vertex attribute and index offset
+        static constexpr size_t ALIGNMENT = 256u;
+        static constexpr size_t INITIAL_CAPACITY = 64u * 1024u * 1024u;
+        static constexpr size_t STAGING_SEGMENT_SIZE = 16u * 1024u * 1024u;
+        static constexpr size_t STAGING_SEGMENT_COUNT = 4u;
+        /// defragment() only moves allocations if at least this share of the used range is free
+        static constexpr double DEFRAGMENT_THRESHOLD = 0.25;
+
+        struct Statistics {
+            size_t capacity{0u};
+            size_t used{0u};
+            size_t allocation_count{0u};
+            size_t free_range_count{0u};
+            size_t uploaded{0u};
+            double upload_time{0.0};    // ms
+            size_t staging_waits{0u};
+            size_t grow_count{0u};
+            size_t defragment_count{0u};
+
+            [[nodiscard]] auto upload_throughput() const noexcept {
+                return upload_time == 0.0 ? 0.0 : static_cast<double>(uploaded) / (1024.0 * 1024.0) / (upload_time * 1e-3);
+            }
+        };
+
+    private:
+        struct Range {
+            size_t offset;
+            size_t size;    // 0 for released handles
+        };
+
+        GLuint _buffer{0u};
+        size_t _capacity{0u};
+        map<size_t, size_t> _free_ranges;   // offset -> size, adjacent ranges are merged
+        vector<Range> _allocations;
+        vector<Allocation> _released;
+        size_t _generation{0u};
+
+        GLuint _staging_buffer{0u};
+        std::byte *_staging{nullptr};
+        std::array<GLsync, STAGING_SEGMENT_COUNT> _fences{};
+        size_t _segment{0u};
+        size_t _cursor{0u};     // in the current segment
+
+        Statistics _statistics;
+
+    public:
+        explicit GeometryArena(size_t capacity = INITIAL_CAPACITY) noexcept;
+        ~GeometryArena() noexcept;
+
+        GeometryArena(GeometryArena &&) = delete;
+        GeometryArena(const GeometryArena &) = delete;
+        GeometryArena &operator=(GeometryArena &&) = delete;
+        GeometryArena &operator=(const GeometryArena &) = delete;
+
+        /// Reserve size bytes, growing the buffer if no free range is large enough
+        [[nodiscard]] Allocation allocate(size_t size) noexcept;
+        /// Return the range of allocation, INVALID_ALLOCATION is ignored
+        void release(Allocation allocation) noexcept;
+
+        /// Copy data to offset in allocation through the staging ring, waiting for a segment if the GPU still reads it
+        void upload(Allocation allocation, size_t offset, span<const std::byte> data) noexcept;
+        template<typename T>
+        void upload(Allocation allocation, size_t offset, span<const T> data) noexcept {
+            upload(allocation, offset, std::as_bytes(data));
+        }
+        /// Copy size bytes between allocations on the GPU, the ranges must not overlap
+        void copy(Allocation source, size_t source_offset, Allocation target, size_t target_offset, size_t size) noexcept;
+
+        /// Pack the allocations to the front of a new buffer if enough of the used range is free, or if force is set.
+        /// Returns true if they were moved.
+        bool defragment(bool force = false) noexcept;
+
+        [[nodiscard]] auto buffer() const noexcept { return _buffer; }
+        [[nodiscard]] auto offset(Allocation allocation) const noexcept { return _allocations[allocation].offset; }
+        [[nodiscard]] auto size(Allocation allocation) const noexcept { return _allocations[allocation].size; }
+        /// changes whenever allocations move, i.e. when the buffer and offsets have to be bound again
+        [[nodiscard]] auto generation() const noexcept { return _generation; }
+        [[nodiscard]] Statistics statistics() const noexcept;
+        /// GL buffer objects of the arena: the storage and the staging ring
+        [[nodiscard]] static constexpr size_t buffer_count() noexcept { return 2u; }
+
+    private:
+        /// Move the allocations into a new buffer of capacity bytes, packed if pack is set and in place otherwise
+        void _reallocate(size_t capacity, bool pack) noexcept;
+        /// Fence the current staging segment and continue in the next one once the GPU is done with it
+        void _next_segment() noexcept;
+        void _insert_free_range(size_t offset, size_t size) noexcept;
+    };
+
+}
@@ -11,19 +11,25 @@ namespace gl_render {
     class LightManager {
     private:
         gl_render::vector<gl_render::unique_ptr<Light>> _lights;
-        gl_render::vector<float3> *_vertex_positions;
 
     public:
         bool enable_shadow = true;
 
     public:
-        explicit LightManager(gl_render::vector<float3> *vertex_positions) noexcept {
-            _vertex_positions = vertex_positions;
-        }
+        LightManager() noexcept = default;
         ~LightManager() noexcept = default;
 
-        void addLight(LightInfo *lightInfo, uint2 shadowResolution) noexcept {
-            _lights.emplace_back(gl_render::make_unique<Light>(lightInfo, shadowResolution, _vertex_positions));
+        void addLight(const LightInfo &lightInfo, uint2 shadowResolution) noexcept {
+            _lights.emplace_back(gl_render::make_unique<Light>(lightInfo, shadowResolution));
+        }
+
+        void updateLight(size_t index, const LightInfo &lightInfo) noexcept {
+            _lights[index]->setLightInfo(lightInfo);
+        }
+
+        /// Remove the last light along with its shadow map
+        void removeLight() noexcept {
+            _lights.pop_back();
         }
 
         void renderShadow(float far_plane) noexcept {
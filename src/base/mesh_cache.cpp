@@ -0,0 +1,149 @@
+//
+// Created by ChenXin on 2022/11/4.
+//
+
+#include <base/mesh_cache.h>
+
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+#include <xxhash.h>
+
+#include <core/logger.h>
+
+namespace gl_render {
+
+    namespace impl {
+
+        struct MeshCacheHeader {
+            uint32_t magic;
+            uint32_t version;
+            uint64_t key;
+            uint64_t vertex_count;
+            uint64_t index_count;
+            float aabb_min[3];
+            float aabb_max[3];
+            uint64_t lod_count;
+        };
+        static_assert(sizeof(MeshCacheHeader) <= MeshCache::HEADER_SIZE);
+
+        bool MeshData::in_bounds() const noexcept {
+            auto vertex_count = this->vertex_count();
+            for (auto index: indices) {
+                if (index >= vertex_count) {
+                    return false;
+                }
+            }
+            for (const auto &lod: lods) {
+                if (static_cast<size_t>(lod.first_index) + lod.index_count > indices.size()) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+    }
+
+    MeshCache::MeshCache(path dir) noexcept: _dir{std::move(dir)} {
+        std::error_code ec;
+        std::filesystem::create_directories(_dir, ec);
+        if (ec) {
+            GL_RENDER_WARNING("Failed to create mesh cache directory \"{}\": {}", _dir.string(), ec.message());
+        }
+    }
+
+    uint64_t MeshCache::key(span<const std::byte> source, const float4x4 &transform,
+                            uint post_process_flags) noexcept {
+        auto state = XXH3_createState();
+        XXH3_64bits_reset(state);
+        XXH3_64bits_update(state, source.data(), source.size());
+        XXH3_64bits_update(state, &transform[0][0], sizeof(float4x4));
+        XXH3_64bits_update(state, &post_process_flags, sizeof(post_process_flags));
+        XXH3_64bits_update(state, &VERSION, sizeof(VERSION));
+        auto hash = XXH3_64bits_digest(state);
+        XXH3_freeState(state);
+        return hash;
+    }
+
+    path MeshCache::_entry_path(uint64_t key) const noexcept {
+        return _dir / format("{:016x}.mesh", key);
+    }
+
+    bool MeshCache::load(uint64_t key, impl::MeshData &data) const noexcept {
+        auto entry_path = _entry_path(key);
+        std::error_code ec;
+        if (!std::filesystem::exists(entry_path, ec)) {
+            return false;
+        }
+        auto file = make_unique<MappedFile>(entry_path);
+        if (!file->valid() || file->size() < HEADER_SIZE) {
+            return false;
+        }
+        impl::MeshCacheHeader header{};
+        std::memcpy(&header, file->data(), sizeof(header));
+        auto stream_size = header.vertex_count * sizeof(float3);
+        if (header.magic != MAGIC || header.version != VERSION || header.key != key ||
+            file->size() != HEADER_SIZE + stream_size * 3u + header.index_count * sizeof(uint) +
+                            header.lod_count * sizeof(impl::MeshLod)) {
+            GL_RENDER_WARNING("Ignoring stale mesh cache entry \"{}\"", entry_path.string());
+            return false;
+        }
+        auto streams = reinterpret_cast<const float3 *>(file->data() + HEADER_SIZE);
+        auto vertex_count = static_cast<size_t>(header.vertex_count);
+        data.positions = {streams, vertex_count};
+        data.normals = {streams + vertex_count, vertex_count};
+        data.tex_coords = {streams + vertex_count * 2u, vertex_count};
+        data.indices = {reinterpret_cast<const uint *>(streams + vertex_count * 3u), static_cast<size_t>(header.index_count)};
+        data.lods = {reinterpret_cast<const impl::MeshLod *>(data.indices.data() + data.indices.size()),
+                     static_cast<size_t>(header.lod_count)};
+        data.aabb.min = float3{header.aabb_min[0], header.aabb_min[1], header.aabb_min[2]};
+        data.aabb.max = float3{header.aabb_max[0], header.aabb_max[1], header.aabb_max[2]};
+        if (!data.in_bounds()) {
+            GL_RENDER_WARNING("Ignoring corrupted mesh cache entry \"{}\"", entry_path.string());
+            data = impl::MeshData{};
+            return false;
+        }
+        data.mapped_file = std::move(file);
+        return true;
+    }
+
+    void MeshCache::store(uint64_t key, const impl::MeshData &data) const noexcept {
+        impl::MeshCacheHeader header{
+                MAGIC, VERSION, key, data.vertex_count(), data.indices.size(),
+                {data.aabb.min.x, data.aabb.min.y, data.aabb.min.z},
+                {data.aabb.max.x, data.aabb.max.y, data.aabb.max.z},
+                data.lods.size()};
+        std::array<std::byte, HEADER_SIZE> header_bytes{};
+        std::memcpy(header_bytes.data(), &header, sizeof(header));
+
+        // write to a private file first, concurrent writers of the same key then race on an atomic rename only
+        auto entry_path = _entry_path(key);
+        auto temp_path = entry_path;
+        temp_path += format(".{}.tmp", std::hash<std::thread::id>{}(std::this_thread::get_id()));
+        {
+            std::ofstream file{temp_path, std::ios::binary};
+            if (!file.is_open()) {
+                GL_RENDER_WARNING("Failed to write mesh cache entry \"{}\"", temp_path.string());
+                return;
+            }
+            auto write = [&file](auto stream) {
+                file.write(reinterpret_cast<const char *>(stream.data()),
+                           static_cast<std::streamsize>(stream.size_bytes()));
+            };
+            file.write(reinterpret_cast<const char *>(header_bytes.data()), HEADER_SIZE);
+            write(data.positions);
+            write(data.normals);
+            write(data.tex_coords);
+            write(data.indices);
+            write(data.lods);
+        }
+        std::error_code ec;
+        std::filesystem::rename(temp_path, entry_path, ec);
+        if (ec) {
+            std::filesystem::remove(temp_path, ec);
+        }
+    }
+
+}
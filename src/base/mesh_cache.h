@@ -0,0 +1,94 @@
+//
+// Created by ChenXin on 2022/11/4.
+//
+
+#pragma once
+
+#include <core/stl.h>
+#include <base/aabb.h>
+#include <util/mapped_file.h>
+
+namespace gl_render {
+
+    namespace impl {
+
+        /// One level of detail: a range of the mesh indices over the shared vertices, and the geometric error
+        /// of the level against the full mesh, in the units of the positions
+        struct MeshLod {
+            uint first_index;
+            uint index_count;
+            float error;
+        };
+
+        /// World-space vertex streams of one scene mesh, either processed from the source file (storage)
+        /// or mapped from the mesh cache (mapped_file). Meshes are flattened (three vertices per triangle,
+        /// no indices) as imported and indexed once welded (see weld_mesh). Indices may hold several levels
+        /// of detail one after the other, listed in lods (see generate_lods).
+        struct MeshData {
+            AABB aabb;
+            span<const float3> positions;
+            span<const float3> normals;
+            span<const float3> tex_coords;
+            span<const uint> indices;
+            span<const MeshLod> lods;
+
+            gl_render::vector<float3> storage;
+            gl_render::vector<uint> index_storage;
+            gl_render::vector<MeshLod> lod_storage;
+            gl_render::unique_ptr<MappedFile> mapped_file;
+
+            /// allocate storage for vertex_count vertices and point the streams into it
+            void allocate(size_t vertex_count) noexcept {
+                storage.resize(vertex_count * 3u);
+                positions = {storage.data(), vertex_count};
+                normals = {storage.data() + vertex_count, vertex_count};
+                tex_coords = {storage.data() + vertex_count * 2u, vertex_count};
+            }
+
+            [[nodiscard]] auto vertex_count() const noexcept { return positions.size(); }
+            [[nodiscard]] auto indexed() const noexcept { return !indices.empty(); }
+            /// vertices drawn at full detail, three per triangle
+            [[nodiscard]] auto index_count() const noexcept {
+                return !indexed() ? positions.size() : lods.empty() ? indices.size() : lods.front().index_count;
+            }
+            [[nodiscard]] auto lod_count() const noexcept { return max(lods.size(), size_t{1}); }
+            [[nodiscard]] MeshLod lod(size_t level) const noexcept {
+                return lods.empty() ? MeshLod{0u, static_cast<uint>(index_count()), 0.f} : lods[level];
+            }
+            /// every index refers to a vertex and every level of detail lies within the indices; mapped meshes
+            /// are checked before use, their indices are read straight by meshlet building and the draws
+            [[nodiscard]] bool in_bounds() const noexcept;
+        };
+
+    }
+
+    /// Content-addressed cache of processed mesh streams, one file per key
+    class MeshCache {
+
+    public:
+        static constexpr uint32_t MAGIC = 0x434d4c47u;    // "GLMC"
+        static constexpr uint32_t VERSION = 3u;
+        /// vertex streams, then indices and levels of detail, start at this offset so that they are suitably aligned inside the mapping
+        static constexpr size_t HEADER_SIZE = 64u;
+
+    private:
+        path _dir;
+
+    public:
+        explicit MeshCache(path dir) noexcept;
+
+        [[nodiscard]] auto dir() const noexcept { return _dir; }
+
+        /// Key of a mesh: source file bytes, mesh transform and the post-process flags used to import it
+        [[nodiscard]] static uint64_t key(span<const std::byte> source, const float4x4 &transform,
+                                          uint post_process_flags) noexcept;
+
+        /// Map the entry of key into data, returns false on a miss or a stale/corrupted entry
+        [[nodiscard]] bool load(uint64_t key, impl::MeshData &data) const noexcept;
+        void store(uint64_t key, const impl::MeshData &data) const noexcept;
+
+    private:
+        [[nodiscard]] path _entry_path(uint64_t key) const noexcept;
+    };
+
+}
@@ -0,0 +1,639 @@
+//
+// Created by ChenXin on 2022/11/12.
+//
+
+#include <base/mesh_processing.h>
+
+#include <cstring>
+#include <numeric>
+
+#include <xxhash.h>
+
+#include <core/logger.h>
+#include <core/profiler.h>
+
+namespace gl_render {
+
+    namespace impl {
+
+        struct WeldVertex {
+            float3 position;
+            float3 normal;
+            float3 tex_coord;
+
+            [[nodiscard]] bool operator==(const WeldVertex &rhs) const noexcept {
+                return std::memcmp(this, &rhs, sizeof(WeldVertex)) == 0;
+            }
+        };
+        static_assert(sizeof(WeldVertex) == sizeof(float3) * 3u);
+
+        struct WeldVertexHash {
+            [[nodiscard]] size_t operator()(const WeldVertex &vertex) const noexcept {
+                return static_cast<size_t>(XXH3_64bits(&vertex, sizeof(WeldVertex)));
+            }
+        };
+
+        void weld_mesh(MeshData &data) noexcept {
+            if (data.indexed() || data.vertex_count() == 0u) {
+                return;
+            }
+            GL_RENDER_PROFILE_SCOPE("weld mesh", "geometry");
+            auto vertex_count = data.vertex_count();
+            gl_render::unordered_map<WeldVertex, uint, WeldVertexHash> unique;
+            unique.reserve(vertex_count);
+            gl_render::vector<WeldVertex> vertices;
+            gl_render::vector<uint> indices(vertex_count);
+            for (auto i = 0ul; i < vertex_count; ++i) {
+                WeldVertex vertex{data.positions[i], data.normals[i], data.tex_coords[i]};
+                auto [iter, inserted] = unique.try_emplace(vertex, static_cast<uint>(vertices.size()));
+                if (inserted) {
+                    vertices.emplace_back(vertex);
+                }
+                indices[i] = iter->second;
+            }
+
+            auto aabb = data.aabb;
+            data = MeshData{};
+            data.aabb = aabb;
+            data.allocate(vertices.size());
+            for (auto i = 0ul; i < vertices.size(); ++i) {
+                data.storage[i] = vertices[i].position;
+                data.storage[vertices.size() + i] = vertices[i].normal;
+                data.storage[vertices.size() * 2u + i] = vertices[i].tex_coord;
+            }
+            data.index_storage = std::move(indices);
+            data.indices = data.index_storage;
+        }
+
+        VertexCacheStatistics analyze_vertex_cache(span<const uint> indices, size_t vertex_count,
+                                                   uint cache_size) noexcept {
+            // a vertex is in the FIFO cache while fewer than cache_size misses happened since its own
+            VertexCacheStatistics statistics{vertex_count, indices.size() / 3u, 0u};
+            gl_render::vector<size_t> cached_at(vertex_count, std::numeric_limits<size_t>::max());
+            for (auto index: indices) {
+                if (cached_at[index] == std::numeric_limits<size_t>::max() ||
+                    statistics.cache_misses - cached_at[index] >= cache_size) {
+                    cached_at[index] = statistics.cache_misses++;
+                }
+            }
+            return statistics;
+        }
+
+        /// Triangles around each vertex v: triangles[offsets[v]] to triangles[offsets[v + 1]]
+        struct VertexAdjacency {
+            gl_render::vector<uint> offsets;
+            gl_render::vector<uint> triangles;
+
+            VertexAdjacency(span<const uint> indices, size_t vertex_count) noexcept
+                    : offsets(vertex_count + 1u, 0u), triangles(indices.size()) {
+                for (auto index: indices) {
+                    ++offsets[index + 1u];
+                }
+                std::partial_sum(offsets.cbegin(), offsets.cend(), offsets.begin());
+                gl_render::vector<uint> fill(offsets.cbegin(), offsets.cend() - 1);
+                for (auto t = 0u; t < indices.size() / 3u; ++t) {
+                    for (auto j = 0u; j < 3u; ++j) {
+                        triangles[fill[indices[t * 3u + j]]++] = t;
+                    }
+                }
+            }
+
+            [[nodiscard]] auto around(uint vertex) const noexcept {
+                return span<const uint>{triangles.data() + offsets[vertex], offsets[vertex + 1u] - offsets[vertex]};
+            }
+        };
+
+        /// Sander et al., Fast Triangle Reordering for Vertex Locality and Reduced Overdraw, 2007
+        [[nodiscard]] static gl_render::vector<uint> tipsify(span<const uint> indices, size_t vertex_count,
+                                                             uint cache_size) noexcept {
+            auto triangle_count = indices.size() / 3u;
+            VertexAdjacency adjacency{indices, vertex_count};
+
+            gl_render::vector<uint> live(vertex_count);
+            for (auto v = 0u; v < vertex_count; ++v) {
+                live[v] = static_cast<uint>(adjacency.around(v).size());
+            }
+            gl_render::vector<uint> cached_at(vertex_count, 0u);
+            gl_render::vector<uint8_t> emitted(triangle_count, 0u);
+            gl_render::vector<uint> dead_ends;
+            gl_render::vector<uint> candidates;
+            gl_render::vector<uint> result;
+            result.reserve(indices.size());
+            auto time = cache_size + 1u;
+            auto cursor = 0ul;
+
+            auto fanning = vertex_count == 0u ? int64_t{-1} : int64_t{0};
+            while (fanning >= 0) {
+                // emit every triangle left around the fanning vertex
+                candidates.clear();
+                for (auto t: adjacency.around(static_cast<uint>(fanning))) {
+                    if (emitted[t] != 0u) {
+                        continue;
+                    }
+                    for (auto j = 0u; j < 3u; ++j) {
+                        auto v = indices[t * 3u + j];
+                        result.emplace_back(v);
+                        dead_ends.emplace_back(v);
+                        candidates.emplace_back(v);
+                        --live[v];
+                        if (time - cached_at[v] > cache_size) {
+                            cached_at[v] = time++;
+                        }
+                    }
+                    emitted[t] = 1u;
+                }
+
+                // continue with the candidate that stays in the cache while it is fanned and entered it first
+                auto next = int64_t{-1};
+                auto best = int64_t{-1};
+                for (auto v: candidates) {
+                    if (live[v] == 0u) {
+                        continue;
+                    }
+                    auto priority = int64_t{0};
+                    if (time - cached_at[v] + 2u * live[v] <= cache_size) {
+                        priority = static_cast<int64_t>(time - cached_at[v]);
+                    }
+                    if (priority > best) {
+                        best = priority;
+                        next = v;
+                    }
+                }
+                // dead end: recently used vertices first, then the input order
+                while (next < 0 && !dead_ends.empty()) {
+                    auto v = dead_ends.back();
+                    dead_ends.pop_back();
+                    if (live[v] != 0u) {
+                        next = v;
+                    }
+                }
+                for (; next < 0 && cursor < vertex_count; ++cursor) {
+                    if (live[cursor] != 0u) {
+                        next = static_cast<int64_t>(cursor);
+                    }
+                }
+                fanning = next;
+            }
+            return result;
+        }
+
+        /// Split the cache-optimized triangles into clusters and draw the outward-facing clusters first,
+        /// they are the likely occluders. Clusters start where the cache is flushed anyway, and are split
+        /// further where that costs little locality.
+        static void optimize_overdraw(gl_render::vector<uint> &indices, span<const float3> positions,
+                                      uint cache_size, float threshold) noexcept {
+            auto triangle_count = indices.size() / 3u;
+            gl_render::vector<size_t> cached_at(positions.size(), std::numeric_limits<size_t>::max());
+            auto misses = 0ul;
+            auto simulate = [&](size_t t) {
+                auto triangle_misses = 0u;
+                for (auto j = 0u; j < 3u; ++j) {
+                    auto v = indices[t * 3u + j];
+                    if (cached_at[v] == std::numeric_limits<size_t>::max() || misses - cached_at[v] >= cache_size) {
+                        cached_at[v] = misses++;
+                        ++triangle_misses;
+                    }
+                }
+                return triangle_misses;
+            };
+            auto flush = [&] { misses += cache_size; };
+
+            // hard boundaries: triangles missing with all three vertices
+            gl_render::vector<size_t> hard_boundaries;
+            for (auto t = 0ul; t < triangle_count; ++t) {
+                if (simulate(t) == 3u || t == 0u) {
+                    hard_boundaries.emplace_back(t);
+                }
+            }
+            hard_boundaries.emplace_back(triangle_count);
+
+            // soft boundaries: split wherever the misses per triangle so far are close to the whole cluster's
+            gl_render::vector<size_t> boundaries;
+            for (auto c = 0ul; c + 1u < hard_boundaries.size(); ++c) {
+                auto begin = hard_boundaries[c];
+                auto end = hard_boundaries[c + 1u];
+                flush();
+                auto cluster_misses = 0ul;
+                for (auto t = begin; t < end; ++t) {
+                    cluster_misses += simulate(t);
+                }
+                auto cluster_threshold = threshold * static_cast<float>(cluster_misses) / static_cast<float>(end - begin);
+
+                flush();
+                auto start = begin;
+                auto start_misses = 0ul;
+                boundaries.emplace_back(begin);
+                for (auto t = begin; t < end; ++t) {
+                    start_misses += simulate(t);
+                    if (t + 1u < end &&
+                        static_cast<float>(start_misses) / static_cast<float>(t + 1u - start) <= cluster_threshold) {
+                        boundaries.emplace_back(t + 1u);
+                        start = t + 1u;
+                        start_misses = 0u;
+                        flush();
+                    }
+                }
+            }
+            boundaries.emplace_back(triangle_count);
+
+            // sort by how much the cluster faces away from the mesh center
+            auto mesh_center = float3{0.f};
+            for (auto position: positions) {
+                mesh_center += position;
+            }
+            mesh_center /= static_cast<float>(max(positions.size(), size_t{1}));
+            auto cluster_count = boundaries.size() - 1u;
+            gl_render::vector<float> keys(cluster_count);
+            for (auto c = 0ul; c < cluster_count; ++c) {
+                auto normal = float3{0.f};
+                auto center = float3{0.f};
+                auto area = 0.f;
+                for (auto t = boundaries[c]; t < boundaries[c + 1u]; ++t) {
+                    auto p0 = positions[indices[t * 3u]];
+                    auto p1 = positions[indices[t * 3u + 1u]];
+                    auto p2 = positions[indices[t * 3u + 2u]];
+                    auto n = cross(p1 - p0, p2 - p0);
+                    auto a = length(n);
+                    normal += n;
+                    center += (p0 + p1 + p2) * (a / 3.f);
+                    area += a;
+                }
+                auto normal_length = length(normal);
+                keys[c] = area > 0.f && normal_length > 0.f ?
+                          dot(center / area - mesh_center, normal / normal_length) : 0.f;
+            }
+            gl_render::vector<size_t> order(cluster_count);
+            std::iota(order.begin(), order.end(), 0ul);
+            std::stable_sort(order.begin(), order.end(), [&keys](auto lhs, auto rhs) { return keys[lhs] > keys[rhs]; });
+
+            gl_render::vector<uint> sorted;
+            sorted.reserve(indices.size());
+            for (auto c: order) {
+                sorted.insert(sorted.end(), indices.cbegin() + boundaries[c] * 3u, indices.cbegin() + boundaries[c + 1u] * 3u);
+            }
+            indices = std::move(sorted);
+        }
+
+        void optimize_mesh(MeshData &data) noexcept {
+            if (data.index_count() < 3u) {
+                return;
+            }
+            GL_RENDER_ASSERT(data.indexed() && data.mapped_file == nullptr, "Only welded meshes are optimized");
+            GL_RENDER_PROFILE_SCOPE("optimize mesh", "geometry");
+            auto vertex_count = data.vertex_count();
+            auto indices = tipsify(data.indices, vertex_count, VERTEX_CACHE_SIZE);
+            optimize_overdraw(indices, data.positions, VERTEX_CACHE_SIZE, OVERDRAW_CLUSTER_THRESHOLD);
+
+            // vertices in order of first use
+            gl_render::vector<uint> remap(vertex_count, std::numeric_limits<uint>::max());
+            auto used_count = 0u;
+            for (auto &index: indices) {
+                if (remap[index] == std::numeric_limits<uint>::max()) {
+                    remap[index] = used_count++;
+                }
+                index = remap[index];
+            }
+            MeshData optimized;
+            optimized.aabb = data.aabb;
+            optimized.allocate(used_count);
+            for (auto v = 0ul; v < vertex_count; ++v) {
+                if (auto r = remap[v]; r != std::numeric_limits<uint>::max()) {
+                    optimized.storage[r] = data.positions[v];
+                    optimized.storage[used_count + r] = data.normals[v];
+                    optimized.storage[used_count * 2u + r] = data.tex_coords[v];
+                }
+            }
+            optimized.index_storage = std::move(indices);
+            optimized.indices = optimized.index_storage;
+            data = std::move(optimized);
+        }
+
+        /// Sum of squared distances to planes, weighted by triangle area
+        struct Quadric {
+            double a00{0.0}, a11{0.0}, a22{0.0}, a01{0.0}, a12{0.0}, a02{0.0};
+            double b0{0.0}, b1{0.0}, b2{0.0};
+            double c{0.0};
+            double weight{0.0};
+
+            [[nodiscard]] static Quadric plane(float3 normal, float3 point, double weight) noexcept {
+                auto x = static_cast<double>(normal.x);
+                auto y = static_cast<double>(normal.y);
+                auto z = static_cast<double>(normal.z);
+                auto d = -static_cast<double>(dot(normal, point));
+                return Quadric{x * x * weight, y * y * weight, z * z * weight,
+                               x * y * weight, y * z * weight, x * z * weight,
+                               x * d * weight, y * d * weight, z * d * weight,
+                               d * d * weight, weight};
+            }
+
+            Quadric &operator+=(const Quadric &rhs) noexcept {
+                a00 += rhs.a00, a11 += rhs.a11, a22 += rhs.a22, a01 += rhs.a01, a12 += rhs.a12, a02 += rhs.a02;
+                b0 += rhs.b0, b1 += rhs.b1, b2 += rhs.b2;
+                c += rhs.c;
+                weight += rhs.weight;
+                return *this;
+            }
+
+            /// mean squared distance of p to the planes
+            [[nodiscard]] double error(float3 p) const noexcept {
+                auto x = static_cast<double>(p.x);
+                auto y = static_cast<double>(p.y);
+                auto z = static_cast<double>(p.z);
+                auto rx = a00 * x + a01 * y + a02 * z;
+                auto ry = a01 * x + a11 * y + a12 * z;
+                auto rz = a02 * x + a12 * y + a22 * z;
+                auto e = rx * x + ry * y + rz * z + 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+                return weight > 0.0 ? std::abs(e) / weight : 0.0;
+            }
+        };
+
+        gl_render::vector<uint> simplify_mesh(span<const uint> indices, span<const float3> positions,
+                                              size_t target_index_count, float &error) noexcept {
+            auto vertex_count = positions.size();
+            error = 0.f;
+
+            // vertices that share their position with another one lie on an attribute seam, moving only one
+            // side would tear the surface; vertices on open edges would shrink the border
+            gl_render::vector<uint8_t> locked(vertex_count, 0u);
+            {
+                gl_render::unordered_map<WeldVertex, uint, WeldVertexHash> first;
+                first.reserve(vertex_count);
+                for (auto v = 0u; v < vertex_count; ++v) {
+                    auto [iter, inserted] = first.try_emplace(WeldVertex{positions[v], float3{0.f}, float3{0.f}}, v);
+                    if (!inserted) {
+                        locked[v] = locked[iter->second] = 1u;
+                    }
+                }
+                gl_render::unordered_map<uint64_t, uint> edges;
+                edges.reserve(indices.size());
+                auto edge_key = [](uint a, uint b) { return (static_cast<uint64_t>(min(a, b)) << 32u) | max(a, b); };
+                for (auto i = 0ul; i < indices.size(); i += 3u) {
+                    for (auto j = 0u; j < 3u; ++j) {
+                        ++edges[edge_key(indices[i + j], indices[i + (j + 1u) % 3u])];
+                    }
+                }
+                for (auto [key, count]: edges) {
+                    if (count == 1u) {
+                        locked[key >> 32u] = locked[key & 0xffffffffu] = 1u;
+                    }
+                }
+            }
+
+            gl_render::vector<Quadric> quadrics(vertex_count);
+            for (auto i = 0ul; i < indices.size(); i += 3u) {
+                auto p0 = positions[indices[i]];
+                auto n = cross(positions[indices[i + 1u]] - p0, positions[indices[i + 2u]] - p0);
+                auto area = length(n);
+                if (area > 0.f) {
+                    auto quadric = Quadric::plane(n / area, p0, area * 0.5);
+                    for (auto j = 0u; j < 3u; ++j) {
+                        quadrics[indices[i + j]] += quadric;
+                    }
+                }
+            }
+
+            struct Collapse {
+                uint from;
+                uint to;
+                double error;
+            };
+            gl_render::vector<uint> result(indices.begin(), indices.end());
+            gl_render::vector<Collapse> collapses;
+            gl_render::vector<uint> remap(vertex_count);
+            gl_render::vector<uint8_t> touched(vertex_count);
+            auto max_error = 0.0;
+            // each pass collapses the cheapest edges that do not share vertices with each other
+            while (result.size() > target_index_count) {
+                collapses.clear();
+                for (auto i = 0ul; i < result.size(); i += 3u) {
+                    for (auto j = 0u; j < 3u; ++j) {
+                        auto from = result[i + j];
+                        auto to = result[i + (j + 1u) % 3u];
+                        if (locked[from] == 0u) {
+                            auto quadric = quadrics[from];
+                            quadric += quadrics[to];
+                            collapses.emplace_back(Collapse{from, to, quadric.error(positions[to])});
+                        }
+                        if (locked[to] == 0u) {
+                            auto quadric = quadrics[to];
+                            quadric += quadrics[from];
+                            collapses.emplace_back(Collapse{to, from, quadric.error(positions[from])});
+                        }
+                    }
+                }
+                std::sort(collapses.begin(), collapses.end(), [](const auto &lhs, const auto &rhs) {
+                    return lhs.error < rhs.error;
+                });
+
+                VertexAdjacency adjacency{result, vertex_count};
+                std::iota(remap.begin(), remap.end(), 0u);
+                std::fill(touched.begin(), touched.end(), 0u);
+                auto triangles_to_remove = (result.size() - target_index_count) / 3u;
+                auto removed = 0ul;
+                for (const auto &collapse: collapses) {
+                    if (removed >= triangles_to_remove) {
+                        break;
+                    }
+                    if (touched[collapse.from] != 0u || touched[collapse.to] != 0u) {
+                        continue;
+                    }
+                    // the triangles that keep their area must not flip
+                    auto degenerate = 0ul;
+                    auto flips = false;
+                    for (auto t: adjacency.around(collapse.from)) {
+                        const auto *triangle = &result[t * 3u];
+                        if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+                            ++degenerate;
+                            continue;
+                        }
+                        auto corner = [&](uint j, bool moved) {
+                            return moved && triangle[j] == collapse.from ? positions[collapse.to] : positions[triangle[j]];
+                        };
+                        auto before = cross(corner(1u, false) - corner(0u, false), corner(2u, false) - corner(0u, false));
+                        auto after = cross(corner(1u, true) - corner(0u, true), corner(2u, true) - corner(0u, true));
+                        if (dot(before, after) <= 0.f) {
+                            flips = true;
+                            break;
+                        }
+                    }
+                    if (flips) {
+                        continue;
+                    }
+                    remap[collapse.from] = collapse.to;
+                    quadrics[collapse.to] += quadrics[collapse.from];
+                    max_error = max(max_error, collapse.error);
+                    removed += degenerate;
+                    for (auto t: adjacency.around(collapse.from)) {
+                        for (auto j = 0u; j < 3u; ++j) {
+                            touched[result[t * 3u + j]] = 1u;
+                        }
+                    }
+                }
+                if (removed == 0u) {
+                    break;
+                }
+
+                auto kept = 0ul;
+                for (auto i = 0ul; i < result.size(); i += 3u) {
+                    auto a = remap[result[i]];
+                    auto b = remap[result[i + 1u]];
+                    auto c = remap[result[i + 2u]];
+                    if (a != b && b != c && a != c) {
+                        result[kept++] = a;
+                        result[kept++] = b;
+                        result[kept++] = c;
+                    }
+                }
+                result.resize(kept);
+            }
+            error = static_cast<float>(std::sqrt(max_error));
+            return result;
+        }
+
+        void generate_lods(MeshData &data) noexcept {
+            if (!data.indexed() || !data.lods.empty() || data.index_count() < LOD_MIN_TRIANGLE_COUNT * 6u) {
+                return;
+            }
+            GL_RENDER_PROFILE_SCOPE("generate lods", "geometry");
+            auto full = data.indices;
+            gl_render::vector<uint> indices(full.begin(), full.end());
+            gl_render::vector<MeshLod> lods{MeshLod{0u, static_cast<uint>(full.size()), 0.f}};
+            while (lods.size() < MAX_LOD_COUNT) {
+                auto previous = lods.back().index_count;
+                auto target = static_cast<size_t>(static_cast<float>(previous / 3u) * LOD_REDUCTION) * 3u;
+                if (target < LOD_MIN_TRIANGLE_COUNT * 3u) {
+                    break;
+                }
+                // every level is simplified from the full mesh, so its error is measured against it
+                auto error = 0.f;
+                auto level = simplify_mesh(full, data.positions, target, error);
+                if (static_cast<float>(level.size()) > static_cast<float>(previous) * (1.f + LOD_REDUCTION) * 0.5f) {
+                    break;
+                }
+                level = tipsify(level, data.vertex_count(), VERTEX_CACHE_SIZE);
+                // coarser levels never claim to be more accurate, selection relies on it
+                error = max(error, lods.back().error);
+                lods.emplace_back(MeshLod{static_cast<uint>(indices.size()), static_cast<uint>(level.size()), error});
+                indices.insert(indices.end(), level.cbegin(), level.cend());
+            }
+            if (lods.size() == 1u) {
+                return;
+            }
+            data.index_storage = std::move(indices);
+            data.indices = data.index_storage;
+            data.lod_storage = std::move(lods);
+            data.lods = data.lod_storage;
+        }
+
+        gl_render::vector<Meshlet> build_meshlets(span<const uint> indices, span<const float3> positions) noexcept {
+            gl_render::vector<Meshlet> meshlets;
+            // meshlet that last used a vertex, to tell whether the next triangle is connected to the open one
+            gl_render::vector<uint> used_by(positions.size(), std::numeric_limits<uint>::max());
+            auto first = 0ul;
+            auto normal_sum = float3{0.f};
+            auto close = [&](size_t last) {
+                AABB bounds;
+                for (auto i = first; i < last; ++i) {
+                    bounds.min = min(bounds.min, positions[indices[i]]);
+                    bounds.max = max(bounds.max, positions[indices[i]]);
+                }
+                Meshlet meshlet{(bounds.min + bounds.max) * 0.5f, 0.f, float3{0.f}, 1.f,
+                                static_cast<uint>(first), static_cast<uint>(last - first)};
+                for (auto i = first; i < last; ++i) {
+                    meshlet.radius = max(meshlet.radius, length(positions[indices[i]] - meshlet.center));
+                }
+                // the cone is around the mean normal, and as wide as the furthest normal from it
+                if (auto sum_length = length(normal_sum); sum_length > 0.f) {
+                    meshlet.cone_axis = normal_sum / sum_length;
+                    auto min_cosine = 1.f;
+                    for (auto i = first; i < last; i += 3u) {
+                        auto p0 = positions[indices[i]];
+                        auto n = cross(positions[indices[i + 1u]] - p0, positions[indices[i + 2u]] - p0);
+                        if (auto n_length = length(n); n_length > 0.f) {
+                            min_cosine = min(min_cosine, dot(n / n_length, meshlet.cone_axis));
+                        }
+                    }
+                    // a cone wider than about 84 degrees is never entirely back-facing
+                    if (min_cosine > 0.1f) {
+                        meshlet.cone_cutoff = std::sqrt(1.f - min_cosine * min_cosine);
+                    }
+                }
+                meshlets.emplace_back(meshlet);
+                first = last;
+                normal_sum = float3{0.f};
+            };
+            for (auto i = 0ul; i + 2u < indices.size(); i += 3u) {
+                auto p0 = positions[indices[i]];
+                auto n = cross(positions[indices[i + 1u]] - p0, positions[indices[i + 2u]] - p0);
+                auto n_length = length(n);
+                n = n_length > 0.f ? n / n_length : float3{0.f};
+                auto triangle_count = (i - first) / 3u;
+                if (triangle_count >= MESHLET_MIN_TRIANGLE_COUNT) {
+                    auto id = static_cast<uint>(meshlets.size());
+                    auto connected = used_by[indices[i]] == id || used_by[indices[i + 1u]] == id ||
+                                     used_by[indices[i + 2u]] == id;
+                    auto sum_length = length(normal_sum);
+                    auto aligned = sum_length == 0.f || dot(n, normal_sum / sum_length) >= MESHLET_MAX_NORMAL_ANGLE;
+                    if (triangle_count >= MESHLET_MAX_TRIANGLE_COUNT || !connected || !aligned) {
+                        close(i);
+                    }
+                }
+                auto id = static_cast<uint>(meshlets.size());
+                used_by[indices[i]] = used_by[indices[i + 1u]] = used_by[indices[i + 2u]] = id;
+                normal_sum += n;
+            }
+            if (first < indices.size()) {
+                close(indices.size() / 3u * 3u);
+            }
+            return meshlets;
+        }
+
+        uint2 encode_position(float3 position, float flag, const AABB &bounds) noexcept {
+            auto extent = max(bounds.max - bounds.min, float3{1.e-20f});
+            auto t = (position - bounds.min) / extent;
+            return uint2{glm::packUnorm2x16(float2{t.x, t.y}), glm::packUnorm2x16(float2{t.z, flag})};
+        }
+
+        float3 decode_position(uint2 encoded, const AABB &bounds) noexcept {
+            auto t = float3{glm::unpackUnorm2x16(encoded.x), glm::unpackUnorm2x16(encoded.y).x};
+            return bounds.min + t * (bounds.max - bounds.min);
+        }
+
+        uint encode_normal(float3 normal) noexcept {
+            // project onto the octahedron, the lower half is folded over the diagonals
+            normal /= max(std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z), 1.e-20f);
+            auto encoded = float2{normal.x, normal.y};
+            if (normal.z < 0.f) {
+                encoded = float2{(1.f - std::abs(normal.y)) * (normal.x >= 0.f ? 1.f : -1.f),
+                                 (1.f - std::abs(normal.x)) * (normal.y >= 0.f ? 1.f : -1.f)};
+            }
+            return glm::packSnorm2x16(encoded);
+        }
+
+        CompactVertices compact_vertices(span<const float3> positions, span<const float3> normals,
+                                         span<const float3> tex_coords) noexcept {
+            GL_RENDER_PROFILE_SCOPE("compact vertices", "upload");
+            CompactVertices compact;
+            for (auto position: positions) {
+                compact.bounds.min = min(compact.bounds.min, position);
+                compact.bounds.max = max(compact.bounds.max, position);
+            }
+            compact.positions.resize(positions.size());
+            compact.normals.resize(normals.size());
+            compact.tex_coords.resize(tex_coords.size());
+            for (auto i = 0ul; i < positions.size(); ++i) {
+                auto flag = i < tex_coords.size() && tex_coords[i].z >= 0.f ? 1.f : 0.f;
+                compact.positions[i] = encode_position(positions[i], flag, compact.bounds);
+            }
+            for (auto i = 0ul; i < normals.size(); ++i) {
+                compact.normals[i] = encode_normal(normals[i]);
+            }
+            for (auto i = 0ul; i < tex_coords.size(); ++i) {
+                compact.tex_coords[i] = glm::packHalf2x16(float2{tex_coords[i].x, tex_coords[i].y});
+            }
+            return compact;
+        }
+
+    }
+
+}
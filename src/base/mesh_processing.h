@@ -0,0 +1,127 @@
+//
+// Created by ChenXin on 2022/11/12.
+//
+
+#pragma once
+
+#include <core/stl.h>
+#include <base/aabb.h>
+#include <base/mesh_cache.h>
+
+namespace gl_render {
+
+    namespace impl {
+
+        /// Merge the bit-identical vertices of a flattened mesh into shared ones, in order of first use,
+        /// and reference them through an index list. Indexed meshes are left as they are.
+        void weld_mesh(MeshData &data) noexcept;
+
+        /// Mesh cache key flag of meshes run through optimize_mesh, unused by the import flags
+        constexpr uint MESH_OPTIMIZATION_FLAG = 0x40000000u;
+        /// Entries of the FIFO post-transform cache that meshes are optimized and analyzed for
+        constexpr uint VERTEX_CACHE_SIZE = 16u;
+        /// Clusters are split where their cache misses per triangle are within this factor of the whole cluster's
+        constexpr float OVERDRAW_CLUSTER_THRESHOLD = 1.05f;
+
+        /// Post-transform vertex cache behaviour of index lists, as simulated by analyze_vertex_cache
+        struct VertexCacheStatistics {
+            size_t vertex_count{0u};
+            size_t triangle_count{0u};
+            size_t cache_misses{0u};
+
+            /// average cache miss ratio, transformed vertices per triangle: 3 at worst, about 0.5 on regular grids
+            [[nodiscard]] auto acmr() const noexcept {
+                return static_cast<double>(cache_misses) / static_cast<double>(max(triangle_count, size_t{1}));
+            }
+            /// average transform to vertex ratio, transformed vertices per vertex: 1 at best
+            [[nodiscard]] auto atvr() const noexcept {
+                return static_cast<double>(cache_misses) / static_cast<double>(max(vertex_count, size_t{1}));
+            }
+            VertexCacheStatistics &operator+=(const VertexCacheStatistics &rhs) noexcept {
+                vertex_count += rhs.vertex_count;
+                triangle_count += rhs.triangle_count;
+                cache_misses += rhs.cache_misses;
+                return *this;
+            }
+        };
+
+        [[nodiscard]] VertexCacheStatistics analyze_vertex_cache(span<const uint> indices, size_t vertex_count,
+                                                                 uint cache_size = VERTEX_CACHE_SIZE) noexcept;
+
+        /// Reorder the triangles of a welded mesh for vertex cache locality (Tipsify), then clusters of them
+        /// so that outward-facing ones come first against overdraw, then the vertices in order of first use
+        /// for fetch locality. The mesh has to own its storage, as welded meshes do.
+        void optimize_mesh(MeshData &data) noexcept;
+
+        /// Mesh cache key flag of meshes with levels of detail from generate_lods, unused by the import flags
+        constexpr uint MESH_LOD_FLAG = 0x20000000u;
+        /// Levels of detail per mesh at most, the full mesh included
+        constexpr uint MAX_LOD_COUNT = 4u;
+        /// Each level aims at this fraction of the triangles of the previous one
+        constexpr float LOD_REDUCTION = 0.5f;
+        /// Levels below this many triangles are not generated
+        constexpr uint LOD_MIN_TRIANGLE_COUNT = 64u;
+
+        /// Collapse edges of a welded mesh in order of their quadric error (Garland and Heckbert, 1997) until
+        /// about target_index_count indices are left. Vertices only move onto their neighbours, so the result
+        /// indexes the same vertices; vertices on attribute seams and open borders stay where they are.
+        /// error is set to the largest distance of a collapsed vertex to the surface it came from.
+        [[nodiscard]] gl_render::vector<uint> simplify_mesh(span<const uint> indices, span<const float3> positions,
+                                                            size_t target_index_count, float &error) noexcept;
+        /// Append simplified, cache-optimized levels of detail to the indices of a welded mesh and list them,
+        /// the full mesh first, in lods. Levels stop once simplification stalls.
+        void generate_lods(MeshData &data) noexcept;
+
+        /// Meshlets are closed at MESHLET_MAX_TRIANGLE_COUNT triangles, or once they have MESHLET_MIN_TRIANGLE_COUNT
+        /// and the next triangle is not connected to them or faces away from their normals by more than
+        /// MESHLET_MAX_NORMAL_ANGLE (cosine)
+        constexpr uint MESHLET_MIN_TRIANGLE_COUNT = 64u;
+        constexpr uint MESHLET_MAX_TRIANGLE_COUNT = 128u;
+        constexpr float MESHLET_MAX_NORMAL_ANGLE = 0.5f;
+
+        /// Run of consecutive triangles culled as a whole: by its bounding sphere against the frustum, and by
+        /// the cone of its face normals against the view direction
+        struct Meshlet {
+            float3 center;
+            float radius;
+            float3 cone_axis;
+            /// sine of the half angle of the normal cone, 1 if the cone is too wide to ever be back-facing
+            float cone_cutoff;
+            uint first_index;
+            uint index_count;
+
+            /// Whether every triangle faces away from a viewer at position (counter-clockwise front faces)
+            [[nodiscard]] bool back_facing(float3 position) const noexcept {
+                auto direction = center - position;
+                return dot(direction, cone_axis) >= cone_cutoff * length(direction) + radius;
+            }
+        };
+
+        /// Split indices into meshlets of consecutive triangles, first_index counts from the start of indices.
+        /// Vertex-cache optimized meshes keep neighbouring triangles close in the index list, so the runs are
+        /// mostly connected patches.
+        [[nodiscard]] gl_render::vector<Meshlet> build_meshlets(span<const uint> indices,
+                                                                span<const float3> positions) noexcept;
+
+        /// Compact vertex format: positions as 16-bit unorm in bounds with the tex coord flag in w, normals
+        /// octahedral-encoded in 2x16-bit snorm, tex coords as 2 half floats. Decoded by decode_position() and
+        /// in the shaders.
+        struct CompactVertices {
+            AABB bounds;
+            gl_render::vector<uint2> positions;
+            gl_render::vector<uint> normals;
+            gl_render::vector<uint> tex_coords;
+        };
+        static constexpr size_t COMPACT_VERTEX_SIZE = sizeof(uint2) + sizeof(uint) * 2u;
+
+        /// Quantize positions to their own bounds, the tex coord flag in z moves to the position
+        [[nodiscard]] CompactVertices compact_vertices(span<const float3> positions, span<const float3> normals,
+                                                       span<const float3> tex_coords) noexcept;
+        /// flag is 1 if the vertex has tex coords, else 0
+        [[nodiscard]] uint2 encode_position(float3 position, float flag, const AABB &bounds) noexcept;
+        [[nodiscard]] float3 decode_position(uint2 encoded, const AABB &bounds) noexcept;
+        [[nodiscard]] uint encode_normal(float3 normal) noexcept;
+
+    }
+
+}
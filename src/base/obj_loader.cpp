@@ -0,0 +1,302 @@
+//
+// Created by ChenXin on 2022/11/11.
+//
+
+#include <base/obj_loader.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <thread>
+
+#include <fast_float/fast_float.h>
+
+#include <core/profiler.h>
+#include <base/vertex_transform.h>
+
+namespace gl_render {
+
+    namespace impl {
+
+        /// One corner of a face, indices are 0-based into the whole file once resolved, -1 if absent
+        struct ObjCorner {
+            int64_t position;
+            int64_t tex_coord;
+            int64_t normal;
+        };
+
+        /// Statements of one chunk of the file, faces already triangulated
+        struct ObjChunk {
+            const char *begin;
+            const char *end;
+            gl_render::vector<float3> positions;
+            gl_render::vector<float2> tex_coords;
+            gl_render::vector<float3> normals;
+            gl_render::vector<ObjCorner> corners;
+            // relative (negative) indices are resolved against the counts of the chunk, so they
+            // still need the offset of the chunk, marked per corner: bit 0 position, 1 tex_coord, 2 normal
+            gl_render::vector<uint8_t> relative;
+            bool valid{true};
+
+            // first element of each stream in the whole file
+            size_t position_offset{0u};
+            size_t tex_coord_offset{0u};
+            size_t normal_offset{0u};
+            size_t corner_offset{0u};
+            AABB aabb;
+        };
+
+        [[nodiscard]] static inline bool is_blank(char c) noexcept {
+            return c == ' ' || c == '\t' || c == '\r';
+        }
+
+        [[nodiscard]] static inline const char *skip_blanks(const char *p, const char *end) noexcept {
+            while (p < end && is_blank(*p)) {
+                ++p;
+            }
+            return p;
+        }
+
+        [[nodiscard]] static inline const char *skip_line(const char *p, const char *end) noexcept {
+            p = std::find(p, end, '\n');
+            return p == end ? end : p + 1;
+        }
+
+        [[nodiscard]] static inline const char *parse_float(const char *p, const char *end, float &value) noexcept {
+            p = skip_blanks(p, end);
+            auto [ptr, ec] = fast_float::from_chars(p, end, value);
+            return ec == std::errc{} ? ptr : nullptr;
+        }
+
+        /// Parse "v", "v/vt", "v//vn" or "v/vt/vn", absent indices are 0
+        [[nodiscard]] static inline const char *parse_corner(const char *p, const char *end, int64_t (&indices)[3]) noexcept {
+            indices[0] = indices[1] = indices[2] = 0;
+            for (auto k = 0u; k < 3u; ++k) {
+                if (k != 0u) {
+                    if (p == end || *p != '/') {
+                        break;
+                    }
+                    ++p;
+                    if (p != end && *p == '/') {
+                        continue;
+                    }
+                }
+                auto [ptr, ec] = std::from_chars(p, end, indices[k]);
+                if (ec != std::errc{} || indices[k] == 0) {
+                    return nullptr;
+                }
+                p = ptr;
+            }
+            return p;
+        }
+
+        static void parse_chunk(ObjChunk &chunk) noexcept {
+            gl_render::vector<ObjCorner> face;
+            gl_render::vector<uint8_t> face_relative;
+            auto resolve = [&chunk](int64_t index, size_t count, uint8_t bit, uint8_t &relative) -> int64_t {
+                if (index > 0) {
+                    return index - 1;
+                }
+                if (index < 0) {
+                    relative |= bit;
+                    return static_cast<int64_t>(count) + index;
+                }
+                return -1;
+            };
+            auto p = chunk.begin;
+            auto end = chunk.end;
+            while (p < end && chunk.valid) {
+                p = skip_blanks(p, end);
+                auto line_end = std::find(p, end, '\n');
+                if (p + 1 < line_end && p[0] == 'v' && is_blank(p[1])) {
+                    float3 v;
+                    p = parse_float(p + 1, line_end, v.x);
+                    p = p == nullptr ? nullptr : parse_float(p, line_end, v.y);
+                    p = p == nullptr ? nullptr : parse_float(p, line_end, v.z);
+                    chunk.valid = p != nullptr;
+                    chunk.positions.emplace_back(v);
+                } else if (p + 2 < line_end && p[0] == 'v' && p[1] == 'n' && is_blank(p[2])) {
+                    float3 n;
+                    p = parse_float(p + 2, line_end, n.x);
+                    p = p == nullptr ? nullptr : parse_float(p, line_end, n.y);
+                    p = p == nullptr ? nullptr : parse_float(p, line_end, n.z);
+                    chunk.valid = p != nullptr;
+                    chunk.normals.emplace_back(n);
+                } else if (p + 2 < line_end && p[0] == 'v' && p[1] == 't' && is_blank(p[2])) {
+                    // v is optional, a third (w) coordinate is ignored
+                    float2 uv{0.f};
+                    p = parse_float(p + 2, line_end, uv.x);
+                    if (p != nullptr && skip_blanks(p, line_end) != line_end) {
+                        p = parse_float(p, line_end, uv.y);
+                    }
+                    chunk.valid = p != nullptr;
+                    chunk.tex_coords.emplace_back(uv);
+                } else if (p + 1 < line_end && p[0] == 'f' && is_blank(p[1])) {
+                    face.clear();
+                    face_relative.clear();
+                    p = skip_blanks(p + 1, line_end);
+                    while (p != nullptr && p < line_end) {
+                        int64_t indices[3];
+                        p = parse_corner(p, line_end, indices);
+                        if (p == nullptr || (p < line_end && !is_blank(*p))) {
+                            chunk.valid = false;
+                            break;
+                        }
+                        auto &relative = face_relative.emplace_back(0u);
+                        face.emplace_back(ObjCorner{
+                                resolve(indices[0], chunk.positions.size(), 1u, relative),
+                                resolve(indices[1], chunk.tex_coords.size(), 2u, relative),
+                                resolve(indices[2], chunk.normals.size(), 4u, relative)});
+                        p = skip_blanks(p, line_end);
+                    }
+                    // fan triangulation, like aiProcess_Triangulate; points and lines are dropped
+                    for (auto i = 2ul; chunk.valid && i < face.size(); ++i) {
+                        for (auto k: {0ul, i - 1u, i}) {
+                            chunk.corners.emplace_back(face[k]);
+                            chunk.relative.emplace_back(face_relative[k]);
+                        }
+                    }
+                }
+                // anything else (comments, groups, objects, materials, smoothing groups, lines) is skipped
+                p = line_end == end ? end : line_end + 1;
+            }
+        }
+
+        /// Run f(i) for i in [0, n), on n - 1 new threads and the calling one
+        static void run_chunks(size_t n, const function<void(size_t)> &f) noexcept {
+            gl_render::vector<std::thread> threads;
+            threads.reserve(n - 1u);
+            for (auto i = 1ul; i < n; ++i) {
+                threads.emplace_back(f, i);
+            }
+            f(0u);
+            for (auto &thread: threads) {
+                thread.join();
+            }
+        }
+
+        bool is_obj_file(const path &mesh_path) noexcept {
+            auto extension = mesh_path.extension().string();
+            std::transform(extension.begin(), extension.end(), extension.begin(),
+                           [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            return extension == ".obj";
+        }
+
+        bool load_obj(span<const std::byte> source, const float4x4 &transform, MeshData &data,
+                      uint thread_count) noexcept {
+            GL_RENDER_PROFILE_SCOPE("parse obj", "geometry");
+            auto begin = reinterpret_cast<const char *>(source.data());
+            auto end = begin + source.size();
+
+            // chunks start right after a line break, so every statement is parsed by exactly one chunk
+            auto chunk_count = std::clamp<size_t>(source.size() / OBJ_MIN_CHUNK_SIZE, 1u, max(thread_count, 1u));
+            gl_render::vector<ObjChunk> chunks(chunk_count);
+            auto chunk_begin = begin;
+            for (auto i = 0ul; i < chunk_count; ++i) {
+                auto chunk_end = i + 1u == chunk_count ? end : skip_line(begin + source.size() * (i + 1u) / chunk_count, end);
+                chunks[i].begin = chunk_begin;
+                chunks[i].end = std::max(chunk_begin, chunk_end);
+                chunk_begin = chunks[i].end;
+            }
+            run_chunks(chunk_count, [&chunks](size_t i) { parse_chunk(chunks[i]); });
+
+            auto position_count = 0ul;
+            auto tex_coord_count = 0ul;
+            auto normal_count = 0ul;
+            auto corner_count = 0ul;
+            for (auto &chunk: chunks) {
+                if (!chunk.valid) {
+                    return false;
+                }
+                chunk.position_offset = position_count;
+                chunk.tex_coord_offset = tex_coord_count;
+                chunk.normal_offset = normal_count;
+                chunk.corner_offset = corner_count;
+                position_count += chunk.positions.size();
+                tex_coord_count += chunk.tex_coords.size();
+                normal_count += chunk.normals.size();
+                corner_count += chunk.corners.size();
+            }
+
+            // transform the vertex streams of the whole file once, faces may reference any chunk
+            auto normal_matrix = float3x3{transpose(inverse(transform))};
+            gl_render::vector<float3> positions(position_count);
+            gl_render::vector<float3> object_positions(position_count);
+            gl_render::vector<float2> tex_coords(tex_coord_count);
+            gl_render::vector<float3> normals(normal_count);
+            run_chunks(chunk_count, [&](size_t i) {
+                const auto &chunk = chunks[i];
+                std::copy(chunk.positions.cbegin(), chunk.positions.cend(), object_positions.begin() + chunk.position_offset);
+                std::copy(chunk.tex_coords.cbegin(), chunk.tex_coords.cend(), tex_coords.begin() + chunk.tex_coord_offset);
+                // the bounds only cover the referenced positions, they are taken from the corners below
+                transform_vertices(chunk.positions, span{positions}.subspan(chunk.position_offset, chunk.positions.size()),
+                                   chunk.normals, span{normals}.subspan(chunk.normal_offset, chunk.normals.size()),
+                                   transform, normal_matrix);
+            });
+
+            data.allocate(corner_count);
+            auto out_positions = data.storage.data();
+            auto out_normals = out_positions + corner_count;
+            auto out_tex_coords = out_normals + corner_count;
+            std::atomic<bool> valid{true};
+            run_chunks(chunk_count, [&](size_t i) {
+                auto &chunk = chunks[i];
+                auto in_range = [](int64_t index, size_t count) {
+                    return index >= 0 && static_cast<size_t>(index) < count;
+                };
+                for (auto t = 0ul; t < chunk.corners.size(); t += 3u) {
+                    ObjCorner corners[3];
+                    for (auto k = 0u; k < 3u; ++k) {
+                        auto corner = chunk.corners[t + k];
+                        auto relative = chunk.relative[t + k];
+                        corner.position += (relative & 1u) ? static_cast<int64_t>(chunk.position_offset) : 0;
+                        corner.tex_coord += (relative & 2u) ? static_cast<int64_t>(chunk.tex_coord_offset) : 0;
+                        corner.normal += (relative & 4u) ? static_cast<int64_t>(chunk.normal_offset) : 0;
+                        if (!in_range(corner.position, position_count) ||
+                            (corner.tex_coord != -1 && !in_range(corner.tex_coord, tex_coord_count)) ||
+                            (corner.normal != -1 && !in_range(corner.normal, normal_count))) {
+                            valid = false;
+                            return;
+                        }
+                        corners[k] = corner;
+                    }
+                    // flat normal in object space, transformed like the file normals (aiProcess_GenNormals)
+                    float3 face_normal{0.f};
+                    if (corners[0].normal == -1 || corners[1].normal == -1 || corners[2].normal == -1) {
+                        auto p0 = object_positions[corners[0].position];
+                        auto p1 = object_positions[corners[1].position];
+                        auto p2 = object_positions[corners[2].position];
+                        auto n = cross(p1 - p0, p2 - p0);
+                        auto length = glm::length(n);
+                        face_normal = normal_matrix * (length > 0.f ? n / length : n);
+                    }
+                    for (auto k = 0u; k < 3u; ++k) {
+                        auto index = chunk.corner_offset + t + k;
+                        const auto &corner = corners[k];
+                        out_positions[index] = positions[corner.position];
+                        out_normals[index] = corner.normal == -1 ? face_normal : normals[corner.normal];
+                        // z < 0 marks vertices without texture coordinates
+                        out_tex_coords[index] = corner.tex_coord == -1 ?
+                                                float3{0.f, 0.f, -1.f} :
+                                                float3{tex_coords[corner.tex_coord], 1.f};
+                        chunk.aabb.min = min(chunk.aabb.min, out_positions[index]);
+                        chunk.aabb.max = max(chunk.aabb.max, out_positions[index]);
+                    }
+                }
+            });
+            if (!valid) {
+                data = MeshData{};
+                return false;
+            }
+            data.aabb = AABB{};
+            for (const auto &chunk: chunks) {
+                data.aabb.min = min(data.aabb.min, chunk.aabb.min);
+                data.aabb.max = max(data.aabb.max, chunk.aabb.max);
+            }
+            return true;
+        }
+
+    }
+
+}
@@ -0,0 +1,30 @@
+//
+// Created by ChenXin on 2022/11/11.
+//
+
+#pragma once
+
+#include <core/stl.h>
+#include <base/mesh_cache.h>
+
+namespace gl_render {
+
+    namespace impl {
+
+        /// Mesh cache key flags of meshes parsed by load_obj, in place of the Assimp post-process flags
+        constexpr uint OBJ_LOADER_FLAGS = 0x80000001u;
+        /// Files are only split into chunks of at least this many bytes
+        constexpr size_t OBJ_MIN_CHUNK_SIZE = 1024u * 1024u;
+
+        [[nodiscard]] bool is_obj_file(const path &mesh_path) noexcept;
+
+        /// Parse a Wavefront OBJ file into world-space streams, with the same output as the Assimp import:
+        /// polygons are fan-triangulated, vertices without a normal get the flat normal of their face,
+        /// vertices without texture coordinates get z = -1. The file is parsed in up to thread_count chunks
+        /// in parallel. Returns false (with data left empty) if the file is malformed.
+        [[nodiscard]] bool load_obj(span<const std::byte> source, const float4x4 &transform, MeshData &data,
+                                    uint thread_count = 1u) noexcept;
+
+    }
+
+}
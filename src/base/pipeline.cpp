@@ -4,55 +4,71 @@
 
 #include <base/pipeline.h>
 
+#include <chrono>
 #include <fstream>
+#include <iterator>
 
-#include <nlohmann/json.hpp>
 #include <stb/stb_image_write.h>
 //#include <imgui/imgui.h>
 //#include <imgui/backends/imgui_impl_glfw.h>
 //#include <imgui/backends/imgui_impl_opengl3.h>
 
 #include <core/logger.h>
+#include <core/profiler.h>
 #include <base/shader.h>
 #include <base/camera.h>
+#include <base/scene_diff.h>
 #include <util/imageio.h>
 #include <core/util.h>
 
 namespace gl_render {
 
-    Pipeline::Pipeline(const path &scene_path) noexcept {
+    Pipeline::Pipeline(const path &scene_path, const Config &config) noexcept
+            : _config{config}, _scene_path{scene_path}, _load_begin{std::chrono::steady_clock::now()} {
+        GL_RENDER_PROFILE_SCOPE("Pipeline::Pipeline", "pipeline", scene_path.string());
         // load scene
-        nlohmann::json scene_json = nlohmann::json::parse(std::ifstream{scene_path});
-        _scene = make_unique<SceneAllNode>(scene_json);
-        const auto &camera_info = _scene->scene_all_info.camera->camera_info;
-        _config.renderer_info = _scene->scene_all_info.renderer->renderer_info;
+        if (SceneArchive::is_archive(scene_path)) {
+            _archive = make_unique<SceneArchive>(scene_path);
+            _scene = SceneParser::parse(_archive->scene_description());
+            // archives are immutable snapshots, there is nothing to watch
+            _config.watch_config.enable = false;
+        } else {
+            std::error_code ec;
+            _scene_write_time = std::filesystem::last_write_time(scene_path, ec);
+            _scene = SceneParser::parse(scene_path);
+        }
+        const auto &camera_info = *_scene->camera;
+        _config.renderer_info = *_scene->renderer;
         if (_config.renderer_info.output_file.is_relative()) {
             _config.renderer_info.output_file = scene_path.parent_path() / _config.renderer_info.output_file;
         }
         int width = static_cast<int>(camera_info.resolution.x);
         int height = static_cast<int>(camera_info.resolution.y);
 
-        // glfw init
-        glfwInit();
-        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
-        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        {
+            GL_RENDER_PROFILE_SCOPE("create window", "pipeline");
+            // glfw init
+            glfwInit();
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+            glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 //        glfwWindowHint(GLFW_SRGB_CAPABLE, 1);
-        // glfw window creation
-        // ====================
-        glfwWindowHint(GLFW_SAMPLES, 4);
-        _window = glfwCreateWindow(width, height, "OpenGL-Render", nullptr, nullptr);
-        if (_window == nullptr) {
-            glfwTerminate();
-            GL_RENDER_ERROR_WITH_LOCATION("Failed to create GLFW window");
-        }
-        glfwMakeContextCurrent(_window);
-        glfwSwapInterval(_config.renderer_info.enable_vsync);    // handle vsync
+            // glfw window creation
+            // ====================
+            glfwWindowHint(GLFW_SAMPLES, 4);
+            _window = glfwCreateWindow(width, height, "OpenGL-Render", nullptr, nullptr);
+            if (_window == nullptr) {
+                glfwTerminate();
+                GL_RENDER_ERROR_WITH_LOCATION("Failed to create GLFW window");
+            }
+            glfwMakeContextCurrent(_window);
+            glfwSwapInterval(_config.renderer_info.enable_vsync);    // handle vsync
 
-        // glad: load all OpenGL function pointers
-        // =======================================
-        if (gladLoadGL() == 0) {
-            GL_RENDER_ERROR_WITH_LOCATION("Failed to initialize GLAD");
+            // glad: load all OpenGL function pointers
+            // =======================================
+            if (gladLoadGL() == 0) {
+                GL_RENDER_ERROR_WITH_LOCATION("Failed to initialize GLAD");
+            }
         }
 
         glEnable(GL_DEPTH_TEST);
@@ -75,17 +91,98 @@ namespace gl_render {
 //        ImGui_ImplOpenGL3_Init(glsl_version);
 
         // init HDR2LDR
-        _hdr2ldr = make_unique<HDR2LDR>(_scene->scene_all_info.camera->camera_info.resolution, _hdr_frame_buffer);
+        _hdr2ldr = make_unique<HDR2LDR>(_scene->camera->resolution, _hdr_frame_buffer);
         // init geometry
-        _geometry = make_unique<Geometry>(_scene->scene_all_info, scene_path.parent_path());
+        _geometry = make_unique<Geometry>(*_scene, scene_path.parent_path(), _config.geometry_config, _archive.get());
         // init light manager
-        auto vertex_positions = _geometry->vertex_positions_flattened();
-        _lightManager = make_unique<LightManager>(vertex_positions);
-        for (auto &light : _scene->scene_all_info.lights) {
-            _lightManager->addLight(&light.light_info, _config.renderer_info.shadow_map_resolution);
+        GL_RENDER_PROFILE_SCOPE("create lights", "shadow");
+        DepthCubeMap::set_compact_positions(_config.geometry_config.enable_compact_vertices);
+        DepthCubeMap::set_scene([geometry = _geometry.get()](const Shader &shader) { geometry->shadow(shader); });
+        _lightManager = make_unique<LightManager>();
+        for (auto &light : _scene->lights) {
+            _lightManager->addLight(light, _config.renderer_info.shadow_map_resolution);
         }
     }
 
+    bool Pipeline::_reload_scene() noexcept {
+        std::error_code ec;
+        auto write_time = std::filesystem::last_write_time(_scene_path, ec);
+        if (ec || write_time == _scene_write_time) {
+            return false;
+        }
+        _scene_write_time = write_time;
+
+        GL_RENDER_PROFILE_SCOPE("reload scene", "reload", _scene_path.string());
+        auto reload_begin = std::chrono::steady_clock::now();
+        // editors may save in several writes, an invalid file is skipped until its next change
+        string scene_json;
+        {
+            std::ifstream file{_scene_path, std::ios::binary};
+            scene_json.assign(std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{});
+        }
+        string error;
+        auto scene = SceneParser::try_parse(string_view{scene_json}, error);
+        if (scene == nullptr) {
+            GL_RENDER_WARNING("Scene \"{}\" is invalid, keeping the current scene: {}", _scene_path.string(), error);
+            return false;
+        }
+        auto diff = diff_scenes(*_scene, *scene);
+        if (diff.empty()) {
+            GL_RENDER_INFO("Scene \"{}\" changed on disk, nothing to update", _scene_path.string());
+            return false;
+        }
+
+        // rebuilt groups are drawn into the shadow maps as soon as they are ready, like progressively loaded ones
+        _geometry->update(*scene, diff);
+
+        auto renderer_info = *scene->renderer;
+        if (renderer_info.output_file.is_relative()) {
+            renderer_info.output_file = _scene_path.parent_path() / renderer_info.output_file;
+        }
+        if (renderer_info.enable_vsync != _config.renderer_info.enable_vsync) {
+            glfwSwapInterval(renderer_info.enable_vsync);
+        }
+        // lights keep their shadow maps unless they are removed or the shadow map resolution changed
+        auto shadow_resolution = renderer_info.shadow_map_resolution;
+        if (shadow_resolution != _config.renderer_info.shadow_map_resolution) {
+            while (!_lightManager->lights().empty()) {
+                _lightManager->removeLight();
+            }
+        }
+        while (_lightManager->lights().size() > scene->lights.size()) {
+            _lightManager->removeLight();
+        }
+        for (auto index: diff.changed_lights) {
+            if (index < _lightManager->lights().size()) {
+                _lightManager->updateLight(index, scene->lights[index]);
+            }
+        }
+        for (auto index = _lightManager->lights().size(); index < scene->lights.size(); ++index) {
+            _lightManager->addLight(scene->lights[index], shadow_resolution);
+        }
+        if (scene->camera->resolution != _scene->camera->resolution) {
+            GL_RENDER_WARNING("Camera resolution changes take effect after a restart");
+        }
+        _config.renderer_info = renderer_info;
+        _scene = std::move(scene);
+
+        // wait for the uploads, so the latency covers everything the next frame would otherwise stall on
+        glFinish();
+        auto reload_end = std::chrono::steady_clock::now();
+        GL_RENDER_INFO(
+                "Reloaded scene \"{}\" in {} ms: {} of {} group(s) rebuilt, {} material(s) recolored, "
+                "{} light(s) changed{}{}",
+                _scene_path.string(),
+                std::chrono::duration<double, std::milli>(reload_end - reload_begin).count(),
+                diff.changed_groups.size(),
+                _geometry->group_count(),
+                diff.changed_materials.size(),
+                diff.changed_lights.size(),
+                diff.light_count_changed ? ", light count changed (shaders recompiled)" : "",
+                diff.camera_changed ? ", camera changed" : "");
+        return true;
+    }
+
     void Pipeline::render() noexcept {
         gl_render::queue<double> frame_time;
         double last_fps_time = glfwGetTime();
@@ -94,23 +191,111 @@ namespace gl_render {
         const size_t frame_min_size = 60u;
         double print_time = 0.f;
         size_t frame_index = 0u;
+        // CPU time spent culling and issuing the draws, summed over the frames since the last print
+        double submission_time_sum = 0.0;
+        size_t submission_frame_count = 0u;
+        // frames of the benchmark, counted from the end of the loading
+        const auto &benchmark = _config.benchmark_config;
+        size_t benchmark_frame_count = 0u;
+        double benchmark_frame_time = 0.0;
+        double benchmark_submission_time = 0.0;
+        double benchmark_cull_time = 0.0;
+        impl::TransformUpload benchmark_transforms;
         auto clear_color = float3(0.45f, 0.55f, 0.60f);
 
-        const auto &camera_info = _scene->scene_all_info.camera->camera_info;
-        int width = static_cast<int>(camera_info.resolution.x);
-        int height = static_cast<int>(camera_info.resolution.y);
-        float near_plane = 0.001f;
-        float far_plane = util::get_far_plane(camera_info.position, camera_info.front, _geometry->aabb()) * 1.1f;
-        Camera camera{camera_info.position, camera_info.front, camera_info.up, camera_info.fov};
-        auto view_matrix = camera.view_matrix();
-        auto projection = perspective(
-                radians(camera_info.fov),
-                static_cast<float>(width) / static_cast<float>(height),
-                near_plane, far_plane);
+        // the window and the framebuffers keep the initial resolution
+        int width = static_cast<int>(_scene->camera->resolution.x);
+        int height = static_cast<int>(_scene->camera->resolution.y);
+        const float min_near_plane = 0.001f;
+        // used until the first group is resident, the bounds of the geometry are empty before
+        const float empty_far_plane = 1000.f;
+        auto bounds_empty = true;
+        float near_plane;
+        float far_plane;
+        float shadow_far_plane;
+        float3 camera_position;
+        float4x4 view_matrix;
+        float4x4 projection;
+        // the depth range also depends on the geometry, so this is redone after every reload
+        auto update_camera = [&] {
+            const auto &camera_info = *_scene->camera;
+            // shadows are cast from outside the view as well, their range covers the whole scene
+            bounds_empty = _geometry->aabb().empty();
+            shadow_far_plane = bounds_empty ?
+                               empty_far_plane :
+                               util::get_far_plane(camera_info.position, camera_info.front, _geometry->aabb()) * 1.1f;
+            Camera camera{camera_info.position, camera_info.front, camera_info.up, camera_info.fov};
+            camera_position = camera_info.position;
+            view_matrix = camera.view_matrix();
+            auto aspect = static_cast<float>(width) / static_cast<float>(height);
+            // the planes are fitted to the bounds of the meshes in view, for depth precision
+            near_plane = min_near_plane;
+            far_plane = shadow_far_plane;
+            auto view_projection = perspective(radians(camera_info.fov), aspect, near_plane, far_plane) * view_matrix;
+            if (auto range = _geometry->depth_range(view_projection, camera_position, normalize(camera_info.front))) {
+                near_plane = max(range->x * 0.9f, min_near_plane);
+                far_plane = max(range->y * 1.1f, near_plane * 2.f);
+            }
+            projection = perspective(radians(camera_info.fov), aspect, near_plane, far_plane);
+            _geometry->select_lods(camera_info.position, camera_info.fov, static_cast<float>(height));
+        };
+        update_camera();
+        auto lod_policy = _config.geometry_config.enable_lods ?
+                          format("LOD error <= {} px", _config.geometry_config.lod_error_threshold) :
+                          string{"full detail"};
+        double last_watch_time = glfwGetTime();
+        // the depth range is fitted to the bounds of all meshes, so it is refreshed at most this often
+        // while groups keep arriving or objects move
+        const double bounds_refresh_interval = 0.25;
+        double last_bounds_refresh = glfwGetTime();
+        auto geometry_revision = _geometry->revision();
+        auto milliseconds_since_load_begin = [this] {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _load_begin).count();
+        };
 
         while (!glfwWindowShouldClose(_window)) {
+            auto frame_begin = std::chrono::steady_clock::now();
             glfwPollEvents();
 
+            // 0. upload the meshes loaded since the last frame and the objects moved, refresh what depends on
+            // the resident geometry
+            if (_geometry->loading() && _geometry->load()) {
+                GL_RENDER_INFO("Full scene after {} ms ({} groups)", milliseconds_since_load_begin(), _geometry->group_count());
+            }
+            auto transform_begin = std::chrono::steady_clock::now();
+            if (benchmark.moved_objects != 0u && !_geometry->loading()) {
+                // a degree per frame; baked objects cannot move and are not counted
+                auto rotation = glm::rotate(constant::IDENTITY_FLOAT4x4, radians(static_cast<float>(frame_index)),
+                                            float3{0.f, 1.f, 0.f});
+                auto moved = 0u;
+                for (auto index = 0ul; index < _scene->meshes.size() && moved < benchmark.moved_objects; ++index) {
+                    const auto &mesh = _scene->meshes[index];
+                    for (auto instance = 0ul; instance < mesh.instance_count() && moved < benchmark.moved_objects; ++instance) {
+                        if (_geometry->set_transform(index, instance, mesh.world_transform(instance) * rotation)) {
+                            ++moved;
+                        }
+                    }
+                }
+            }
+            auto transform_upload = _geometry->upload_transforms();
+            transform_upload.time = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - transform_begin).count();
+            auto settled = !_geometry->loading() && transform_upload.instance_count == 0u;
+            if (_geometry->revision() != geometry_revision &&
+                (settled || bounds_empty || glfwGetTime() - last_bounds_refresh >= bounds_refresh_interval)) {
+                geometry_revision = _geometry->revision();
+                last_bounds_refresh = glfwGetTime();
+                update_camera();
+            }
+
+            if (_config.watch_config.enable && !_geometry->loading() &&
+                glfwGetTime() - last_watch_time >= _config.watch_config.interval) {
+                last_watch_time = glfwGetTime();
+                if (_reload_scene()) {
+                    update_camera();
+                }
+            }
+
 //            // Start the Dear ImGui frame
 //            ImGui_ImplOpenGL3_NewFrame();
 //            ImGui_ImplGlfw_NewFrame();
@@ -126,7 +311,7 @@ namespace gl_render {
 
             // 1. render shadow map
             _lightManager->enable_shadow = _config.renderer_info.enable_shadow;
-            _lightManager->renderShadow(far_plane);
+            _lightManager->renderShadow(shadow_far_plane);
             if (auto error = glGetError(); error != GL_NO_ERROR) {
                 GL_RENDER_ERROR_WITH_LOCATION("OpenGL shadow map error: {}", error);
             }
@@ -136,7 +321,13 @@ namespace gl_render {
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
             glClearColor(clear_color.x, clear_color.y, clear_color.z, 1.0f);
             glViewport(0, 0, width, height);
-            _geometry->render(_lightManager.get(), projection, view_matrix, camera_info.position);
+            auto submission_begin = std::chrono::steady_clock::now();
+            auto cull_time = _geometry->cull(projection * view_matrix, camera_position).time;
+            _geometry->render(_lightManager.get(), projection, view_matrix, camera_position);
+            auto submission_time = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - submission_begin).count();
+            submission_time_sum += submission_time;
+            ++submission_frame_count;
             if (auto error = glGetError(); error != GL_NO_ERROR) {
                 GL_RENDER_ERROR_WITH_LOCATION("OpenGL render error: {}", error);
             }
@@ -147,6 +338,10 @@ namespace gl_render {
                 GL_RENDER_ERROR_WITH_LOCATION("OpenGL hdr2ldr error: {}", error);
             }
 
+            // the statistics below may wait for the GPU, they are not part of the frame
+            auto frame_cpu_time = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - frame_begin).count();
+
             // calculate fps
             frame_index++;
             double current_time = glfwGetTime();
@@ -162,14 +357,58 @@ namespace gl_render {
             print_time += delta_time;
             if (print_time >= fps_count_time) {
                 print_time = 0.f;
+                const auto &culling = _geometry->cull_statistics();
                 GL_RENDER_INFO(
-                        "Frame {}, FPS: {}, SPF: {}",
+                        "Frame {}, FPS: {}, SPF: {}, {} triangles submitted ({}), "
+                        "{} of {} meshes and {} of {} meshlets drawn, culling {:.3f} ms, CPU submission {:.3f} ms",
                         frame_index,
                         1.0 / fps_time_sum * frame_time.size(),
-                        fps_time_sum / frame_time.size());
+                        fps_time_sum / frame_time.size(),
+                        culling.submitted_triangle_count,
+                        lod_policy,
+                        culling.visible_mesh_count,
+                        culling.mesh_count,
+                        culling.visible_meshlet_count,
+                        culling.meshlet_count,
+                        culling.time,
+                        submission_time_sum / static_cast<double>(submission_frame_count));
+                submission_time_sum = 0.0;
+                submission_frame_count = 0u;
+            }
+
+            if (benchmark.frames != 0u && !_geometry->loading()) {
+                benchmark_frame_time += frame_cpu_time;
+                benchmark_submission_time += submission_time;
+                benchmark_cull_time += cull_time;
+                benchmark_transforms += transform_upload;
+                if (++benchmark_frame_count == benchmark.frames) {
+                    auto frames = static_cast<double>(benchmark_frame_count);
+                    GL_RENDER_INFO(
+                            "Benchmark: {} frames, {} meshes in {} groups, {} culling: "
+                            "CPU frame {:.3f} ms, submission {:.3f} ms, culling {:.3f} ms; "
+                            "per frame {:.0f} objects moved, {:.1f} KB of transforms in {:.1f} upload(s), {:.3f} ms",
+                            benchmark_frame_count,
+                            _geometry->cull_statistics().mesh_count,
+                            _geometry->ready_group_count(),
+                            _config.geometry_config.enable_gpu_culling ? "GPU" : "CPU",
+                            benchmark_frame_time / frames,
+                            benchmark_submission_time / frames,
+                            benchmark_cull_time / frames,
+                            static_cast<double>(benchmark_transforms.instance_count) / frames,
+                            static_cast<double>(benchmark_transforms.bytes) / 1024.0 / frames,
+                            static_cast<double>(benchmark_transforms.range_count) / frames,
+                            benchmark_transforms.time / frames);
+                    glfwSetWindowShouldClose(_window, GLFW_TRUE);
+                }
             }
 
             glfwSwapBuffers(_window);
+            if (frame_index == 1u) {
+                GL_RENDER_INFO(
+                        "First frame after {} ms ({} groups resident{})",
+                        milliseconds_since_load_begin(), _geometry->ready_group_count(),
+                        _geometry->loading() ? ", scene still loading" : "");
+            }
         }
 
         // save to file
@@ -4,12 +4,15 @@
 
 #pragma once
 
+#include <chrono>
+
 #include <glad/glad.h>
 #include <glfw/glfw3.h>
 
 #include <core/logger.h>
 #include <core/stl.h>
 #include <base/scene_parser.h>
+#include <base/scene_archive.h>
 #include <base/geometry.h>
 #include <base/hdr2ldr.h>
 #include <util/imageio.h>
@@ -17,16 +20,36 @@
 
 namespace gl_render {
 
+    struct SceneWatchConfig {
+        /// reload a json scene when its file changes, only the affected parts are rebuilt
+        bool enable = true;
+        /// seconds between checks of the scene file
+        double interval = 0.5;
+    };
+
+    struct BenchmarkConfig {
+        /// once the scene is fully loaded, render this many frames, log their average CPU times and close;
+        /// 0 to render until the window is closed
+        uint frames = 0u;
+        /// movable objects, in scene order, spun about their own y axis every frame once the scene is loaded,
+        /// with or without a frame count; their transforms are uploaded each frame, the vertices stay where they are
+        uint moved_objects = 0u;
+    };
+
     class Pipeline {
 
     public:
         struct Config {
             RendererInfo renderer_info;
             HDRConfig hdr_config;
+            GeometryConfig geometry_config;
+            SceneWatchConfig watch_config;
+            BenchmarkConfig benchmark_config;
         };
 
-        static Pipeline& GetInstance(const path &scene_path) noexcept {
-            static Pipeline pipeline{scene_path};
+        /// scene_path is either a json scene description or a scene archive packed from one
+        static Pipeline& GetInstance(const path &scene_path, const Config &config = {}) noexcept {
+            static Pipeline pipeline{scene_path, config};
             return pipeline;
         }
         void render() noexcept;
@@ -36,13 +59,21 @@ namespace gl_render {
         Pipeline &operator=(const Pipeline &) = delete;
 
     private:
-        explicit Pipeline(const path &scene_path) noexcept;
+        explicit Pipeline(const path &scene_path, const Config &config) noexcept;
+
+        /// Reload the scene if its file changed since the last call, returns whether anything was updated
+        bool _reload_scene() noexcept;
 
     private:
         GLFWwindow *_window;
         Config _config;
+        path _scene_path;
+        std::filesystem::file_time_type _scene_write_time;
+        /// start of the scene loading, time to first frame and to full scene are measured from here
+        std::chrono::steady_clock::time_point _load_begin;
 
-        gl_render::unique_ptr<SceneAllNode> _scene;
+        gl_render::unique_ptr<SceneArchive> _archive;
+        gl_render::unique_ptr<SceneAllInfo> _scene;
         gl_render::unique_ptr<Geometry> _geometry;
         gl_render::unique_ptr<HDR2LDR> _hdr2ldr;
         gl_render::unique_ptr<LightManager> _lightManager;
@@ -0,0 +1,398 @@
+//
+// Created by ChenXin on 2022/11/9.
+//
+
+#include <base/scene_archive.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+
+#include <nlohmann/json.hpp>
+
+#include <core/logger.h>
+#include <core/profiler.h>
+#include <core/thread_pool.h>
+#include <base/geometry.h>
+#include <base/scene_parser.h>
+#include <util/imageio.h>
+
+namespace gl_render {
+
+    namespace impl {
+
+        struct ArchiveHeader {
+            uint32_t magic;
+            uint32_t version;
+            uint64_t file_size;
+            uint64_t section_count;
+            uint64_t table_offset;
+            uint64_t names_offset;
+            uint64_t names_size;
+        };
+        static_assert(sizeof(ArchiveHeader) <= SceneArchive::HEADER_SIZE);
+
+        struct ArchiveSection {
+            uint32_t type;
+            uint32_t pixel_storage;     // TEXTURE only
+            uint64_t offset;
+            uint64_t size;
+            uint64_t name_offset;       // relative to the names blob
+            uint64_t name_size;
+            uint32_t resolution[2];     // TEXTURE only
+            float aabb_min[3];          // MESH only
+            float aabb_max[3];          // MESH only
+            uint64_t vertex_count;      // MESH only
+            uint64_t lod_count;         // MESH only, the payload ends with this many impl::MeshLod
+        };
+
+        [[nodiscard]] static constexpr auto align_up(uint64_t offset) noexcept {
+            return (offset + SceneArchive::ALIGNMENT - 1u) / SceneArchive::ALIGNMENT * SceneArchive::ALIGNMENT;
+        }
+
+        class ArchiveWriter {
+
+        private:
+            std::ofstream _file;
+            uint64_t _offset{0u};
+            gl_render::vector<ArchiveSection> _sections;
+            gl_render::string _names;
+
+        public:
+            explicit ArchiveWriter(const path &archive_path) noexcept
+                    : _file{archive_path, std::ios::binary | std::ios::trunc} {
+                GL_RENDER_ASSERT(_file.is_open(), "Failed to open \"{}\" for writing", archive_path.string());
+                // the header is written last, once the table offset is known
+                _pad(SceneArchive::HEADER_SIZE);
+            }
+
+            /// Another table entry for the payload of section index
+            void alias_section(size_t index, string_view name) noexcept {
+                auto section = _sections[index];
+                section.name_offset = _names.size();
+                section.name_size = name.size();
+                _names.append(name);
+                _sections.emplace_back(section);
+            }
+
+            [[nodiscard]] auto section_count() const noexcept { return _sections.size(); }
+
+            ArchiveSection &begin_section(SceneArchive::SectionType type, string_view name) noexcept {
+                _pad(align_up(_offset));
+                auto &section = _sections.emplace_back();
+                section.type = static_cast<uint32_t>(type);
+                section.offset = _offset;
+                section.name_offset = _names.size();
+                section.name_size = name.size();
+                _names.append(name);
+                return section;
+            }
+
+            void write(const void *data, size_t size) noexcept {
+                _file.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+                _offset += size;
+                _sections.back().size += size;
+            }
+
+            [[nodiscard]] auto size() const noexcept { return _offset; }
+
+            void finish() noexcept {
+                ArchiveHeader header{};
+                header.magic = SceneArchive::MAGIC;
+                header.version = SceneArchive::VERSION;
+                header.section_count = _sections.size();
+                header.names_offset = _offset;
+                header.names_size = _names.size();
+                _file.write(_names.data(), static_cast<std::streamsize>(_names.size()));
+                _offset += _names.size();
+                _pad(align_up(_offset));
+                header.table_offset = _offset;
+                _file.write(reinterpret_cast<const char *>(_sections.data()),
+                            static_cast<std::streamsize>(_sections.size() * sizeof(ArchiveSection)));
+                _offset += _sections.size() * sizeof(ArchiveSection);
+                header.file_size = _offset;
+
+                _file.seekp(0);
+                _file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+                _file.close();
+                GL_RENDER_ASSERT(!_file.fail(), "Failed to write the scene archive");
+            }
+
+        private:
+            void _pad(uint64_t offset) noexcept {
+                static constexpr std::array<char, SceneArchive::ALIGNMENT> zeros{};
+                while (_offset < offset) {
+                    auto size = std::min<uint64_t>(offset - _offset, zeros.size());
+                    _file.write(zeros.data(), static_cast<std::streamsize>(size));
+                    _offset += size;
+                }
+            }
+        };
+
+        [[nodiscard]] static auto to_json(const float3 &v) noexcept {
+            return nlohmann::json::array({v.x, v.y, v.z});
+        }
+
+        [[nodiscard]] static auto to_json(const float4x4 &m) noexcept {
+            auto matrix = nlohmann::json::array();
+            for (auto i = 0u; i < 4u; ++i) {
+                for (auto j = 0u; j < 4u; ++j) {
+                    matrix.push_back(m[i][j]);
+                }
+            }
+            return nlohmann::json{{"matrix", std::move(matrix)}};
+        }
+
+        /// Scene description with every default filled in and transforms reduced to matrices
+        [[nodiscard]] static nlohmann::json serialize_scene(const SceneAllInfo &scene) noexcept {
+            nlohmann::json json;
+            // sorted by name so that packing the same scene twice gives the same archive
+            gl_render::vector<const MaterialInfo *> materials;
+            for (const auto &[name, material]: scene.materials) {
+                materials.emplace_back(material.get());
+            }
+            std::sort(materials.begin(), materials.end(), [](auto lhs, auto rhs) { return lhs->name < rhs->name; });
+            json["materials"] = nlohmann::json::array();
+            for (auto material: materials) {
+                json["materials"].push_back({
+                        {"type", MaterialInfo::Type2String(material->type)},
+                        {"name", material->name},
+                        {"diffuse", to_json(material->diffuse)},
+                        {"specular", to_json(material->specular)},
+                        {"ambient", to_json(material->ambient)},
+                        {"diffuse_map", material->diffuse_map.string()}});
+            }
+            json["meshes"] = nlohmann::json::array();
+            for (const auto &mesh: scene.meshes) {
+                nlohmann::json entry{
+                        {"file", mesh.file_path.string()},
+                        {"material", mesh.material_name},
+                        {"transform", to_json(mesh.transform)}};
+                if (!mesh.instances.empty()) {
+                    entry["instances"] = nlohmann::json::array();
+                    for (const auto &instance: mesh.instances) {
+                        entry["instances"].push_back(to_json(instance));
+                    }
+                }
+                json["meshes"].push_back(std::move(entry));
+            }
+            json["lights"] = nlohmann::json::array();
+            for (const auto &light: scene.lights) {
+                json["lights"].push_back({
+                        {"position", to_json(light.position)},
+                        {"emission", to_json(light.emission)}});
+            }
+            const auto &camera = *scene.camera;
+            json["camera"] = {
+                    {"resolution", {camera.resolution.x, camera.resolution.y}},
+                    {"position", to_json(camera.position)},
+                    {"front", to_json(camera.front)},
+                    {"up", to_json(camera.up)},
+                    {"fov", camera.fov}};
+            const auto &renderer = *scene.renderer;
+            json["renderer"] = {
+                    {"enable_vsync", renderer.enable_vsync},
+                    {"enable_shadow", renderer.enable_shadow},
+                    {"output_file", renderer.output_file.string()}};
+            return json;
+        }
+
+    }
+
+    SceneArchive::SceneArchive(const path &archive_path) noexcept: _file{archive_path} {
+        GL_RENDER_PROFILE_SCOPE("map scene archive", "scene", archive_path.string());
+        GL_RENDER_ASSERT(_file.valid() && _file.size() >= HEADER_SIZE,
+                         "Failed to read scene archive \"{}\"", archive_path.string());
+        impl::ArchiveHeader header{};
+        std::memcpy(&header, _file.data(), sizeof(header));
+        GL_RENDER_ASSERT(header.magic == MAGIC && header.version == VERSION && header.file_size == _file.size(),
+                         "\"{}\" is not a scene archive of version {}", archive_path.string(), VERSION);
+        GL_RENDER_ASSERT(header.table_offset % alignof(impl::ArchiveSection) == 0u &&
+                         header.table_offset + header.section_count * sizeof(impl::ArchiveSection) <= _file.size() &&
+                         header.names_offset + header.names_size <= _file.size(),
+                         "Corrupted scene archive \"{}\"", archive_path.string());
+
+        _sections = {reinterpret_cast<const impl::ArchiveSection *>(_file.data() + header.table_offset),
+                     static_cast<size_t>(header.section_count)};
+        auto names = reinterpret_cast<const char *>(_file.data() + header.names_offset);
+        for (const auto &section: _sections) {
+            GL_RENDER_ASSERT(section.offset + section.size <= _file.size() &&
+                             section.name_offset + section.name_size <= header.names_size,
+                             "Corrupted scene archive \"{}\"", archive_path.string());
+            auto payload = _file.data() + section.offset;
+            switch (static_cast<SectionType>(section.type)) {
+                case SectionType::SCENE:
+                    _scene_description = {reinterpret_cast<const char *>(payload), section.size};
+                    break;
+                case SectionType::MESH:
+                    GL_RENDER_ASSERT(section.size >= section.vertex_count * sizeof(float3) * 3u +
+                                                     section.lod_count * sizeof(impl::MeshLod) &&
+                                     (section.size - section.vertex_count * sizeof(float3) * 3u -
+                                      section.lod_count * sizeof(impl::MeshLod)) % (sizeof(uint) * 3u) == 0u,
+                                     "Corrupted mesh section in scene archive \"{}\"", archive_path.string());
+                    _meshes.emplace_back(&section);
+                    break;
+                case SectionType::TEXTURE:
+                    GL_RENDER_ASSERT(section.size == static_cast<uint64_t>(section.resolution[0]) * section.resolution[1] *
+                                                     pixel_storage_size(static_cast<PixelStorage>(section.pixel_storage)),
+                                     "Corrupted texture section in scene archive \"{}\"", archive_path.string());
+                    _textures.emplace(string{names + section.name_offset, section.name_size}, &section);
+                    break;
+                default:
+                    GL_RENDER_WARNING("Skipping unknown section type {} in scene archive \"{}\"",
+                                      section.type, archive_path.string());
+                    break;
+            }
+        }
+        GL_RENDER_ASSERT(!_scene_description.empty(), "Scene archive \"{}\" has no scene description",
+                         archive_path.string());
+        GL_RENDER_INFO(
+                "Mapped scene archive \"{}\": {} meshes, {} textures, {} MB",
+                archive_path.string(), _meshes.size(), _textures.size(),
+                static_cast<double>(_file.size()) / (1024.0 * 1024.0));
+    }
+
+    bool SceneArchive::is_archive(const path &file_path) noexcept {
+        std::ifstream file{file_path, std::ios::binary};
+        uint32_t magic = 0u;
+        file.read(reinterpret_cast<char *>(&magic), sizeof(magic));
+        return file.good() && magic == MAGIC;
+    }
+
+    bool SceneArchive::mesh(size_t index, impl::MeshData &data) const noexcept {
+        if (index >= _meshes.size()) {
+            return false;
+        }
+        auto section = _meshes[index];
+        auto streams = reinterpret_cast<const float3 *>(_file.data() + section->offset);
+        auto vertex_count = static_cast<size_t>(section->vertex_count);
+        auto lod_count = static_cast<size_t>(section->lod_count);
+        auto index_count = static_cast<size_t>(
+                (section->size - vertex_count * sizeof(float3) * 3u - lod_count * sizeof(impl::MeshLod)) / sizeof(uint));
+        data.positions = {streams, vertex_count};
+        data.normals = {streams + vertex_count, vertex_count};
+        data.tex_coords = {streams + vertex_count * 2u, vertex_count};
+        data.indices = {reinterpret_cast<const uint *>(streams + vertex_count * 3u), index_count};
+        data.lods = {reinterpret_cast<const impl::MeshLod *>(data.indices.data() + index_count), lod_count};
+        data.aabb.min = float3{section->aabb_min[0], section->aabb_min[1], section->aabb_min[2]};
+        data.aabb.max = float3{section->aabb_max[0], section->aabb_max[1], section->aabb_max[2]};
+        // checked here rather than when the archive is mapped, so that the indices are only paged in by the
+        // worker loading the mesh
+        GL_RENDER_ASSERT(data.in_bounds(), "Corrupted scene archive: mesh section {} has indices or levels of "
+                                           "detail out of range", index);
+        return true;
+    }
+
+    optional<SceneArchive::TextureView> SceneArchive::texture(const string &name) const noexcept {
+        auto iter = _textures.find(name);
+        if (iter == _textures.end()) {
+            return nullopt;
+        }
+        auto section = iter->second;
+        return TextureView{
+                uint2{section->resolution[0], section->resolution[1]},
+                static_cast<PixelStorage>(section->pixel_storage),
+                _file.data() + section->offset};
+    }
+
+    void SceneArchive::pack(const path &scene_path, const path &archive_path, uint thread_count) noexcept {
+        auto pack_begin = std::chrono::steady_clock::now();
+        auto scene = SceneParser::parse(scene_path);
+        auto scene_dir = scene_path.parent_path();
+        impl::ArchiveWriter writer{archive_path};
+
+        auto description = impl::serialize_scene(*scene).dump();
+        writer.begin_section(SectionType::SCENE, "scene");
+        writer.write(description.data(), description.size());
+
+        // meshes are imported in parallel a batch at a time, so only a few of them are held in memory;
+        // a shared file is imported once in object space, the other meshes referencing it alias its section
+        ThreadPool thread_pool{thread_count};
+        auto mesh_count = scene->meshes.size();
+        auto instancing = impl::find_mesh_instancing(*scene, true);
+        gl_render::vector<size_t> mesh_sections(mesh_count);
+        auto batch_size = static_cast<size_t>(thread_pool.size()) * 4u;
+        gl_render::vector<impl::MeshData> batch;
+        for (auto first = 0ul; first < mesh_count; first += batch_size) {
+            auto count = std::min(batch_size, mesh_count - first);
+            batch.clear();
+            batch.resize(count);
+            thread_pool.parallel_for(count, [&](size_t i) {
+                auto index = first + i;
+                if (instancing.source[index] != index) {
+                    return;
+                }
+                const auto &mesh = scene->meshes[index];
+                auto mesh_path = mesh.file_path.is_relative() ? scene_dir / mesh.file_path : mesh.file_path;
+                auto transform = instancing.instanced(index) ? constant::IDENTITY_FLOAT4x4 : mesh.world_transform(0u);
+                MappedFile source{mesh_path};
+                GL_RENDER_ASSERT(source.valid(), "Failed to read mesh \"{}\"", mesh_path.string());
+                impl::load_mesh_file(mesh_path, source.bytes(), transform, batch[i], true, true, true);
+            });
+            for (auto i = 0ul; i < count; ++i) {
+                auto index = first + i;
+                auto name = scene->meshes[index].file_path.string();
+                if (auto source = instancing.source[index]; source != index) {
+                    mesh_sections[index] = writer.section_count();
+                    writer.alias_section(mesh_sections[source], name);
+                    continue;
+                }
+                const auto &data = batch[i];
+                mesh_sections[index] = writer.section_count();
+                auto &section = writer.begin_section(SectionType::MESH, name);
+                for (auto k = 0u; k < 3u; ++k) {
+                    section.aabb_min[k] = data.aabb.min[k];
+                    section.aabb_max[k] = data.aabb.max[k];
+                }
+                section.vertex_count = data.vertex_count();
+                section.lod_count = data.lods.size();
+                writer.write(data.positions.data(), data.positions.size_bytes());
+                writer.write(data.normals.data(), data.normals.size_bytes());
+                writer.write(data.tex_coords.data(), data.tex_coords.size_bytes());
+                writer.write(data.indices.data(), data.indices.size_bytes());
+                writer.write(data.lods.data(), data.lods.size_bytes());
+            }
+        }
+
+        // textures are stored decoded, so the runtime passes them to glTexImage2D as they are
+        gl_render::vector<string> texture_names;
+        for (const auto &[name, material]: scene->materials) {
+            if (!material->diffuse_map.empty()) {
+                texture_names.emplace_back(material->diffuse_map.string());
+            }
+        }
+        std::sort(texture_names.begin(), texture_names.end());
+        texture_names.erase(std::unique(texture_names.begin(), texture_names.end()), texture_names.end());
+        for (const auto &name: texture_names) {
+            auto image_path = path{name}.is_relative() ? scene_dir / name : path{name};
+            uint2 resolution;
+            if (is_ldr_image(image_path)) {
+                auto image = load_ldr_image(image_path, resolution);
+                auto &section = writer.begin_section(SectionType::TEXTURE, name);
+                section.pixel_storage = static_cast<uint32_t>(PixelStorage::BYTE4);
+                section.resolution[0] = resolution.x;
+                section.resolution[1] = resolution.y;
+                writer.write(image.data(), image.size() * sizeof(uchar4));
+            } else if (is_hdr_image(image_path)) {
+                auto image = load_hdr_image(image_path, resolution);
+                auto &section = writer.begin_section(SectionType::TEXTURE, name);
+                section.pixel_storage = static_cast<uint32_t>(PixelStorage::FLOAT4);
+                section.resolution[0] = resolution.x;
+                section.resolution[1] = resolution.y;
+                writer.write(image.data(), image.size() * sizeof(float4));
+            } else {
+                GL_RENDER_ERROR("Unsupported texture format: {}", image_path.extension().string());
+            }
+        }
+        writer.finish();
+
+        GL_RENDER_INFO(
+                "Packed \"{}\" into \"{}\": {} meshes, {} textures, {} MB in {} ms",
+                scene_path.string(), archive_path.string(), mesh_count, texture_names.size(),
+                static_cast<double>(writer.size()) / (1024.0 * 1024.0),
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pack_begin).count());
+    }
+
+}
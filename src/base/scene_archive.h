@@ -0,0 +1,75 @@
+//
+// Created by ChenXin on 2022/11/9.
+//
+
+#pragma once
+
+#include <core/stl.h>
+#include <base/pixel.h>
+#include <base/mesh_cache.h>
+#include <util/mapped_file.h>
+
+namespace gl_render {
+
+    namespace impl {
+
+        struct ArchiveSection;
+
+    }
+
+    /// Single-file scene: the resolved scene description, the processed mesh streams and the decoded textures.
+    /// The file is memory-mapped and its sections are aligned, so payloads go to GL straight from the mapping.
+    ///
+    /// Layout: header | sections (each ALIGNMENT aligned) | section names | section table
+    class SceneArchive {
+
+    public:
+        static constexpr uint32_t MAGIC = 0x41534c47u;    // "GLSA"
+        static constexpr uint32_t VERSION = 4u;
+        static constexpr size_t HEADER_SIZE = 64u;
+        static constexpr size_t ALIGNMENT = 256u;
+        static constexpr auto EXTENSION = ".glscene";
+
+        enum class SectionType : uint32_t {
+            SCENE = 0u,     // scene description json, same format as the loose scene file
+            MESH,           // positions | normals | tex_coords | indices | lods, one section per scene mesh, in scene order;
+                            // meshes sharing a file (see impl::find_mesh_instancing) share one object-space payload
+            TEXTURE,        // pixels of one image, named by the diffuse_map of the materials
+        };
+
+        struct TextureView {
+            uint2 resolution;
+            PixelStorage pixel_storage;
+            const std::byte *pixels;
+        };
+
+    private:
+        MappedFile _file;
+        span<const impl::ArchiveSection> _sections;
+        string_view _scene_description;
+        gl_render::vector<const impl::ArchiveSection *> _meshes;
+        gl_render::unordered_map<string, const impl::ArchiveSection *> _textures;
+
+    public:
+        explicit SceneArchive(const path &archive_path) noexcept;
+
+        SceneArchive(SceneArchive &&) = delete;
+        SceneArchive(const SceneArchive &) = delete;
+        SceneArchive &operator=(SceneArchive &&) = delete;
+        SceneArchive &operator=(const SceneArchive &) = delete;
+
+        /// Whether the file starts with the archive magic
+        [[nodiscard]] static bool is_archive(const path &file_path) noexcept;
+
+        /// Pack a json scene and everything it references into one archive
+        static void pack(const path &scene_path, const path &archive_path, uint thread_count = 0u) noexcept;
+
+        [[nodiscard]] auto scene_description() const noexcept { return _scene_description; }
+        [[nodiscard]] auto mesh_count() const noexcept { return _meshes.size(); }
+
+        /// Point the streams of data into the mapping, returns false if the archive has no such mesh
+        [[nodiscard]] bool mesh(size_t index, impl::MeshData &data) const noexcept;
+        [[nodiscard]] optional<TextureView> texture(const string &name) const noexcept;
+    };
+
+}
@@ -0,0 +1,105 @@
+//
+// Created by ChenXin on 2022/11/10.
+//
+
+#include <base/scene_diff.h>
+
+namespace gl_render {
+
+    namespace impl {
+
+        /// what a group is built with: the shader of the type and the diffuse texture
+        [[nodiscard]] bool same_material_layout(const MaterialInfo &lhs, const MaterialInfo &rhs) noexcept {
+            return lhs.type == rhs.type && lhs.diffuse_map == rhs.diffuse_map;
+        }
+
+        [[nodiscard]] bool same_material_colors(const MaterialInfo &lhs, const MaterialInfo &rhs) noexcept {
+            return lhs.diffuse == rhs.diffuse && lhs.specular == rhs.specular && lhs.ambient == rhs.ambient;
+        }
+
+        [[nodiscard]] bool same_mesh(const MeshInfo &lhs, const MeshInfo &rhs) noexcept {
+            return lhs.file_path == rhs.file_path && lhs.transform == rhs.transform && lhs.instances == rhs.instances;
+        }
+
+        /// Meshes of every group in scene order, which is also their order in the group buffers
+        [[nodiscard]] auto group_meshes(const SceneAllInfo &scene) noexcept {
+            gl_render::unordered_map<string, gl_render::vector<const MeshInfo *>> groups;
+            for (const auto &mesh: scene.meshes) {
+                groups[mesh.material_name].emplace_back(&mesh);
+            }
+            return groups;
+        }
+
+    }
+
+    SceneDiff diff_scenes(const SceneAllInfo &old_scene, const SceneAllInfo &new_scene) noexcept {
+        SceneDiff diff;
+
+        auto old_groups = impl::group_meshes(old_scene);
+        auto new_groups = impl::group_meshes(new_scene);
+        auto group_changed = [&](const string &name) {
+            auto old_group = old_groups.find(name);
+            auto new_group = new_groups.find(name);
+            if (old_group == old_groups.end() || new_group == new_groups.end()) {
+                return true;
+            }
+            auto old_material = old_scene.materials.find(name);
+            auto new_material = new_scene.materials.find(name);
+            if (old_material == old_scene.materials.end() || new_material == new_scene.materials.end() ||
+                !impl::same_material_layout(*old_material->second, *new_material->second)) {
+                return true;
+            }
+            const auto &old_meshes = old_group->second;
+            const auto &new_meshes = new_group->second;
+            if (old_meshes.size() != new_meshes.size()) {
+                return true;
+            }
+            for (auto i = 0ul; i < old_meshes.size(); ++i) {
+                if (!impl::same_mesh(*old_meshes[i], *new_meshes[i])) {
+                    return true;
+                }
+            }
+            return false;
+        };
+        for (const auto &groups: {&old_groups, &new_groups}) {
+            for (const auto &[name, meshes]: *groups) {
+                if (!diff.changed_groups.contains(name) && group_changed(name)) {
+                    diff.changed_groups.emplace(name);
+                }
+            }
+        }
+        // groups kept in place only have their entry in the material table rewritten
+        for (const auto &[name, meshes]: new_groups) {
+            if (diff.changed_groups.contains(name)) {
+                continue;
+            }
+            if (!impl::same_material_colors(*old_scene.materials.at(name), *new_scene.materials.at(name))) {
+                diff.changed_materials.emplace(name);
+            }
+        }
+
+        diff.light_count_changed = old_scene.lights.size() != new_scene.lights.size();
+        for (auto i = 0ul; i < min(old_scene.lights.size(), new_scene.lights.size()); ++i) {
+            const auto &old_light = old_scene.lights[i];
+            const auto &new_light = new_scene.lights[i];
+            if (old_light.position != new_light.position || old_light.emission != new_light.emission) {
+                diff.changed_lights.emplace_back(i);
+            }
+        }
+
+        const auto &old_camera = *old_scene.camera;
+        const auto &new_camera = *new_scene.camera;
+        diff.camera_changed = old_camera.resolution != new_camera.resolution ||
+                              old_camera.position != new_camera.position || old_camera.front != new_camera.front ||
+                              old_camera.up != new_camera.up || old_camera.fov != new_camera.fov;
+
+        const auto &old_renderer = *old_scene.renderer;
+        const auto &new_renderer = *new_scene.renderer;
+        diff.renderer_changed = old_renderer.enable_vsync != new_renderer.enable_vsync ||
+                                old_renderer.enable_shadow != new_renderer.enable_shadow ||
+                                old_renderer.output_file != new_renderer.output_file ||
+                                old_renderer.shadow_map_resolution != new_renderer.shadow_map_resolution;
+        return diff;
+    }
+
+}
@@ -0,0 +1,34 @@
+//
+// Created by ChenXin on 2022/11/10.
+//
+
+#pragma once
+
+#include <core/stl.h>
+#include <base/scene_info.h>
+
+namespace gl_render {
+
+    /// What a reload of the scene description has to update, groups are identified by their material name
+    struct SceneDiff {
+        /// groups to rebuild: their meshes, material type or diffuse map changed, new groups and groups left
+        /// without meshes included
+        gl_render::unordered_set<string> changed_groups;
+        /// groups that only changed their material colors, which live in the material table
+        gl_render::unordered_set<string> changed_materials;
+        /// lights present in both scenes with a different position or emission
+        gl_render::vector<size_t> changed_lights;
+        /// shaders are specialized on the light count, so they have to be recompiled
+        bool light_count_changed{false};
+        bool camera_changed{false};
+        bool renderer_changed{false};
+
+        [[nodiscard]] bool empty() const noexcept {
+            return changed_groups.empty() && changed_materials.empty() && changed_lights.empty() &&
+                   !light_count_changed && !camera_changed && !renderer_changed;
+        }
+    };
+
+    [[nodiscard]] SceneDiff diff_scenes(const SceneAllInfo &old_scene, const SceneAllInfo &new_scene) noexcept;
+
+}
@@ -66,13 +66,21 @@ namespace gl_render {
 
     struct MeshInfo : public SceneNodeInfo  {
         float4x4 transform = constant::IDENTITY_FLOAT4x4;
+        /// placements of the mesh, each applied after transform; the mesh is placed once by transform if empty
+        /// and is always drawn instanced otherwise
+        vector<float4x4> instances;
         path file_path;
         string material_name;
 
+        [[nodiscard]] auto instance_count() const noexcept { return max(instances.size(), size_t{1}); }
+        [[nodiscard]] float4x4 world_transform(size_t instance) const noexcept {
+            return instances.empty() ? transform : instances[instance] * transform;
+        }
+
         void print() const noexcept override {
             GL_RENDER_INFO(
-                    "MeshInfo: file_path: {}, material_name: {}, transform(not printed)",
-                    file_path.string(), material_name);
+                    "MeshInfo: file_path: {}, material_name: {}, {} instance(s), transform(not printed)",
+                    file_path.string(), material_name, instance_count());
         }
     };
 
@@ -115,4 +123,12 @@ namespace gl_render {
         }
     };
 
+    struct SceneAllInfo {
+        unordered_map<string, unique_ptr<MaterialInfo>> materials;
+        vector<MeshInfo> meshes;
+        vector<LightInfo> lights;
+        optional<CameraInfo> camera;
+        optional<RendererInfo> renderer;
+    };
+
 }
\ No newline at end of file
@@ -0,0 +1,540 @@
+//
+// Created by ChenXin on 2022/11/8.
+//
+
+#include <base/scene_parser.h>
+
+#include <array>
+#include <chrono>
+
+#include <nlohmann/json.hpp>
+
+#include <core/allocation_stats.h>
+#include <core/constant.h>
+#include <core/profiler.h>
+#include <util/mapped_file.h>
+
+namespace gl_render {
+
+    namespace impl {
+
+        /// SAX handler of the scene file, see nlohmann::json_sax for the interface.
+        /// Every object/array pushes a context, properties are assigned as soon as their value is read.
+        /// The first error found is kept in error() and stops the parse.
+        class SceneSaxHandler {
+
+        private:
+            using json = nlohmann::json;
+
+            enum class Context : uint8_t {
+                Root,
+                Materials,
+                Material,
+                Meshes,
+                Mesh,
+                Transform,
+                Instances,
+                Instance,
+                Rotate,
+                Lights,
+                Light,
+                Camera,
+                Renderer,
+                Numbers,
+                Skip,
+            };
+
+            struct TransformDesc {
+                optional<float4x4> matrix;
+                optional<float3> scale;
+                optional<float3> rotate_axis;
+                optional<float> rotate_angle;
+                optional<float3> translate;
+                bool has_rotate = false;
+            };
+
+        private:
+            SceneAllInfo &_scene;
+            gl_render::vector<Context> _stack;
+            gl_render::string _key;
+
+            // numbers of the innermost array
+            std::array<double, 16u> _numbers{};
+            size_t _number_count{0u};
+
+            // objects being parsed
+            unique_ptr<MaterialInfo> _material;
+            MeshInfo _mesh;
+            TransformDesc _transform;
+            LightInfo _light;
+            float _light_scale{1.f};
+            CameraInfo _camera;
+            RendererInfo _renderer;
+
+            // required properties seen in the current object
+            uint _required{0u};
+            bool _has_materials{false};
+            bool _has_meshes{false};
+
+            gl_render::string _error;
+
+        public:
+            explicit SceneSaxHandler(SceneAllInfo &scene) noexcept: _scene{scene} {
+                _stack.reserve(16u);
+                _key.reserve(32u);
+            }
+
+            [[nodiscard]] auto finished() const noexcept { return _stack.empty(); }
+            [[nodiscard]] const auto &error() const noexcept { return _error; }
+
+            bool null() noexcept { return true; }
+
+            bool boolean(bool value) noexcept {
+                if (_top() == Context::Renderer) {
+                    if (_key == "enable_vsync") {
+                        _renderer.enable_vsync = value;
+                    } else if (_key == "enable_shadow") {
+                        _renderer.enable_shadow = value;
+                    }
+                }
+                return true;
+            }
+
+            bool number_integer(json::number_integer_t value) noexcept { return _number(static_cast<double>(value)); }
+            bool number_unsigned(json::number_unsigned_t value) noexcept { return _number(static_cast<double>(value)); }
+            bool number_float(json::number_float_t value, const json::string_t &) noexcept { return _number(value); }
+
+            bool string(json::string_t &value) noexcept {
+                switch (_top()) {
+                    case Context::Material:
+                        if (_key == "type") {
+                            _material->type = MaterialInfo::String2Type(value);
+                            _required |= 1u;
+                        } else if (_key == "name") {
+                            _material->name = std::move(value);
+                            _required |= 2u;
+                        } else if (_key == "diffuse_map") {
+                            _material->diffuse_map = std::move(value);
+                        }
+                        break;
+                    case Context::Mesh:
+                        if (_key == "file") {
+                            _mesh.file_path = std::move(value);
+                            _required |= 1u;
+                        } else if (_key == "material") {
+                            _mesh.material_name = std::move(value);
+                            _required |= 2u;
+                        }
+                        break;
+                    case Context::Renderer:
+                        if (_key == "output_file") {
+                            _renderer.output_file = std::move(value);
+                        }
+                        break;
+                    default:
+                        break;
+                }
+                return true;
+            }
+
+            bool binary(json::binary_t &) noexcept { return true; }
+
+            bool key(json::string_t &key) noexcept {
+                _key = key;
+                return true;
+            }
+
+            bool start_object(std::size_t) noexcept {
+                if (_stack.empty()) {
+                    _stack.emplace_back(Context::Root);
+                    return true;
+                }
+                auto context = Context::Skip;
+                switch (_top()) {
+                    case Context::Root:
+                        if (_key == "camera") {
+                            context = Context::Camera;
+                            _camera.position = float3{0.f};
+                            _camera.front = float3{0.0f, 0.0f, -1.0f};
+                            _camera.up = float3{0.0f, 1.0f, 0.0f};
+                            _camera.fov = 35.f;
+                            _required = 0u;
+                        } else if (_key == "renderer") {
+                            context = Context::Renderer;
+                            _renderer = RendererInfo{};
+                            _renderer.enable_vsync = true;
+                            _renderer.enable_shadow = true;
+                            _renderer.output_file = "output.exr";
+                        }
+                        break;
+                    case Context::Materials:
+                        context = Context::Material;
+                        _material = make_unique<MaterialInfo>();
+                        _material->diffuse = float3(0.5f);
+                        _material->specular = float3(0.f);
+                        _material->ambient = float3(0.f);
+                        _required = 0u;
+                        break;
+                    case Context::Meshes:
+                        context = Context::Mesh;
+                        _mesh = MeshInfo{};
+                        _required = 0u;
+                        break;
+                    case Context::Mesh:
+                        if (_key == "transform") {
+                            context = Context::Transform;
+                            _transform = TransformDesc{};
+                        }
+                        break;
+                    case Context::Instances:
+                        // an instance is described like a transform
+                        context = Context::Instance;
+                        _transform = TransformDesc{};
+                        break;
+                    case Context::Transform:
+                    case Context::Instance:
+                        if (_key == "rotate") {
+                            context = Context::Rotate;
+                            _transform.has_rotate = true;
+                        }
+                        break;
+                    case Context::Lights:
+                        context = Context::Light;
+                        _light_scale = 1.f;
+                        _required = 0u;
+                        break;
+                    default:
+                        break;
+                }
+                _stack.emplace_back(context);
+                return true;
+            }
+
+            bool end_object() noexcept {
+                auto context = _pop();
+                switch (context) {
+                    case Context::Root:
+                        return _finish();
+                    case Context::Material: {
+                        if (_required != 3u) {
+                            return _fail("Material must have a type and a name.");
+                        }
+                        auto material_name = _material->name;
+                        if (_scene.materials.contains(material_name)) {
+                            return _fail("Material '{}' already exists.", material_name);
+                        }
+                        _scene.materials.emplace(std::move(material_name), std::move(_material));
+                        break;
+                    }
+                    case Context::Mesh:
+                        if (_required != 3u) {
+                            return _fail("Mesh must have a file and a material.");
+                        }
+                        _scene.meshes.emplace_back(std::move(_mesh));
+                        break;
+                    case Context::Transform:
+                        _mesh.transform = _compose_transform();
+                        break;
+                    case Context::Instance:
+                        _mesh.instances.emplace_back(_compose_transform());
+                        break;
+                    case Context::Rotate:
+                        if (!_transform.rotate_axis || !_transform.rotate_angle) {
+                            return _fail("Rotation must have an axis and an angle.");
+                        }
+                        break;
+                    case Context::Light:
+                        if (_required != 3u) {
+                            return _fail("Light must have a position and an emission.");
+                        }
+                        _light.emission *= _light_scale;
+                        _scene.lights.emplace_back(_light);
+                        break;
+                    case Context::Camera:
+                        if (_required != 1u) {
+                            return _fail("Camera must have a resolution.");
+                        }
+                        _scene.camera.emplace(_camera);
+                        break;
+                    case Context::Renderer:
+                        _scene.renderer.emplace(_renderer);
+                        break;
+                    default:
+                        break;
+                }
+                return true;
+            }
+
+            bool start_array(std::size_t) noexcept {
+                auto context = Context::Skip;
+                switch (_top()) {
+                    case Context::Root:
+                        if (_key == "materials") {
+                            context = Context::Materials;
+                            _has_materials = true;
+                        } else if (_key == "meshes") {
+                            context = Context::Meshes;
+                            _has_meshes = true;
+                        } else if (_key == "lights") {
+                            context = Context::Lights;
+                        }
+                        break;
+                    case Context::Mesh:
+                        if (_key == "instances") {
+                            context = Context::Instances;
+                        } else {
+                            context = Context::Numbers;
+                            _number_count = 0u;
+                        }
+                        break;
+                    case Context::Material:
+                    case Context::Transform:
+                    case Context::Instance:
+                    case Context::Rotate:
+                    case Context::Light:
+                    case Context::Camera:
+                    case Context::Renderer:
+                        context = Context::Numbers;
+                        _number_count = 0u;
+                        break;
+                    default:
+                        break;
+                }
+                _stack.emplace_back(context);
+                return true;
+            }
+
+            bool end_array() noexcept {
+                if (_pop() == Context::Numbers) {
+                    _assign_numbers();
+                }
+                return _error.empty();
+            }
+
+            template<typename Exception>
+            bool parse_error(std::size_t position, const std::string &last_token, const Exception &ex) noexcept {
+                return _fail("Failed to parse scene at byte {} near '{}': {}", position, last_token, ex.what());
+            }
+
+        private:
+            template<typename FMT, typename... Args>
+            bool _fail(FMT &&f, Args &&...args) noexcept {
+                if (_error.empty()) {
+                    _error = format(std::forward<FMT>(f), std::forward<Args>(args)...);
+                }
+                return false;
+            }
+
+            [[nodiscard]] Context _top() const noexcept {
+                return _stack.empty() ? Context::Skip : _stack.back();
+            }
+
+            Context _pop() noexcept {
+                auto context = _stack.back();
+                _stack.pop_back();
+                return context;
+            }
+
+            bool _number(double value) noexcept {
+                switch (_top()) {
+                    case Context::Numbers:
+                        if (_number_count == _numbers.size()) {
+                            return _fail("Too many values for property '{}'", _key);
+                        }
+                        _numbers[_number_count++] = value;
+                        break;
+                    case Context::Rotate:
+                        if (_key == "angle") {
+                            _transform.rotate_angle = static_cast<float>(value);
+                        }
+                        break;
+                    case Context::Light:
+                        if (_key == "scale") {
+                            _light_scale = static_cast<float>(value);
+                        }
+                        break;
+                    case Context::Camera:
+                        if (_key == "fov") {
+                            _camera.fov = static_cast<float>(value);
+                        }
+                        break;
+                    default:
+                        break;
+                }
+                return true;
+            }
+
+            /// too few values fail the parse, the missing ones are left zero
+            template<typename T, size_t N>
+            [[nodiscard]] Vector<T, N> _vector() noexcept {
+                if (_number_count < N) {
+                    _fail("Property '{}' needs {} values, {} given", _key, N, _number_count);
+                }
+                Vector<T, N> v{};
+                for (auto i = 0u; i < N; ++i) {
+                    v[i] = static_cast<T>(_numbers[i]);
+                }
+                return v;
+            }
+
+            [[nodiscard]] float4x4 _matrix() noexcept {
+                if (_number_count < 16u) {
+                    _fail("Property '{}' needs 16 values, {} given", _key, _number_count);
+                }
+                float4x4 m{};
+                for (auto i = 0u; i < 4u; ++i) {
+                    for (auto j = 0u; j < 4u; ++j) {
+                        m[i][j] = static_cast<float>(_numbers[i * 4u + j]);
+                    }
+                }
+                return m;
+            }
+
+            void _assign_numbers() noexcept {
+                switch (_top()) {
+                    case Context::Material:
+                        if (_key == "diffuse") {
+                            _material->diffuse = _vector<float, 3>();
+                        } else if (_key == "specular") {
+                            _material->specular = _vector<float, 3>();
+                        } else if (_key == "ambient") {
+                            _material->ambient = _vector<float, 3>();
+                        }
+                        break;
+                    case Context::Transform:
+                    case Context::Instance:
+                        if (_key == "matrix") {
+                            _transform.matrix = _matrix();
+                        } else if (_key == "scale") {
+                            _transform.scale = _vector<float, 3>();
+                        } else if (_key == "translate") {
+                            _transform.translate = _vector<float, 3>();
+                        }
+                        break;
+                    case Context::Rotate:
+                        if (_key == "axis") {
+                            _transform.rotate_axis = _vector<float, 3>();
+                        }
+                        break;
+                    case Context::Light:
+                        if (_key == "position") {
+                            _light.position = _vector<float, 3>();
+                            _required |= 1u;
+                        } else if (_key == "emission") {
+                            _light.emission = _vector<float, 3>();
+                            _required |= 2u;
+                        }
+                        break;
+                    case Context::Camera:
+                        if (_key == "resolution") {
+                            _camera.resolution = _vector<uint, 2>();
+                            _required |= 1u;
+                        } else if (_key == "position") {
+                            _camera.position = _vector<float, 3>();
+                        } else if (_key == "front") {
+                            _camera.front = _vector<float, 3>();
+                        } else if (_key == "up") {
+                            _camera.up = _vector<float, 3>();
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+
+            /// same order as the scene format always used: matrix, or scale then rotate then translate
+            [[nodiscard]] float4x4 _compose_transform() const noexcept {
+                if (_transform.matrix) {
+                    return *_transform.matrix;
+                }
+                auto transform = constant::IDENTITY_FLOAT4x4;
+                if (_transform.scale) {
+                    transform = scale(transform, *_transform.scale);
+                }
+                if (_transform.has_rotate) {
+                    transform = rotate(transform, *_transform.rotate_angle, *_transform.rotate_axis);
+                }
+                if (_transform.translate) {
+                    transform = translate(transform, *_transform.translate);
+                }
+                return transform;
+            }
+
+            bool _finish() noexcept {
+                if (!_has_materials) {
+                    return _fail("Scene file must contain materials.");
+                }
+                if (!_has_meshes) {
+                    return _fail("Scene file must contain meshes.");
+                }
+                if (!_scene.camera.has_value()) {
+                    return _fail("Scene file must contain camera.");
+                }
+                if (!_scene.renderer.has_value()) {
+                    return _fail("Scene file must contain renderer.");
+                }
+                // materials may follow meshes in the file, so references are only checked at the end
+                for (const auto &mesh: _scene.meshes) {
+                    if (!_scene.materials.contains(mesh.material_name)) {
+                        return _fail("Material '{}' does not exist.", mesh.material_name);
+                    }
+                }
+                return true;
+            }
+        };
+
+    }
+
+    unique_ptr<SceneAllInfo> SceneParser::parse(const path &scene_path, Statistics *statistics) noexcept {
+        MappedFile file{scene_path};
+        GL_RENDER_ASSERT(file.valid(), "Failed to read scene file \"{}\"", scene_path.string());
+        auto scene = parse(string_view{reinterpret_cast<const char *>(file.data()), file.size()}, statistics);
+        GL_RENDER_INFO(
+                "Parsed scene \"{}\": {} materials, {} meshes, {} lights",
+                scene_path.string(), scene->materials.size(), scene->meshes.size(), scene->lights.size());
+        return scene;
+    }
+
+    unique_ptr<SceneAllInfo> SceneParser::parse(string_view scene_json, Statistics *statistics) noexcept {
+        string error;
+        auto scene = try_parse(scene_json, error, statistics);
+        if (scene == nullptr) [[unlikely]] {
+            GL_RENDER_ERROR_WITH_LOCATION("Invalid scene description: {}", error);
+        }
+        return scene;
+    }
+
+    unique_ptr<SceneAllInfo> SceneParser::try_parse(string_view scene_json, string &error,
+                                                    Statistics *statistics) noexcept {
+        GL_RENDER_PROFILE_SCOPE("parse scene", "scene");
+        auto allocations_begin = allocation_stats();
+        auto parse_begin = std::chrono::steady_clock::now();
+
+        auto scene = make_unique<SceneAllInfo>();
+        impl::SceneSaxHandler handler{*scene};
+        auto success = nlohmann::json::sax_parse(scene_json.data(), scene_json.data() + scene_json.size(), &handler);
+        if (!success || !handler.finished()) {
+            error = handler.error().empty() ? string{"Incomplete scene description"} : handler.error();
+            return nullptr;
+        }
+
+        auto parse_end = std::chrono::steady_clock::now();
+        auto allocations_end = allocation_stats();
+        Statistics stats{
+                std::chrono::duration<double, std::milli>(parse_end - parse_begin).count(),
+                allocations_end.count - allocations_begin.count,
+                allocations_end.bytes - allocations_begin.bytes};
+        if (allocations_end.count == 0u) {
+            GL_RENDER_INFO("Scene parsed in {} ms", stats.parse_time);
+        } else {
+            GL_RENDER_INFO(
+                    "Scene parsed in {} ms with {} allocations ({} bytes)",
+                    stats.parse_time, stats.allocation_count, stats.allocation_bytes);
+        }
+        if (statistics != nullptr) {
+            *statistics = stats;
+        }
+        return scene;
+    }
+
+}
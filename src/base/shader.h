@@ -13,6 +13,7 @@
 
 #include <core/serialize.h>
 #include <core/logger.h>
+#include <core/profiler.h>
 
 namespace gl_render {
 
@@ -27,6 +28,7 @@ namespace gl_render {
         // ------------------------------------------------------------------------
         Shader(const path &vertexPath, const path &geometryPath, const path &fragmentPath,
                const TemplateList &tl = {}) {
+            GL_RENDER_PROFILE_SCOPE("compile shader", "shader", vertexPath.string());
 
             // 1. retrieve the vertex/fragment source code from filePath
             string vertexCode;
@@ -65,6 +67,7 @@ namespace gl_render {
                 checkCompileErrors(geometry, "GEOMETRY");
             }
             // shader Program
+            GL_RENDER_PROFILE_SCOPE("link program", "shader");
             ID = glCreateProgram();
             glAttachShader(ID, vertex);
             glAttachShader(ID, fragment);
@@ -81,12 +84,38 @@ namespace gl_render {
             }
         }
 
+        // compute shader program, run with dispatch()
+        // ------------------------------------------------------------------------
+        explicit Shader(const path &computePath, const TemplateList &tl = {}) {
+            GL_RENDER_PROFILE_SCOPE("compile shader", "shader", computePath.string());
+
+            string computeCode = readSourceFile(computePath, tl);
+            const char *cShaderCode = computeCode.c_str();
+            unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
+            glShaderSource(compute, 1, &cShaderCode, NULL);
+            glCompileShader(compute);
+            checkCompileErrors(compute, "COMPUTE");
+
+            GL_RENDER_PROFILE_SCOPE("link program", "shader");
+            ID = glCreateProgram();
+            glAttachShader(ID, compute);
+            glLinkProgram(ID);
+            checkCompileErrors(ID, "PROGRAM");
+            glDeleteShader(compute);
+        }
+
         // activate the shader
         // ------------------------------------------------------------------------
         void use() const {
             glUseProgram(ID);
         }
 
+        // run the compute shader over thread_count threads, in work groups of group_size
+        // ------------------------------------------------------------------------
+        void dispatch(uint thread_count, uint group_size) const {
+            glDispatchCompute((thread_count + group_size - 1u) / group_size, 1u, 1u);
+        }
+
         // utility uniform functions
         // ------------------------------------------------------------------------
         void setBool(const string &name, bool value) const {
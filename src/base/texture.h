@@ -11,6 +11,7 @@
 #include <core/stl.h>
 #include <base/pixel.h>
 #include <core/logger.h>
+#include <core/profiler.h>
 #include <util/imageio.h>
 
 namespace gl_render {
@@ -26,35 +27,54 @@ namespace gl_render {
         explicit Texture(const path &image_path) noexcept {
             GL_RENDER_INFO("Loading texture: {}", image_path.string());
 
-            glGenTextures(1, &_id);
-            glBindTexture(GL_TEXTURE_2D, _id);
-            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
             if (is_ldr_image(image_path)) {
                 auto image = load_ldr_image(image_path, _resolution);
                 _pixel_storage = PixelStorage::BYTE4;
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, _resolution.x, _resolution.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.data());
+                _create(image.data());
             } else if (is_hdr_image(image_path)) {
                 auto image = load_hdr_image(image_path, _resolution);
                 _pixel_storage = PixelStorage::FLOAT4;
-                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, _resolution.x, _resolution.y, 0, GL_RGBA, GL_FLOAT, image.data());
+                _create(image.data());
             } else {
                 GL_RENDER_ERROR("Unsupported texture format: {}", image_path.extension().string());
             }
-            glGenerateMipmap(GL_TEXTURE_2D);
-            _handle = glGetTextureHandleARB(_id);
-            glMakeTextureHandleResidentARB(_handle);
-            glBindTexture(GL_TEXTURE_2D, 0);
             GL_RENDER_INFO("Created texture: {}, id: {}, handle: {}", image_path.string(), _id, _handle);
         }
 
+        /// Texture from decoded pixels (BYTE4 or FLOAT4), e.g. mapped from a scene archive
+        Texture(const string &name, uint2 resolution, PixelStorage pixel_storage, const void *pixels) noexcept
+                : _resolution{resolution}, _pixel_storage{pixel_storage} {
+            _create(pixels);
+            GL_RENDER_INFO("Created texture: {}, id: {}, handle: {}", name, _id, _handle);
+        }
+
         ~Texture() {
             glDeleteTextures(1, &_id);
         }
 
+    private:
+        void _create(const void *pixels) noexcept {
+            GL_RENDER_PROFILE_SCOPE("upload texture", "upload");
+            glGenTextures(1, &_id);
+            glBindTexture(GL_TEXTURE_2D, _id);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            if (_pixel_storage == PixelStorage::BYTE4) {
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, _resolution.x, _resolution.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+            } else if (_pixel_storage == PixelStorage::FLOAT4) {
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, _resolution.x, _resolution.y, 0, GL_RGBA, GL_FLOAT, pixels);
+            } else {
+                GL_RENDER_ERROR("Unsupported texture pixel storage: {}", static_cast<uint32_t>(_pixel_storage));
+            }
+            glGenerateMipmap(GL_TEXTURE_2D);
+            _handle = glGetTextureHandleARB(_id);
+            glMakeTextureHandleResidentARB(_handle);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+
     protected:
         GLuint _id = 0u;
         GLuint64 _handle;
@@ -26,6 +26,14 @@ namespace gl_render {
             }
             return _textures[image_path].get();
         }
+        Texture* CreateTexture(const path &name, uint2 resolution, PixelStorage pixel_storage, const void *pixels) noexcept {
+            if (auto iter = _textures.find(name); iter == _textures.end()) {
+                _textures.emplace(name, gl_render::make_unique<Texture>(name.string(), resolution, pixel_storage, pixels));
+            } else {
+                GL_RENDER_INFO("Using cached image: {}", name.string());
+            }
+            return _textures[name].get();
+        }
         [[nodiscard]] Texture* GetTexture(const path &image_path) const noexcept {
             return _textures.at(image_path).get();
         }
@@ -0,0 +1,158 @@
+//
+// Created by ChenXin on 2022/11/17.
+//
+
+#include <base/vertex_transform.h>
+
+#include <array>
+
+#include <core/logger.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace gl_render {
+
+    namespace impl {
+
+        static_assert(sizeof(float3) == 3u * sizeof(float), "The kernels read float3 streams as packed floats");
+
+#if defined(__AVX2__)
+
+        /// 8 packed float3 (x0 y0 z0 x1 ...) to one register per component
+        static void load_soa(const float *aos, __m256 &x, __m256 &y, __m256 &z) noexcept {
+            // each 128-bit half holds 4 vertices: the lower ones 0-3, the upper ones 4-7
+            auto m03 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(aos)), _mm_loadu_ps(aos + 12), 1);
+            auto m14 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(aos + 4)), _mm_loadu_ps(aos + 16), 1);
+            auto m25 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(aos + 8)), _mm_loadu_ps(aos + 20), 1);
+            auto xy = _mm256_shuffle_ps(m14, m25, _MM_SHUFFLE(2, 1, 3, 2));
+            auto yz = _mm256_shuffle_ps(m03, m14, _MM_SHUFFLE(1, 0, 2, 1));
+            x = _mm256_shuffle_ps(m03, xy, _MM_SHUFFLE(2, 0, 3, 0));
+            y = _mm256_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0));
+            z = _mm256_shuffle_ps(yz, m25, _MM_SHUFFLE(3, 0, 3, 1));
+        }
+
+        /// Inverse of load_soa
+        static void store_aos(float *aos, __m256 x, __m256 y, __m256 z) noexcept {
+            auto rxy = _mm256_shuffle_ps(x, y, _MM_SHUFFLE(2, 0, 2, 0));
+            auto ryz = _mm256_shuffle_ps(y, z, _MM_SHUFFLE(3, 1, 3, 1));
+            auto rzx = _mm256_shuffle_ps(z, x, _MM_SHUFFLE(3, 1, 2, 0));
+            auto r03 = _mm256_shuffle_ps(rxy, rzx, _MM_SHUFFLE(2, 0, 2, 0));
+            auto r14 = _mm256_shuffle_ps(ryz, rxy, _MM_SHUFFLE(3, 1, 2, 0));
+            auto r25 = _mm256_shuffle_ps(rzx, ryz, _MM_SHUFFLE(3, 1, 3, 1));
+            _mm_storeu_ps(aos, _mm256_castps256_ps128(r03));
+            _mm_storeu_ps(aos + 4, _mm256_castps256_ps128(r14));
+            _mm_storeu_ps(aos + 8, _mm256_castps256_ps128(r25));
+            _mm_storeu_ps(aos + 12, _mm256_extractf128_ps(r03, 1));
+            _mm_storeu_ps(aos + 16, _mm256_extractf128_ps(r14, 1));
+            _mm_storeu_ps(aos + 20, _mm256_extractf128_ps(r25, 1));
+        }
+
+        /// The upper 3x4 part of a column-major matrix, every element broadcast; the translation of 3x3 ones is 0
+        struct BroadcastRows {
+            std::array<std::array<__m256, 4u>, 3u> m;
+
+            template<typename M>
+            explicit BroadcastRows(const M &matrix) noexcept {
+                for (auto r = 0; r < 3; ++r) {
+                    for (auto c = 0; c < 4; ++c) {
+                        m[r][c] = c < M::length() ? _mm256_set1_ps(matrix[c][r]) : _mm256_setzero_ps();
+                    }
+                }
+            }
+
+            [[nodiscard]] __m256 row(int r, __m256 x, __m256 y, __m256 z) const noexcept {
+                auto v = _mm256_add_ps(_mm256_mul_ps(m[r][0], x), m[r][3]);
+                v = _mm256_add_ps(v, _mm256_mul_ps(m[r][1], y));
+                return _mm256_add_ps(v, _mm256_mul_ps(m[r][2], z));
+            }
+        };
+
+        [[nodiscard]] static float horizontal_min(__m256 v) noexcept {
+            auto h = _mm_min_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+            h = _mm_min_ps(h, _mm_movehl_ps(h, h));
+            return _mm_cvtss_f32(_mm_min_ps(h, _mm_shuffle_ps(h, h, _MM_SHUFFLE(1, 1, 1, 1))));
+        }
+
+        [[nodiscard]] static float horizontal_max(__m256 v) noexcept {
+            auto h = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+            h = _mm_max_ps(h, _mm_movehl_ps(h, h));
+            return _mm_cvtss_f32(_mm_max_ps(h, _mm_shuffle_ps(h, h, _MM_SHUFFLE(1, 1, 1, 1))));
+        }
+
+#endif
+
+        AABB transform_vertices(span<const float3> positions, span<float3> out_positions,
+                                span<const float3> normals, span<float3> out_normals,
+                                const float4x4 &transform, const float3x3 &normal_matrix) noexcept {
+            GL_RENDER_ASSERT(out_positions.size() == positions.size() && out_normals.size() == normals.size(),
+                             "Vertex transform outputs have to be presized to their inputs");
+            auto position_batches = 0ul;
+            auto normal_batches = 0ul;
+            AABB aabb;
+#if defined(__AVX2__)
+            position_batches = positions.size() / VERTEX_TRANSFORM_BATCH_SIZE;
+            normal_batches = normals.size() / VERTEX_TRANSFORM_BATCH_SIZE;
+            BroadcastRows position_rows{transform};
+            BroadcastRows normal_rows{normal_matrix};
+            auto min_x = _mm256_set1_ps(aabb.min.x), min_y = _mm256_set1_ps(aabb.min.y), min_z = _mm256_set1_ps(aabb.min.z);
+            auto max_x = _mm256_set1_ps(aabb.max.x), max_y = _mm256_set1_ps(aabb.max.y), max_z = _mm256_set1_ps(aabb.max.z);
+            // positions and normals of a batch are transformed together while both streams last
+            for (auto batch = 0ul; batch < max(position_batches, normal_batches); ++batch) {
+                auto first = batch * VERTEX_TRANSFORM_BATCH_SIZE;
+                __m256 x, y, z;
+                if (batch < position_batches) {
+                    load_soa(&positions[first].x, x, y, z);
+                    auto tx = position_rows.row(0, x, y, z);
+                    auto ty = position_rows.row(1, x, y, z);
+                    auto tz = position_rows.row(2, x, y, z);
+                    min_x = _mm256_min_ps(min_x, tx), min_y = _mm256_min_ps(min_y, ty), min_z = _mm256_min_ps(min_z, tz);
+                    max_x = _mm256_max_ps(max_x, tx), max_y = _mm256_max_ps(max_y, ty), max_z = _mm256_max_ps(max_z, tz);
+                    store_aos(&out_positions[first].x, tx, ty, tz);
+                }
+                if (batch < normal_batches) {
+                    load_soa(&normals[first].x, x, y, z);
+                    store_aos(&out_normals[first].x, normal_rows.row(0, x, y, z),
+                              normal_rows.row(1, x, y, z), normal_rows.row(2, x, y, z));
+                }
+            }
+            aabb.min = float3{horizontal_min(min_x), horizontal_min(min_y), horizontal_min(min_z)};
+            aabb.max = float3{horizontal_max(max_x), horizontal_max(max_y), horizontal_max(max_z)};
+#endif
+            auto position_tail = position_batches * VERTEX_TRANSFORM_BATCH_SIZE;
+            auto normal_tail = normal_batches * VERTEX_TRANSFORM_BATCH_SIZE;
+            auto tail = transform_vertices_scalar(positions.subspan(position_tail), out_positions.subspan(position_tail),
+                                                  normals.subspan(normal_tail), out_normals.subspan(normal_tail),
+                                                  transform, normal_matrix);
+            aabb.min = min(aabb.min, tail.min);
+            aabb.max = max(aabb.max, tail.max);
+            return aabb;
+        }
+
+        AABB transform_vertices_scalar(span<const float3> positions, span<float3> out_positions,
+                                       span<const float3> normals, span<float3> out_normals,
+                                       const float4x4 &transform, const float3x3 &normal_matrix) noexcept {
+            AABB aabb;
+            for (auto i = 0ul; i < positions.size(); ++i) {
+                out_positions[i] = float3{transform * float4{positions[i], 1.f}};
+                aabb.min = min(aabb.min, out_positions[i]);
+                aabb.max = max(aabb.max, out_positions[i]);
+            }
+            for (auto i = 0ul; i < normals.size(); ++i) {
+                out_normals[i] = normal_matrix * normals[i];
+            }
+            return aabb;
+        }
+
+        string_view vertex_transform_kernel() noexcept {
+#if defined(__AVX2__)
+            return "AVX2";
+#else
+            return "scalar";
+#endif
+        }
+
+    }
+
+}
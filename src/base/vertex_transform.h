@@ -0,0 +1,35 @@
+//
+// Created by ChenXin on 2022/11/17.
+//
+
+#pragma once
+
+#include <core/stl.h>
+#include <base/aabb.h>
+
+namespace gl_render {
+
+    namespace impl {
+
+        /// Vertices the kernel of transform_vertices() works on at a time
+        constexpr size_t VERTEX_TRANSFORM_BATCH_SIZE = 8u;
+
+        /// Transform positions by transform into out_positions and normals by normal_matrix into out_normals, both
+        /// presized to their inputs, and return the bounds of the transformed positions, computed in the same pass.
+        /// The streams may differ in length. Batches of 8 vertices are transposed into structure-of-arrays blocks
+        /// for AVX2 if enabled, the remainder and builds without it take transform_vertices_scalar().
+        AABB transform_vertices(span<const float3> positions, span<float3> out_positions,
+                                span<const float3> normals, span<float3> out_normals,
+                                const float4x4 &transform, const float3x3 &normal_matrix) noexcept;
+
+        /// One vertex at a time, the reference of transform_vertices()
+        AABB transform_vertices_scalar(span<const float3> positions, span<float3> out_positions,
+                                       span<const float3> normals, span<float3> out_normals,
+                                       const float4x4 &transform, const float3x3 &normal_matrix) noexcept;
+
+        /// Instruction set transform_vertices() was built for, "AVX2" or "scalar"
+        [[nodiscard]] string_view vertex_transform_kernel() noexcept;
+
+    }
+
+}
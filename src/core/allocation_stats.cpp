@@ -0,0 +1,30 @@
+//
+// Created by ChenXin on 2022/11/8.
+//
+
+#include <core/allocation_stats.h>
+
+#include <atomic>
+
+namespace gl_render {
+
+    namespace detail {
+
+        // constant-initialized, so safe to touch from allocations made during static initialization
+        static std::atomic<size_t> allocation_count{0u};
+        static std::atomic<size_t> allocation_bytes{0u};
+
+        void record_allocation(size_t size) noexcept {
+            allocation_count.fetch_add(1u, std::memory_order_relaxed);
+            allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+        }
+
+    }
+
+    AllocationStats allocation_stats() noexcept {
+        return AllocationStats{
+                detail::allocation_count.load(std::memory_order_relaxed),
+                detail::allocation_bytes.load(std::memory_order_relaxed)};
+    }
+
+}
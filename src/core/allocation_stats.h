@@ -0,0 +1,25 @@
+//
+// Created by ChenXin on 2022/11/8.
+//
+
+#pragma once
+
+#include <core/stl.h>
+
+namespace gl_render {
+
+    struct AllocationStats {
+        size_t count = 0u;
+        size_t bytes = 0u;
+    };
+
+    /// Heap allocations counted so far. Only applications that replace the global operator new
+    /// and forward to detail::record_allocation are counted (see app/scene_parse_benchmark.cpp), otherwise
+    /// all zero. On Windows the replacement does not reach the DLLs, so nothing is counted there.
+    [[nodiscard]] AllocationStats allocation_stats() noexcept;
+
+    namespace detail {
+        void record_allocation(size_t size) noexcept;
+    }
+
+}
@@ -0,0 +1,101 @@
+//
+// Created by ChenXin on 2022/11/10.
+//
+
+#include <core/profiler.h>
+
+#include <algorithm>
+#include <fstream>
+
+#include <nlohmann/json.hpp>
+
+#include <core/logger.h>
+#include <core/serialize.h>
+
+namespace gl_render {
+
+    Profiler &Profiler::GetInstance() noexcept {
+        // defined out of line so that every shared library records into the same instance
+        static Profiler instance;
+        return instance;
+    }
+
+    void Profiler::enable() noexcept {
+        // the enabling thread is reported as the main thread
+        static_cast<void>(thread_index());
+        std::lock_guard lock{_mutex};
+        _origin = clock::now();
+        _enabled.store(true, std::memory_order_relaxed);
+    }
+
+    void Profiler::record(Event event) noexcept {
+        std::lock_guard lock{_mutex};
+        _events.emplace_back(std::move(event));
+    }
+
+    uint Profiler::thread_index() noexcept {
+        static std::atomic<uint> thread_count{0u};
+        thread_local auto index = thread_count.fetch_add(1u, std::memory_order_relaxed);
+        return index;
+    }
+
+    void Profiler::save(const path &trace_path) noexcept {
+        std::lock_guard lock{_mutex};
+        auto to_microseconds = [](clock::duration duration) {
+            return std::chrono::duration<double, std::micro>(duration).count();
+        };
+        std::stable_sort(_events.begin(), _events.end(), [](const auto &lhs, const auto &rhs) {
+            return lhs.begin < rhs.begin;
+        });
+
+        auto events = nlohmann::json::array();
+        auto thread_count = 0u;
+        for (const auto &event: _events) {
+            nlohmann::json e{
+                    {"name", event.name},
+                    {"cat", event.category},
+                    {"ph", "X"},
+                    {"ts", to_microseconds(event.begin - _origin)},
+                    {"dur", to_microseconds(event.end - event.begin)},
+                    {"pid", 0},
+                    {"tid", event.thread}};
+            if (!event.detail.empty()) {
+                e["args"] = {{"detail", event.detail}};
+            }
+            events.push_back(std::move(e));
+            thread_count = max(thread_count, event.thread + 1u);
+        }
+        for (auto thread = 0u; thread < thread_count; ++thread) {
+            events.push_back({
+                    {"name", "thread_name"},
+                    {"ph", "M"},
+                    {"pid", 0},
+                    {"tid", thread},
+                    {"args", {{"name", thread == 0u ? string{"main"} : serialize("worker ", thread)}}}});
+        }
+
+        std::ofstream file{trace_path};
+        if (!file.is_open()) {
+            GL_RENDER_WARNING("Failed to write trace \"{}\"", trace_path.string());
+            return;
+        }
+        file << nlohmann::json{{"traceEvents", std::move(events)}, {"displayTimeUnit", "ms"}}.dump();
+        GL_RENDER_INFO("Wrote {} trace events to \"{}\"", _events.size(), trace_path.string());
+    }
+
+    ProfileScope::ProfileScope(const char *name, const char *category, string_view detail) noexcept
+            : _name{name}, _category{category}, _enabled{Profiler::GetInstance().enabled()} {
+        if (_enabled) {
+            _detail = detail;
+            _begin = Profiler::clock::now();
+        }
+    }
+
+    ProfileScope::~ProfileScope() noexcept {
+        if (_enabled) {
+            Profiler::GetInstance().record(Profiler::Event{
+                    _name, _category, std::move(_detail), _begin, Profiler::clock::now(), Profiler::thread_index()});
+        }
+    }
+
+}
@@ -0,0 +1,83 @@
+//
+// Created by ChenXin on 2022/11/10.
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+#include <core/stl.h>
+
+namespace gl_render {
+
+    /// Timed scopes of the scene loading, written as a Chrome trace_event file
+    /// (open it in chrome://tracing or ui.perfetto.dev). Nothing is recorded until enable() is called.
+    class Profiler {
+
+    public:
+        using clock = std::chrono::steady_clock;
+
+        struct Event {
+            const char *name;
+            const char *category;
+            string detail;
+            clock::time_point begin;
+            clock::time_point end;
+            uint thread;
+        };
+
+    private:
+        std::atomic<bool> _enabled{false};
+        std::mutex _mutex;
+        gl_render::vector<Event> _events;
+        clock::time_point _origin;
+
+        Profiler() noexcept = default;
+
+    public:
+        static Profiler &GetInstance() noexcept;
+
+        void enable() noexcept;
+        [[nodiscard]] auto enabled() const noexcept { return _enabled.load(std::memory_order_relaxed); }
+
+        void record(Event event) noexcept;
+        /// Write the events recorded so far
+        void save(const path &trace_path) noexcept;
+
+        /// Small id of the calling thread, in order of first use
+        [[nodiscard]] static uint thread_index() noexcept;
+    };
+
+    class ProfileScope {
+
+    private:
+        const char *_name;
+        const char *_category;
+        string _detail;
+        Profiler::clock::time_point _begin;
+        bool _enabled;
+
+    public:
+        explicit ProfileScope(const char *name, const char *category = "load", string_view detail = {}) noexcept;
+        ~ProfileScope() noexcept;
+
+        ProfileScope(ProfileScope &&) = delete;
+        ProfileScope(const ProfileScope &) = delete;
+        ProfileScope &operator=(ProfileScope &&) = delete;
+        ProfileScope &operator=(const ProfileScope &) = delete;
+    };
+
+}
+
+#define GL_RENDER_PROFILE_CONCAT_IMPL(a, b) a##b
+#define GL_RENDER_PROFILE_CONCAT(a, b) GL_RENDER_PROFILE_CONCAT_IMPL(a, b)
+
+/**
+ * @brief Time the enclosing scope
+ *
+ * Ex. GL_RENDER_PROFILE_SCOPE("import mesh", "geometry", mesh_path);
+ */
+#define GL_RENDER_PROFILE_SCOPE(...) \
+    ::gl_render::ProfileScope GL_RENDER_PROFILE_CONCAT(_profile_scope_, __LINE__) { __VA_ARGS__ }
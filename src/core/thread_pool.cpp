@@ -0,0 +1,91 @@
+//
+// Created by ChenXin on 2022/11/2.
+//
+
+#include <core/thread_pool.h>
+
+namespace gl_render {
+
+    ThreadPool::ThreadPool(uint thread_count) noexcept {
+        if (thread_count == 0u) {
+            thread_count = max(std::thread::hardware_concurrency(), 1u);
+        }
+        if (thread_count == 1u) {
+            return;
+        }
+        _workers.reserve(thread_count);
+        for (auto i = 0u; i < thread_count; ++i) {
+            _workers.emplace_back([this] {
+                while (true) {
+                    function<void()> task;
+                    {
+                        std::unique_lock lock{_mutex};
+                        _cv_task.wait(lock, [this] { return _stop || !_tasks.empty(); });
+                        if (_tasks.empty()) {
+                            return;
+                        }
+                        task = std::move(_tasks.front());
+                        _tasks.pop();
+                    }
+                    task();
+                    {
+                        std::lock_guard lock{_mutex};
+                        if (--_pending == 0u) {
+                            _cv_done.notify_all();
+                        }
+                    }
+                }
+            });
+        }
+    }
+
+    ThreadPool::~ThreadPool() noexcept {
+        {
+            std::lock_guard lock{_mutex};
+            _stop = true;
+        }
+        _cv_task.notify_all();
+        for (auto &worker: _workers) {
+            worker.join();
+        }
+    }
+
+    void ThreadPool::dispatch(function<void()> task) noexcept {
+        if (_workers.empty()) {
+            task();
+            return;
+        }
+        {
+            std::lock_guard lock{_mutex};
+            _tasks.push(std::move(task));
+            ++_pending;
+        }
+        _cv_task.notify_one();
+    }
+
+    void ThreadPool::synchronize() noexcept {
+        std::unique_lock lock{_mutex};
+        _cv_done.wait(lock, [this] { return _pending == 0u; });
+    }
+
+    void ThreadPool::parallel_for(size_t n, const function<void(size_t)> &f) noexcept {
+        if (_workers.empty() || n <= 1u) {
+            for (auto i = 0ul; i < n; ++i) {
+                f(i);
+            }
+            return;
+        }
+        // workers grab indices one at a time, so uneven items (e.g. meshes of very different sizes) balance out
+        std::atomic<size_t> next{0u};
+        auto task_count = std::min(n, _workers.size());
+        for (auto t = 0ul; t < task_count; ++t) {
+            dispatch([&next, n, &f] {
+                for (auto i = next.fetch_add(1u); i < n; i = next.fetch_add(1u)) {
+                    f(i);
+                }
+            });
+        }
+        synchronize();
+    }
+
+}
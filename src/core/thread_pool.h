@@ -0,0 +1,47 @@
+//
+// Created by ChenXin on 2022/11/2.
+//
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <core/stl.h>
+
+namespace gl_render {
+
+    class ThreadPool {
+
+    private:
+        gl_render::vector<std::thread> _workers;
+        gl_render::queue<function<void()>> _tasks;
+        std::mutex _mutex;
+        std::condition_variable _cv_task;
+        std::condition_variable _cv_done;
+        size_t _pending{0u};
+        bool _stop{false};
+
+    public:
+        /// thread_count == 0 uses hardware concurrency, thread_count == 1 runs everything on the calling thread
+        explicit ThreadPool(uint thread_count = 0u) noexcept;
+        ~ThreadPool() noexcept;
+
+        ThreadPool(ThreadPool &&) = delete;
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(ThreadPool &&) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        /// Number of threads executing tasks, including the calling thread when the pool is serial
+        [[nodiscard]] auto size() const noexcept { return _workers.empty() ? 1u : static_cast<uint>(_workers.size()); }
+
+        void dispatch(function<void()> task) noexcept;
+        void synchronize() noexcept;
+
+        /// Call f(i) for every i in [0, n), blocks until all calls returned
+        void parallel_for(size_t n, const function<void(size_t)> &f) noexcept;
+    };
+
+}
@@ -9,6 +9,7 @@
 #include <stb/stb_image.h>
 
 #include <core/logger.h>
+#include <core/profiler.h>
 
 namespace gl_render {
 
@@ -134,6 +135,7 @@ namespace gl_render {
     }
 
     gl_render::vector<uchar4> load_ldr_image(const path& input_path, uint2 &resolution) noexcept {
+        GL_RENDER_PROFILE_SCOPE("decode image", "texture", input_path.string());
         int w, h, d;
         auto data = stbi_load(input_path.string().c_str(), &w, &h, &d, 4);
         GL_RENDER_ASSERT(data != nullptr, "Failed to load texture: {}", input_path.string());
@@ -145,6 +147,7 @@ namespace gl_render {
     }
 
     gl_render::vector<float4> load_hdr_image(const path& input_path, uint2 &resolution) noexcept {
+        GL_RENDER_PROFILE_SCOPE("decode image", "texture", input_path.string());
         int w, h;
         gl_render::vector<float4> image;
         if (input_path.extension() == ".exr") {
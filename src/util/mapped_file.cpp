@@ -0,0 +1,85 @@
+//
+// Created by ChenXin on 2022/11/4.
+//
+
+#include <util/mapped_file.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace gl_render {
+
+#ifdef _WIN32
+
+    MappedFile::MappedFile(const path &file_path) noexcept {
+        auto file = CreateFileW(file_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return;
+        }
+        _file_handle = file;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size)) {
+            return;
+        }
+        _size = static_cast<size_t>(size.QuadPart);
+        if (_size == 0u) {
+            _valid = true;
+            return;
+        }
+        _mapping_handle = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (_mapping_handle == nullptr) {
+            return;
+        }
+        _data = static_cast<const std::byte *>(MapViewOfFile(_mapping_handle, FILE_MAP_READ, 0, 0, 0));
+        _valid = _data != nullptr;
+    }
+
+    MappedFile::~MappedFile() noexcept {
+        if (_data != nullptr) {
+            UnmapViewOfFile(_data);
+        }
+        if (_mapping_handle != nullptr) {
+            CloseHandle(_mapping_handle);
+        }
+        if (_file_handle != nullptr) {
+            CloseHandle(_file_handle);
+        }
+    }
+
+#else
+
+    MappedFile::MappedFile(const path &file_path) noexcept {
+        auto fd = open(file_path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st{};
+        if (fstat(fd, &st) == 0) {
+            _size = static_cast<size_t>(st.st_size);
+            if (_size == 0u) {
+                _valid = true;
+            } else if (auto p = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0); p != MAP_FAILED) {
+                _data = static_cast<const std::byte *>(p);
+                _valid = true;
+            }
+        }
+        // the mapping stays valid after the descriptor is closed
+        close(fd);
+    }
+
+    MappedFile::~MappedFile() noexcept {
+        if (_data != nullptr) {
+            munmap(const_cast<std::byte *>(_data), _size);
+        }
+    }
+
+#endif
+
+}
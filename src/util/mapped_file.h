@@ -0,0 +1,39 @@
+//
+// Created by ChenXin on 2022/11/4.
+//
+
+#pragma once
+
+#include <core/stl.h>
+
+namespace gl_render {
+
+    /// Read-only memory mapping of a whole file
+    class MappedFile {
+
+    private:
+        const std::byte *_data{nullptr};
+        size_t _size{0u};
+        bool _valid{false};
+#ifdef _WIN32
+        void *_file_handle{nullptr};
+        void *_mapping_handle{nullptr};
+#endif
+
+    public:
+        explicit MappedFile(const path &file_path) noexcept;
+        ~MappedFile() noexcept;
+
+        MappedFile(MappedFile &&) = delete;
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(MappedFile &&) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        /// false if the file could not be opened or mapped (an empty file is valid, with data() == nullptr)
+        [[nodiscard]] auto valid() const noexcept { return _valid; }
+        [[nodiscard]] auto data() const noexcept { return _data; }
+        [[nodiscard]] auto size() const noexcept { return _size; }
+        [[nodiscard]] auto bytes() const noexcept { return span<const std::byte>{_data, _size}; }
+    };
+
+}
@@ -0,0 +1,18 @@
+//
+// Created by ChenXin on 2022/11/6.
+//
+
+#pragma once
+
+#include <core/stl.h>
+
+namespace gl_render {
+
+    /// Peak resident set size of the process in bytes, 0 if unavailable
+    [[nodiscard]] size_t peak_memory_usage() noexcept;
+
+    [[nodiscard]] inline double to_megabytes(size_t bytes) noexcept {
+        return static_cast<double>(bytes) / (1024.0 * 1024.0);
+    }
+
+}